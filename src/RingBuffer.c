@@ -1,60 +1,272 @@
-#include "RingBuffer.h"
+#include "RingBufferInternal.h"
+#include <string.h>
 
-#define ALIGN_SIZE(size, align)	(((uintptr_t)(size) + ((uintptr_t)(align) - 1)) & ~((uintptr_t)(align) - 1))
-#define ALIGN_PTR(ptr, align)	(void*)(ALIGN_SIZE(ptr, align))
-#define CONTAINER_FOR(ptr, TYPE, member)	((TYPE*)((uint8_t*)(ptr) - (size_t)&((TYPE*)0)->member))
+/**
+* the index slot of a node. slots are direct mapped by sequence number.
+*/
+inline static uint32_t* _ring_buffer_index_slot(ring_buffer_t* rb, uint64_t seq)
+{
+	return &rb->index.slots[seq & rb->index.mask];
+}
+
+inline static uint32_t _ring_buffer_index_value(ring_buffer_t* rb, ring_buffer_node_t* node)
+{
+	return (uint32_t)(((uint8_t*)node - rb->cfg.cache) / sizeof(void*) + 1);
+}
+
+/**
+* give a new node its sequence number and record it in index.
+* a newer node always take the slot, older node sharing the same slot can only be found by walking.
+*/
+inline static void _ring_buffer_index_insert(ring_buffer_t* rb, ring_buffer_node_t* node)
+{
+	*(uint64_t*)&node->token.seq = rb->counter.seq++;
+	if (rb->index.slots == NULL)
+	{
+		return;
+	}
+
+	/* slot of removed node is cleared, so a taken slot belongs to a resident node */
+	uint32_t* slot = _ring_buffer_index_slot(rb, node->token.seq);
+	if (*slot != 0)
+	{
+		const ring_buffer_node_t* displaced = (ring_buffer_node_t*)(rb->cfg.cache + (*slot - 1) * sizeof(void*));
+		if (displaced->token.seq >= rb->index.walk_below)
+		{
+			rb->index.walk_below = displaced->token.seq + 1;
+		}
+	}
+	*slot = _ring_buffer_index_value(rb, node);
+}
+
+/**
+* remove a node from index
+*/
+inline static void _ring_buffer_index_remove(ring_buffer_t* rb, ring_buffer_node_t* node)
+{
+	if (rb->index.slots == NULL)
+	{
+		return;
+	}
+
+	uint32_t* slot = _ring_buffer_index_slot(rb, node->token.seq);
+	if (*slot == _ring_buffer_index_value(rb, node))
+	{
+		*slot = 0;
+	}
+}
+
+/**
+* the first slot to probe for a key
+*/
+inline static size_t _ring_buffer_key_hash(ring_buffer_t* rb, uint64_t key)
+{
+	return (size_t)((key * 0x9E3779B97F4A7C15ULL) >> 32) & rb->conflate.mask;
+}
+
+inline static ring_buffer_node_t* _ring_buffer_key_node(ring_buffer_t* rb, size_t pos)
+{
+	return (ring_buffer_node_t*)(rb->cfg.cache + (rb->conflate.slots[pos] - 1) * sizeof(void*));
+}
+
+/**
+* find the key index slot of a node with the key
+* @return	slot position, or number of slots if not found
+*/
+inline static size_t _ring_buffer_key_find(ring_buffer_t* rb, uint64_t key)
+{
+	size_t pos;
+	for (pos = _ring_buffer_key_hash(rb, key); rb->conflate.slots[pos] != 0; pos = (pos + 1) & rb->conflate.mask)
+	{
+		if (_ring_buffer_node_key(_ring_buffer_key_node(rb, pos))->key == key)
+		{
+			return pos;
+		}
+	}
+	return rb->conflate.mask + 1;
+}
+
+/**
+* add a node to key index. at least one slot is kept empty, so probing always stops.
+*/
+inline static void _ring_buffer_key_insert(ring_buffer_t* rb, ring_buffer_node_t* node)
+{
+	if (rb->conflate.count >= rb->conflate.mask)
+	{
+		return;
+	}
+
+	size_t pos;
+	for (pos = _ring_buffer_key_hash(rb, _ring_buffer_node_key(node)->key); rb->conflate.slots[pos] != 0;
+		pos = (pos + 1) & rb->conflate.mask);
+	rb->conflate.slots[pos] = _ring_buffer_index_value(rb, node);
+	rb->conflate.count++;
+}
+
+/**
+* remove a node from key index if it is there.
+* following entries are shifted back, so no tombstone is needed.
+*/
+inline static void _ring_buffer_key_remove(ring_buffer_t* rb, ring_buffer_node_t* node)
+{
+	const uint32_t value = _ring_buffer_index_value(rb, node);
+	size_t pos;
+	for (pos = _ring_buffer_key_hash(rb, _ring_buffer_node_key(node)->key); rb->conflate.slots[pos] != value;
+		pos = (pos + 1) & rb->conflate.mask)
+	{
+		if (rb->conflate.slots[pos] == 0)
+		{
+			return;
+		}
+	}
+
+	size_t next;
+	for (next = (pos + 1) & rb->conflate.mask; rb->conflate.slots[next] != 0; next = (next + 1) & rb->conflate.mask)
+	{
+		/* entry can move to `pos` only if its home slot is not in (pos, next] */
+		const size_t home = _ring_buffer_key_hash(rb, _ring_buffer_node_key(_ring_buffer_key_node(rb, next))->key);
+		if (((next - home) & rb->conflate.mask) >= ((next - pos) & rb->conflate.mask))
+		{
+			rb->conflate.slots[pos] = rb->conflate.slots[next];
+			pos = next;
+		}
+	}
+	rb->conflate.slots[pos] = 0;
+	rb->conflate.count--;
+}
 
-typedef enum ring_buffer_node_state
+/**
+* memory of removed nodes is going to be written, tokens returned by `ring_buffer_peek` may be invalid.
+* generation is increased before the write, so a reader checking it after reading never miss the change.
+*/
+inline static void _ring_buffer_view_reuse(ring_buffer_t* rb)
 {
-	writing,
-	committed,
-	reading,
-}ring_buffer_node_state_t;
+	if (rb->view.dirty)
+	{
+		rb->view.dirty = 0;
+		atomic_fetch_add_explicit(&rb->view.generation, 1, memory_order_relaxed);
+		atomic_thread_fence(memory_order_release);
+	}
+}
 
-typedef struct ring_buffer_node
+/**
+* account a new node: sequence number, index and fill level
+*/
+inline static void _ring_buffer_node_attach(ring_buffer_t* rb, ring_buffer_node_t* node)
 {
-	struct ring_buffer_node_chain_pos
+	_ring_buffer_index_insert(rb, node);
+	rb->counter.used += _ring_buffer_node_size(node);
+	rb->counter.count++;
+	rb->producers[node->producer].used += _ring_buffer_node_size(node);
+	if (node->flags & ring_buffer_node_flag_expire)
 	{
-		struct ring_buffer_node* p_forward;		/** next position */
-		struct ring_buffer_node* p_backward;	/** previous position */
-	}chain_pos;
+		const uint64_t expire = _ring_buffer_node_expire(node)->expire;
+		rb->expiry.next = rb->expiry.count++ == 0 || expire < rb->expiry.next ? expire : rb->expiry.next;
+	}
+}
 
-	struct ring_buffer_node_chain_time
+/**
+* forget a node. must be called before the memory of node is reused.
+*/
+inline static void _ring_buffer_node_detach(ring_buffer_t* rb, ring_buffer_node_t* node)
+{
+	_ring_buffer_index_remove(rb, node);
+	if (node->flags & ring_buffer_node_flag_key)
 	{
-		struct ring_buffer_node* p_newer;		/** newer node */
-		struct ring_buffer_node* p_older;		/** older node */
-	}chain_time;
+		_ring_buffer_key_remove(rb, node);
+	}
+	rb->counter.used -= _ring_buffer_node_size(node);
+	rb->counter.count--;
+	rb->producers[node->producer].used -= _ring_buffer_node_size(node);
+	if (node->flags & ring_buffer_node_flag_expire)
+	{
+		rb->expiry.count--;
+	}
+	rb->view.dirty = 1;
+	if (node->flags & ring_buffer_node_flag_external)
+	{
+		/* payload is freed now rather than when the space is reused, peeked tokens must be invalid first */
+		_ring_buffer_view_reuse(rb);
+		_ring_buffer_large_release(rb, node);
+	}
+	rb->view.layout++;
+	node->version |= 0x01;
 
-	ring_buffer_node_state_t	state;			/** node state */
-	ring_buffer_token_t			token;			/** user data */
-}ring_buffer_node_t;
+	/* credits are kept in first segment, only nodes reserved with credits give them back */
+	if ((node->flags & ring_buffer_node_flag_credit) && rb->segment.base->credit.producers[node->producer].limit != 0)
+	{
+		_ring_buffer_credit_refund(rb->segment.base, node->producer, _ring_buffer_node_cost(node->token.len));
+	}
+}
 
-struct ring_buffer
+/**
+* notify user once when fill level cross a watermark
+*/
+inline static void _ring_buffer_watermark_check(ring_buffer_t* rb)
 {
-	struct ring_buffer_cfg
+	if (rb->watermark.cb == NULL)
 	{
-		uint8_t*			cache;				/** start of usable address */
-		size_t				capacity;			/** length of usable address */
-	}cfg;
+		return;
+	}
 
-	struct ring_buffer_counter
+	const size_t level = rb->watermark.unit == ring_buffer_watermark_count ? rb->counter.count : rb->counter.used;
+	if (!rb->watermark.above && level >= rb->watermark.high)
+	{
+		rb->watermark.above = 1;
+		rb->watermark.cb(rb, 1, rb->watermark.arg);
+	}
+	else if (rb->watermark.above && level <= rb->watermark.low)
 	{
-		size_t				lost;				/** the number of lost elements form last consume */
-	}counter;
+		rb->watermark.above = 0;
+		rb->watermark.cb(rb, 0, rb->watermark.arg);
+	}
+}
+
+/**
+* a node can be overwritten or claimed only if it is committed and no one is reading it by sequence
+*/
+inline static int _ring_buffer_node_is_free(ring_buffer_node_t* node)
+{
+	return node->state == committed && node->refs == 0;
+}
+
+/**
+* whether a producer is using no more than its quota, if so its nodes cannot be overwritten
+*/
+inline static int _ring_buffer_producer_is_protected(ring_buffer_t* rb, unsigned producer)
+{
+	return rb->producers[producer].quota != 0 && rb->producers[producer].used <= rb->producers[producer].quota;
+}
+
+/**
+* whether a node can be overwritten by a producer
+* @param own_only	producer is over its quota, so it can only overwrite its own nodes
+*/
+inline static int _ring_buffer_node_can_overwrite(ring_buffer_t* rb, ring_buffer_node_t* node, unsigned producer, int own_only)
+{
+	return _ring_buffer_node_is_free(node)
+		&& (own_only ? node->producer == producer : !_ring_buffer_producer_is_protected(rb, node->producer));
+}
 
-	ring_buffer_node_t*		HEAD;				/** point to newest reading/writing/committed node */
-	ring_buffer_node_t*		TAIL;				/** point to oldest reading/writing/committed node */
-	ring_buffer_node_t*		oldest_reserve;		/** point to oldest writing/committed node */
-};
+/**
+* count a node as lost, must be called before the node is detached
+*/
+inline static void _ring_buffer_node_lost(ring_buffer_t* rb, ring_buffer_node_t* node)
+{
+	rb->counter.lost++;
+	rb->producers[node->producer].lost++;
+}
 
 /**
-* calculate how many space a data actually cost
-* @param len	data length
-* @return		actual space
+* delayed nodes and reading nodes are left behind oldest_reserve
 */
-inline static size_t _ring_buffer_node_cost(size_t len)
+inline static void _ring_buffer_skip_claimed(ring_buffer_t* rb)
 {
-	return ALIGN_SIZE(sizeof(ring_buffer_node_t) + len, sizeof(void*));
+	while (rb->oldest_reserve != NULL
+		&& (rb->oldest_reserve->state == delayed || rb->oldest_reserve->state == reading))
+	{
+		rb->oldest_reserve = rb->oldest_reserve->chain_time.p_newer;
+	}
 }
 
 inline static void _ring_buffer_reinit(ring_buffer_t* rb)
@@ -62,6 +274,7 @@ inline static void _ring_buffer_reinit(ring_buffer_t* rb)
 	rb->oldest_reserve = NULL;
 	rb->HEAD = NULL;
 	rb->TAIL = NULL;
+	rb->FRONTIER = NULL;
 }
 
 /**
@@ -80,8 +293,11 @@ inline static ring_buffer_token_t* _ring_buffer_reserve_empty(ring_buffer_t* rb,
 	}
 
 	/* initialize node */
+	_ring_buffer_view_reuse(rb);
 	rb->HEAD = (ring_buffer_node_t*)rb->cfg.cache;
 	rb->HEAD->state = writing;
+	rb->HEAD->refs = 0;
+	rb->HEAD->version = (uint16_t)((rb->HEAD->version | 0x01) + 1);
 	*(size_t*)&rb->HEAD->token.len = data_len;
 
 	/* update chain_pos */
@@ -95,6 +311,7 @@ inline static ring_buffer_token_t* _ring_buffer_reserve_empty(ring_buffer_t* rb,
 	/* initialize other field */
 	rb->TAIL = rb->HEAD;
 	rb->oldest_reserve = rb->HEAD;
+	rb->FRONTIER = rb->HEAD;
 
 	return &rb->oldest_reserve->token;
 }
@@ -108,116 +325,49 @@ inline static void _ring_buffer_update_time_for_new_node(ring_buffer_t* rb, ring
 
 	/* update HEAD */
 	rb->HEAD = new_node;
-}
-
-/**
-* perform overwrite
-*/
-inline static ring_buffer_token_t* _ring_buffer_reserve_overwrite(ring_buffer_t* rb, size_t data_len, size_t node_size)
-{
-	/* overwrite only perform on committed nodes */
-	if (rb->oldest_reserve == NULL || rb->oldest_reserve->state != committed)
-	{
-		return NULL;
-	}
-
-	/* if there is only one node in ring buffer, then check if the whole buffer can hold the new node */
-	if (rb->oldest_reserve->chain_pos.p_forward == rb->oldest_reserve && rb->oldest_reserve->chain_pos.p_backward == rb->oldest_reserve)
-	{
-		if (rb->cfg.capacity >= node_size)
-		{
-			rb->counter.lost++;
-			_ring_buffer_reinit(rb);
-			return _ring_buffer_reserve_empty(rb, data_len, node_size);
-		}
-		return NULL;
-	}
-
-	/* we need to calculate if continuous committed node is large enough to hold new data */
-	size_t sum_size = 0;
-	size_t lost_node = 1;
-	ring_buffer_node_t* node_start = rb->oldest_reserve;
-	ring_buffer_node_t* node_end = node_start;
-
-	while (1)
-	{
-		sum_size += _ring_buffer_node_cost(node_end->token.len);
-		if (!(
-			sum_size < node_size	/* overwrite minimum nodes */
-			&& node_end->chain_pos.p_forward->state == committed	/* only overwrite committed node */
-			&& node_end->chain_pos.p_forward == node_end->chain_time.p_newer	/* node must both physical and time continuous */
-			&& node_end->chain_pos.p_forward > node_end	/* cannot interrupt by array boundary */
-			))
-		{
-			break;
-		}
-		node_end = node_end->chain_pos.p_forward;
-		lost_node++;
-	}
-
-	/* if requirement cannot meet, then overwrite failed */
-	if (sum_size < node_size)
-	{
-		return NULL;
-	}
-
-	/*
-	* here [node_start, node_end] will be overwrite,
-	* oldest_reserve need to move forward.
-	*/
-	rb->oldest_reserve = node_end->chain_time.p_newer;
-
-	/* update chain_pos */
-	node_start->chain_pos.p_forward = node_end->chain_pos.p_forward;
-	node_end->chain_pos.p_forward->chain_pos.p_backward = node_start;
 
-	/* update chain_time */
-	if (node_start->chain_time.p_older != NULL)
+	/* all older nodes are being consumed */
+	if (rb->oldest_reserve == NULL)
 	{
-		node_start->chain_time.p_older->chain_time.p_newer = node_end->chain_time.p_newer;
+		rb->oldest_reserve = new_node;
 	}
-	node_end->chain_time.p_newer->chain_time.p_older = node_start->chain_time.p_older;
-
-	_ring_buffer_update_time_for_new_node(rb, node_start);
-	rb->counter.lost += lost_node;
-
-	/* update length */
-	*(size_t*)&node_start->token.len = data_len;
-
-	return &node_start->token;
 }
 
 inline static void _ring_buffer_insert_new_node(ring_buffer_t* rb, ring_buffer_node_t* new_node, size_t data_len)
 {
+	_ring_buffer_view_reuse(rb);
+
 	/* initialize token */
 	new_node->state = writing;
+	new_node->refs = 0;
+	new_node->version = (uint16_t)((new_node->version | 0x01) + 1);
 	*(size_t*)&new_node->token.len = data_len;
 
 	/* update chain_pos */
-	new_node->chain_pos.p_forward = rb->HEAD->chain_pos.p_forward;
-	new_node->chain_pos.p_backward = rb->HEAD;
+	new_node->chain_pos.p_forward = rb->FRONTIER->chain_pos.p_forward;
+	new_node->chain_pos.p_backward = rb->FRONTIER;
 	new_node->chain_pos.p_forward->chain_pos.p_backward = new_node;
 	new_node->chain_pos.p_backward->chain_pos.p_forward = new_node;
+	rb->FRONTIER = new_node;
 
 	_ring_buffer_update_time_for_new_node(rb, new_node);
 }
 
-inline static ring_buffer_token_t* _ring_buffer_reserve_none_empty(ring_buffer_t* rb, size_t data_len, size_t node_size, int flags)
+inline static ring_buffer_token_t* _ring_buffer_reserve_none_empty(ring_buffer_t* rb, size_t data_len, size_t node_size)
 {
 	/* calculate possible node position on the right */
-	ring_buffer_node_t* next_possible_node = (ring_buffer_node_t*)((uint8_t*)rb->HEAD + _ring_buffer_node_cost(rb->HEAD->token.len));
+	ring_buffer_node_t* next_possible_node = (ring_buffer_node_t*)((uint8_t*)rb->FRONTIER + _ring_buffer_node_size(rb->FRONTIER));
 
 	/* if there exists node on the right, then try to make token */
-	if (rb->HEAD->chain_pos.p_forward > rb->HEAD)
+	if (rb->FRONTIER->chain_pos.p_forward > rb->FRONTIER)
 	{
-		if ((size_t)((uint8_t*)rb->HEAD->chain_pos.p_forward - (uint8_t*)next_possible_node) >= node_size)
+		if ((size_t)((uint8_t*)rb->FRONTIER->chain_pos.p_forward - (uint8_t*)next_possible_node) >= node_size)
 		{
 			_ring_buffer_insert_new_node(rb, next_possible_node, data_len);
 			return &next_possible_node->token;
 		}
 
-		return (flags & ring_buffer_flag_overwrite) ?
-			_ring_buffer_reserve_overwrite(rb, data_len, node_size) : NULL;
+		return NULL;
 	}
 
 	/* if higher area has enough space, make token */
@@ -229,7 +379,7 @@ inline static ring_buffer_token_t* _ring_buffer_reserve_none_empty(ring_buffer_t
 	}
 
 	/* if area on the most left cache is enough, make token */
-	if ((size_t)((uint8_t*)rb->HEAD->chain_pos.p_forward - rb->cfg.cache) >= node_size)
+	if ((size_t)((uint8_t*)rb->FRONTIER->chain_pos.p_forward - rb->cfg.cache) >= node_size)
 	{
 		next_possible_node = (ring_buffer_node_t*)rb->cfg.cache;
 		_ring_buffer_insert_new_node(rb, next_possible_node, data_len);
@@ -237,19 +387,15 @@ inline static ring_buffer_token_t* _ring_buffer_reserve_none_empty(ring_buffer_t
 		return &next_possible_node->token;
 	}
 
-	/* in other condition, overwrite if needed */
-	return (flags & ring_buffer_flag_overwrite) ?
-		_ring_buffer_reserve_overwrite(rb, data_len, node_size) : NULL;
-}
-
-inline static int _ring_buffer_commit_for_write_confirm(ring_buffer_t* rb, ring_buffer_node_t* node)
-{
-	node->state = committed;
-	return 0;
+	return NULL;
 }
 
-inline static void _ring_buffer_remove_node_chain_pos(ring_buffer_node_t* node)
+inline static void _ring_buffer_remove_node_chain_pos(ring_buffer_t* rb, ring_buffer_node_t* node)
 {
+	if (rb->FRONTIER == node)
+	{
+		rb->FRONTIER = node->chain_pos.p_backward;
+	}
 	node->chain_pos.p_backward->chain_pos.p_forward = node->chain_pos.p_forward;
 	node->chain_pos.p_forward->chain_pos.p_backward = node->chain_pos.p_backward;
 }
@@ -257,7 +403,7 @@ inline static void _ring_buffer_remove_node_chain_pos(ring_buffer_node_t* node)
 inline static void _ring_buffer_remove_tail(ring_buffer_t* rb)
 {
 	/* update chain_pos */
-	_ring_buffer_remove_node_chain_pos(rb->TAIL);
+	_ring_buffer_remove_node_chain_pos(rb, rb->TAIL);
 
 	/* update chain_time */
 	rb->TAIL->chain_time.p_newer->chain_time.p_older = NULL;
@@ -273,7 +419,7 @@ inline static void _ring_buffer_remove_tail(ring_buffer_t* rb)
 inline static void _ring_buffer_remove_head(ring_buffer_t* rb)
 {
 	/* update chain_pos */
-	_ring_buffer_remove_node_chain_pos(rb->HEAD);
+	_ring_buffer_remove_node_chain_pos(rb, rb->HEAD);
 
 	/* update chain_time */
 	rb->HEAD->chain_time.p_older->chain_time.p_newer = NULL;
@@ -291,6 +437,8 @@ inline static void _ring_buffer_remove_head(ring_buffer_t* rb)
 */
 inline static void _ring_buffer_delete_node(ring_buffer_t* rb, ring_buffer_node_t* node)
 {
+	_ring_buffer_node_detach(rb, node);
+
 	/* only node in ring buffer */
 	if (node->chain_pos.p_backward == node && node->chain_pos.p_forward == node)
 	{
@@ -322,7 +470,7 @@ inline static void _ring_buffer_delete_node(ring_buffer_t* rb, ring_buffer_node_
 		return ;
 	}
 
-	_ring_buffer_remove_node_chain_pos(node);
+	_ring_buffer_remove_node_chain_pos(rb, node);
 	/* in other condition, just take care about `oldest_reserve` */
 	node->chain_time.p_older->chain_time.p_newer = node->chain_time.p_newer;
 	node->chain_time.p_newer->chain_time.p_older = node->chain_time.p_older;
@@ -334,149 +482,1479 @@ inline static void _ring_buffer_delete_node(ring_buffer_t* rb, ring_buffer_node_
 	return ;
 }
 
-inline static int _ring_buffer_commit_for_write_discard(ring_buffer_t* rb, ring_buffer_node_t* node)
-{
-	_ring_buffer_delete_node(rb, node);
-	return 0;
-}
-
-inline static int _ring_buffer_commit_for_write(ring_buffer_t* rb, ring_buffer_node_t* node, int flags)
-{
-	return (flags & ring_buffer_flag_discard) ?
-		_ring_buffer_commit_for_write_discard(rb, node) :
-		_ring_buffer_commit_for_write_confirm(rb, node);
-}
-
-inline static int _ring_buffer_commit_for_consume_confirm(ring_buffer_t* rb, ring_buffer_node_t* node)
-{
-	_ring_buffer_delete_node(rb, node);
-	return 0;
-}
-
 /**
-* discard a consumed token.
-* the only condition a consumed token can be discard is no one consume newer token
+* remove a node from chain_time only, its space still belongs to it
 */
-inline static int _ring_buffer_commit_for_consume_discard(ring_buffer_t* rb, ring_buffer_node_t* node, int flags)
+inline static void _ring_buffer_remove_node_chain_time(ring_buffer_t* rb, ring_buffer_node_t* node)
 {
-	/* if exist a newer consumer, should fail */
-	if (node->chain_time.p_newer != NULL && node->chain_time.p_newer->state == reading)
+	ring_buffer_node_t* node_older = node->chain_time.p_older;
+	ring_buffer_node_t* node_newer = node->chain_time.p_newer;
+
+	if (node_older != NULL)
 	{
-		return (flags & ring_buffer_flag_consume_on_error) ?
-			_ring_buffer_commit_for_consume_confirm(rb, node) : -1;
+		node_older->chain_time.p_newer = node_newer;
 	}
-
-	/* modify state */
-	node->state = committed;
-
-	/* if no newer node, then oldest_reserve should point to this node */
-	if (node->chain_time.p_newer == NULL)
+	else
 	{
-		rb->oldest_reserve = node;
-		return 0;
+		rb->TAIL = node_newer;
 	}
 
-	/* if node is just older than oldest_reserve, then oldest_reserve should move back */
-	if (rb->oldest_reserve != NULL && rb->oldest_reserve->chain_time.p_older == node)
+	if (node_newer != NULL)
 	{
-		rb->oldeest_reserve = node;
-		return 0;
+		node_newer->chain_time.p_older = node_older;
+	}
+	else
+	{
+		rb->HEAD = node_older;
 	}
-	
-	return 0;
-}
 
-inline static int _ring_buffer_commit_for_consume(ring_buffer_t* rb, ring_buffer_node_t* node, int flags)
-{
-	return (flags & ring_buffer_flag_discard) ?
-		_ring_buffer_commit_for_consume_discard(rb, node, flags) :
-		_ring_buffer_commit_for_consume_confirm(rb, node);
+	if (rb->oldest_reserve == node)
+	{
+		rb->oldest_reserve = node_newer;
+	}
 }
 
-size_t ring_buffer_heap_cost(void)
+/**
+* bytes from `node_start` to the node physically after `node_end`.
+* holes left by dropped nodes are counted, so they save live nodes from being overwritten.
+*/
+inline static size_t _ring_buffer_span_space(ring_buffer_t* rb, ring_buffer_node_t* node_start, ring_buffer_node_t* node_end)
 {
-	/* need to align with machine size */
-	return ALIGN_SIZE(sizeof(struct ring_buffer), sizeof(void*));
+	const uint8_t* stop = node_end->chain_pos.p_forward > node_end ?
+		(uint8_t*)node_end->chain_pos.p_forward : rb->cfg.cache + rb->cfg.capacity;
+	return (size_t)(stop - (uint8_t*)node_start);
 }
 
-size_t ring_buffer_node_cost(size_t len)
+/**
+* perform overwrite.
+* start from the oldest node this producer can overwrite, and take physically continuous nodes after it.
+*/
+inline static ring_buffer_token_t* _ring_buffer_reserve_overwrite(ring_buffer_t* rb, size_t data_len, size_t node_size, unsigned producer)
 {
-	return _ring_buffer_node_cost(len);
-}
+	const int own_only = rb->producers[producer].quota != 0
+		&& rb->producers[producer].used + node_size > rb->producers[producer].quota;
 
-ring_buffer_t* ring_buffer_init(void* buffer, size_t size)
-{
-	ring_buffer_t* rb = ALIGN_PTR(buffer, sizeof(void*));
+	/* skip nodes protected by quota */
+	_ring_buffer_skip_claimed(rb);
+	ring_buffer_node_t* node_start = rb->oldest_reserve;
+	while (node_start != NULL && _ring_buffer_node_is_free(node_start)
+		&& !_ring_buffer_node_can_overwrite(rb, node_start, producer, own_only))
+	{
+		node_start = node_start->chain_time.p_newer;
+	}
 
-	/* ring buffer must start from aligned address */
-	const size_t leading_align_size = (uint8_t*)rb - (uint8_t*)buffer;
+	/* overwrite only perform on committed nodes */
+	if (node_start == NULL || !_ring_buffer_node_can_overwrite(rb, node_start, producer, own_only))
+	{
+		return NULL;
+	}
 
-	/* check if buffer has enough space */
-	if (leading_align_size + ring_buffer_heap_cost() >= size)
-	{/* out of range */
+	/* if there is only one node in ring buffer, then check if the whole buffer can hold the new node */
+	if (node_start->chain_pos.p_forward == node_start && node_start->chain_pos.p_backward == node_start)
+	{
+		if (rb->cfg.capacity >= node_size)
+		{
+			_ring_buffer_node_lost(rb, node_start);
+			_ring_buffer_node_detach(rb, node_start);
+			_ring_buffer_reinit(rb);
+			return _ring_buffer_reserve_empty(rb, data_len, node_size);
+		}
 		return NULL;
 	}
 
-	/* setup necessary field */
-	rb->cfg.cache = (uint8_t*)rb + ring_buffer_heap_cost();
-	rb->cfg.capacity = size - leading_align_size - ring_buffer_heap_cost();
+	/* we need to calculate if continuous committed node is large enough to hold new data */
+	ring_buffer_node_t* node_end = node_start;
+	size_t sum_size = _ring_buffer_span_space(rb, node_start, node_end);
+	while (sum_size < node_size	/* overwrite minimum nodes */
+		&& node_end->chain_pos.p_forward > node_end	/* cannot interrupt by array boundary */
+		&& _ring_buffer_node_can_overwrite(rb, node_end->chain_pos.p_forward, producer, own_only))
+	{
+		node_end = node_end->chain_pos.p_forward;
+		sum_size = _ring_buffer_span_space(rb, node_start, node_end);
+	}
+
+	/* if requirement cannot meet, then overwrite failed */
+	if (sum_size < node_size)
+	{
+		return NULL;
+	}
+
+	/* here [node_start, node_end] will be overwrite, space of other nodes is merged into node_start */
+	ring_buffer_node_t* node_stop = node_end->chain_pos.p_forward;
+	while (node_start->chain_pos.p_forward != node_stop)
+	{
+		_ring_buffer_node_lost(rb, node_start->chain_pos.p_forward);
+		_ring_buffer_delete_node(rb, node_start->chain_pos.p_forward);
+	}
+	_ring_buffer_node_lost(rb, node_start);
+	_ring_buffer_node_detach(rb, node_start);
+	_ring_buffer_remove_node_chain_time(rb, node_start);
+
+	/* node_start become the newest node */
+	if (rb->HEAD == NULL)
+	{
+		node_start->chain_time.p_newer = NULL;
+		node_start->chain_time.p_older = NULL;
+		rb->HEAD = node_start;
+		rb->TAIL = node_start;
+	}
+	else
+	{
+		_ring_buffer_update_time_for_new_node(rb, node_start);
+	}
+	if (rb->oldest_reserve == NULL)
+	{
+		rb->oldest_reserve = node_start;
+	}
+
+	rb->FRONTIER = node_start;
+
+	/* initialize token */
+	_ring_buffer_view_reuse(rb);
+	node_start->state = writing;
+	node_start->refs = 0;
+	node_start->version = (uint16_t)((node_start->version | 0x01) + 1);
+	*(size_t*)&node_start->token.len = data_len;
+
+	return &node_start->token;
+}
+
+/**
+* whether a node is expired at `now`
+*/
+inline static int _ring_buffer_node_is_expired(ring_buffer_node_t* node, uint64_t now)
+{
+	return (node->flags & ring_buffer_node_flag_expire) && _ring_buffer_node_expire(node)->expire <= now;
+}
+
+/**
+* drop expired nodes from the oldest one, until a node not expired.
+* consumers use it, so expired elements are never handed out.
+* @return	how many nodes are dropped
+*/
+inline static size_t _ring_buffer_drop_expired_oldest(ring_buffer_t* rb)
+{
+	if (rb->clock.now == NULL || rb->expiry.count == 0)
+	{
+		return 0;
+	}
+
+	const uint64_t now = rb->clock.now(rb->clock.arg);
+	size_t cnt = 0;
+	while (rb->oldest_reserve != NULL && _ring_buffer_node_is_free(rb->oldest_reserve)
+		&& _ring_buffer_node_is_expired(rb->oldest_reserve, now))
+	{
+		_ring_buffer_delete_node(rb, rb->oldest_reserve);
+		cnt++;
+	}
+
+	rb->counter.expired += cnt;
+	return cnt;
+}
+
+/**
+* drop every expired node, wherever it is, before live elements are overwritten.
+* the whole ring is only walked when some node may have expired, and the walk computes the next time to look.
+* @return	how many nodes are dropped
+*/
+inline static size_t _ring_buffer_drop_expired_all(ring_buffer_t* rb)
+{
+	if (rb->clock.now == NULL || rb->expiry.count == 0)
+	{
+		return 0;
+	}
+
+	const uint64_t now = rb->clock.now(rb->clock.arg);
+	if (now < rb->expiry.next)
+	{
+		return 0;
+	}
+
+	size_t cnt = 0;
+	uint64_t next = UINT64_MAX;
+	ring_buffer_node_t* node = rb->TAIL;
+	while (node != NULL)
+	{
+		ring_buffer_node_t* newer = node->chain_time.p_newer;
+		if (node->flags & ring_buffer_node_flag_expire)
+		{
+			const uint64_t expire = _ring_buffer_node_expire(node)->expire;
+			if (expire <= now && _ring_buffer_node_is_free(node))
+			{
+				_ring_buffer_delete_node(rb, node);
+				cnt++;
+			}
+			else if (expire < next)
+			{
+				next = expire;
+			}
+		}
+		node = newer;
+	}
+
+	/* nodes in use are kept in `next`, so they are looked at again once released */
+	rb->expiry.next = next;
+	rb->counter.expired += cnt;
+	return cnt;
+}
+
+inline static ring_buffer_token_t* _ring_buffer_reserve_space(ring_buffer_t* rb, size_t data_len, size_t node_size)
+{
+	/* empty ring buffer or non empty ring buffer */
+	return rb->TAIL == NULL ?
+		_ring_buffer_reserve_empty(rb, data_len, node_size) :
+		_ring_buffer_reserve_none_empty(rb, data_len, node_size);
+}
+
+/**
+* index of lowest set bit
+*/
+inline static unsigned _ring_buffer_ctz64(uint64_t value)
+{
+#if defined(__GNUC__)
+	return (unsigned)__builtin_ctzll(value);
+#else
+	unsigned idx = 0;
+	for (; !(value & 0x01); value >>= 1, idx++);
+	return idx;
+#endif
+}
+
+/**
+* append a node to a circular list
+* @param p_last	last node of the list
+* @param node	node to append
+*/
+inline static void _ring_buffer_timer_push(ring_buffer_node_t** p_last, ring_buffer_node_t* node)
+{
+	ring_buffer_node_timer_t* timer = _ring_buffer_node_timer(node);
+	if (*p_last == NULL)
+	{
+		timer->p_next = node;
+	}
+	else
+	{
+		timer->p_next = _ring_buffer_node_timer(*p_last)->p_next;
+		_ring_buffer_node_timer(*p_last)->p_next = node;
+	}
+	*p_last = node;
+}
+
+/**
+* a delayed node is due, it becomes the newest committed node with a new sequence number
+*/
+inline static void _ring_buffer_timer_release(ring_buffer_t* rb, ring_buffer_node_t* node)
+{
+	rb->timer.pending--;
+	rb->view.layout++;
+
+	_ring_buffer_remove_node_chain_time(rb, node);
+	if (rb->HEAD == NULL)
+	{
+		node->chain_time.p_newer = NULL;
+		node->chain_time.p_older = NULL;
+		rb->HEAD = node;
+		rb->TAIL = node;
+	}
+	else
+	{
+		_ring_buffer_update_time_for_new_node(rb, node);
+	}
+	if (rb->oldest_reserve == NULL)
+	{
+		rb->oldest_reserve = node;
+	}
+
+	_ring_buffer_index_remove(rb, node);
+	_ring_buffer_index_insert(rb, node);
+	node->state = committed;
+}
+
+/**
+* put a delayed node into timing wheel, or release it if due.
+* a node is put on the lowest level where its time shares higher bits with current time,
+* so every slot in use is after the slot of current time on its level.
+*/
+inline static void _ring_buffer_timer_insert(ring_buffer_t* rb, ring_buffer_node_t* node)
+{
+	const uint64_t not_before = _ring_buffer_node_timer(node)->not_before;
+	if (not_before <= rb->timer.current)
+	{
+		_ring_buffer_timer_release(rb, node);
+		return;
+	}
+
+	unsigned level;
+	for (level = 0; level < RING_BUFFER_TIMER_LEVELS; level++)
+	{
+		const unsigned shift = RING_BUFFER_TIMER_BITS * (level + 1);
+		if ((not_before >> shift) == (rb->timer.current >> shift))
+		{
+			const unsigned idx = (unsigned)(not_before >> (RING_BUFFER_TIMER_BITS * level)) & RING_BUFFER_TIMER_MASK;
+			_ring_buffer_timer_push(&rb->timer.slots[level][idx], node);
+			rb->timer.bitmap[level] |= (uint64_t)1 << idx;
+			return;
+		}
+	}
+
+	_ring_buffer_timer_push(&rb->timer.overflow, node);
+}
+
+/**
+* insert all nodes in a list again
+*/
+inline static void _ring_buffer_timer_reinsert(ring_buffer_t* rb, ring_buffer_node_t* last)
+{
+	ring_buffer_node_t* node = _ring_buffer_node_timer(last)->p_next;
+	while (1)
+	{
+		ring_buffer_node_t* next_node = _ring_buffer_node_timer(node)->p_next;
+		_ring_buffer_timer_insert(rb, node);
+		if (node == last)
+		{
+			break;
+		}
+		node = next_node;
+	}
+}
+
+/**
+* calculate next time something need to be done: a slot on level 0 is due, or a slot on higher level need to cascade
+*/
+inline static uint64_t _ring_buffer_timer_next(ring_buffer_t* rb)
+{
+	uint64_t next = UINT64_MAX;
+
+	unsigned level;
+	for (level = 0; level < RING_BUFFER_TIMER_LEVELS; level++)
+	{
+		const unsigned shift = RING_BUFFER_TIMER_BITS * level;
+		const unsigned current_idx = (unsigned)(rb->timer.current >> shift) & RING_BUFFER_TIMER_MASK;
+		const uint64_t bitmap = rb->timer.bitmap[level] & ~((((uint64_t)2) << current_idx) - 1);
+		if (bitmap == 0)
+		{
+			continue;
+		}
+
+		const uint64_t base = (rb->timer.current >> (shift + RING_BUFFER_TIMER_BITS)) << (shift + RING_BUFFER_TIMER_BITS);
+		const uint64_t time = base | ((uint64_t)_ring_buffer_ctz64(bitmap) << shift);
+		next = time < next ? time : next;
+	}
+
+	if (rb->timer.overflow != NULL)
+	{
+		const unsigned shift = RING_BUFFER_TIMER_BITS * RING_BUFFER_TIMER_LEVELS;
+		const uint64_t time = ((rb->timer.current >> shift) + 1) << shift;
+		next = time < next ? time : next;
+	}
+
+	return next;
+}
+
+/**
+* process one time point: cascade higher levels, then release due nodes
+*/
+inline static void _ring_buffer_timer_expire(ring_buffer_t* rb, uint64_t time)
+{
+	ring_buffer_node_t* last;
+	const unsigned overflow_shift = RING_BUFFER_TIMER_BITS * RING_BUFFER_TIMER_LEVELS;
+	if ((time & (((uint64_t)1 << overflow_shift) - 1)) == 0 && (last = rb->timer.overflow) != NULL)
+	{
+		rb->timer.overflow = NULL;
+		_ring_buffer_timer_reinsert(rb, last);
+	}
+
+	int level;
+	for (level = RING_BUFFER_TIMER_LEVELS - 1; level >= 0; level--)
+	{
+		const unsigned shift = RING_BUFFER_TIMER_BITS * level;
+		if ((time & (((uint64_t)1 << shift) - 1)) != 0)
+		{
+			continue;
+		}
+
+		const unsigned idx = (unsigned)(time >> shift) & RING_BUFFER_TIMER_MASK;
+		if ((last = rb->timer.slots[level][idx]) != NULL)
+		{
+			rb->timer.slots[level][idx] = NULL;
+			rb->timer.bitmap[level] &= ~((uint64_t)1 << idx);
+			_ring_buffer_timer_reinsert(rb, last);
+		}
+	}
+}
+
+/**
+* move timing wheel to current time, release all due nodes
+*/
+inline static void _ring_buffer_timer_advance(ring_buffer_t* rb)
+{
+	if (rb->clock.now == NULL)
+	{
+		return;
+	}
+
+	const uint64_t now = rb->clock.now(rb->clock.arg);
+	while (rb->timer.pending != 0)
+	{
+		const uint64_t next = _ring_buffer_timer_next(rb);
+		if (next > now)
+		{
+			break;
+		}
+
+		rb->timer.current = next;
+		_ring_buffer_timer_expire(rb, next);
+	}
+
+	if (now > rb->timer.current)
+	{
+		rb->timer.current = now;
+	}
+}
+
+/**
+* link a node into chain_time right after `after`
+*/
+inline static void _ring_buffer_insert_time_after(ring_buffer_t* rb, ring_buffer_node_t* node, ring_buffer_node_t* after)
+{
+	node->chain_time.p_older = after;
+	node->chain_time.p_newer = after->chain_time.p_newer;
+	if (after->chain_time.p_newer != NULL)
+	{
+		after->chain_time.p_newer->chain_time.p_older = node;
+	}
+	else
+	{
+		rb->HEAD = node;
+	}
+	after->chain_time.p_newer = node;
+}
+
+/**
+* replace the pending node with the same key by a newly committed node.
+* if they take the same space, new data is copied into the old node and the new node is removed,
+* so no hole is left behind the newest node. otherwise the old node is removed.
+* a node being read is not pending anymore, the new node just takes its place in key index.
+*/
+inline static void _ring_buffer_conflate(ring_buffer_t* rb, ring_buffer_node_t* node)
+{
+	const size_t pos = _ring_buffer_key_find(rb, _ring_buffer_node_key(node)->key);
+	if (pos > rb->conflate.mask)
+	{
+		_ring_buffer_key_insert(rb, node);
+		return;
+	}
+
+	ring_buffer_node_t* old = _ring_buffer_key_node(rb, pos);
+	if (!_ring_buffer_node_is_free(old))
+	{
+		rb->conflate.slots[pos] = _ring_buffer_index_value(rb, node);
+		return;
+	}
+
+	rb->counter.conflated++;
+	if (old->flags == node->flags && _ring_buffer_node_cost(old->token.len) == _ring_buffer_node_cost(node->token.len))
+	{
+		rb->view.dirty = 1;
+		_ring_buffer_view_reuse(rb);
+		old->version++;
+		atomic_thread_fence(memory_order_release);
+		memcpy(old->token.data, node->token.data, node->token.len);
+		*(size_t*)&old->token.len = node->token.len;
+		if (old->flags & ring_buffer_node_flag_crc)
+		{
+			_ring_buffer_node_crc(old)->crc = _ring_buffer_node_crc(node)->crc;
+		}
+		if (old->flags & ring_buffer_node_flag_expire)
+		{
+			_ring_buffer_node_expire(old)->expire = _ring_buffer_node_expire(node)->expire;
+			rb->expiry.next = _ring_buffer_node_expire(node)->expire < rb->expiry.next ? _ring_buffer_node_expire(node)->expire : rb->expiry.next;
+		}
+		atomic_thread_fence(memory_order_release);
+		old->version++;
+
+		/* old node takes place and sequence number of the new one, so nodes stay in sequence order */
+		const uint64_t seq = node->token.seq;
+		_ring_buffer_index_remove(rb, old);
+		_ring_buffer_remove_node_chain_time(rb, old);
+		_ring_buffer_insert_time_after(rb, old, node);
+		_ring_buffer_delete_node(rb, node);
+		*(uint64_t*)&old->token.seq = seq;
+		if (rb->index.slots != NULL)
+		{
+			*_ring_buffer_index_slot(rb, seq) = _ring_buffer_index_value(rb, old);
+		}
+		return;
+	}
+
+	_ring_buffer_delete_node(rb, old);
+	_ring_buffer_key_insert(rb, node);
+}
+
+inline static int _ring_buffer_commit_for_write_confirm(ring_buffer_t* rb, ring_buffer_node_t* node)
+{
+	if ((node->flags & (ring_buffer_node_flag_crc | ring_buffer_node_flag_crc_ready)) == ring_buffer_node_flag_crc)
+	{
+		size_t len;
+		const uint8_t* data = _ring_buffer_node_payload(node, &len);
+		_ring_buffer_node_crc(node)->crc = _ring_buffer_crc32c(data, len);
+	}
+	node->flags &= ~ring_buffer_node_flag_crc_ready;
+
+	/* data is visible before state, for readers without lock */
+	atomic_thread_fence(memory_order_release);
+	if (!(node->flags & ring_buffer_node_flag_timer))
+	{
+		node->state = committed;
+		if (node->flags & ring_buffer_node_flag_key)
+		{
+			_ring_buffer_conflate(rb, node);
+		}
+		return 0;
+	}
+
+	node->state = delayed;
+	rb->timer.pending++;
+	_ring_buffer_timer_advance(rb);
+	_ring_buffer_timer_insert(rb, node);
+	return 0;
+}
+
+inline static int _ring_buffer_commit_for_write_discard(ring_buffer_t* rb, ring_buffer_node_t* node)
+{
+	_ring_buffer_delete_node(rb, node);
+	return 0;
+}
+
+inline static int _ring_buffer_commit_for_write(ring_buffer_t* rb, ring_buffer_node_t* node, int flags)
+{
+	return (flags & ring_buffer_flag_discard) ?
+		_ring_buffer_commit_for_write_discard(rb, node) :
+		_ring_buffer_commit_for_write_confirm(rb, node);
+}
+
+inline static int _ring_buffer_commit_for_consume_confirm(ring_buffer_t* rb, ring_buffer_node_t* node)
+{
+	_ring_buffer_delete_node(rb, node);
+	return 0;
+}
+
+/**
+* discard a consumed token.
+* the only condition a consumed token can be discard is no one consume newer token
+*/
+inline static int _ring_buffer_commit_for_consume_discard(ring_buffer_t* rb, ring_buffer_node_t* node, int flags)
+{
+	/* if exist a newer consumer, should fail */
+	if (node->chain_time.p_newer != NULL && node->chain_time.p_newer->state == reading)
+	{
+		return (flags & ring_buffer_flag_consume_on_error) ?
+			_ring_buffer_commit_for_consume_confirm(rb, node) : -1;
+	}
+
+	/* modify state */
+	node->state = committed;
+
+	/* if node is older than oldest_reserve, then oldest_reserve should move back. sequence number follows chain_time */
+	if (rb->oldest_reserve == NULL || node->token.seq < rb->oldest_reserve->token.seq)
+	{
+		rb->oldest_reserve = node;
+	}
+
+	return 0;
+}
+
+inline static int _ring_buffer_commit_for_consume(ring_buffer_t* rb, ring_buffer_node_t* node, int flags)
+{
+	/* token got by sequence stay resident, consumer need seek back to replay it */
+	if (node->state == committed)
+	{
+		node->refs--;
+		return 0;
+	}
+
+	return (flags & ring_buffer_flag_discard) ?
+		_ring_buffer_commit_for_consume_discard(rb, node, flags) :
+		_ring_buffer_commit_for_consume_confirm(rb, node);
+}
+
+/**
+* calculate how many index slots a ring buffer should have.
+* one slot for every smallest node, so all resident nodes can be indexed when sequence numbers are dense.
+* @param size	memory size available for index and cache
+* @return		number of slots, power of 2. 0 means no index
+*/
+inline static size_t _ring_buffer_index_slots(size_t size)
+{
+	size_t want = size / (_ring_buffer_node_cost(0) + sizeof(uint32_t));
+
+	/* offsets must fit in slot */
+	if (size / sizeof(void*) >= UINT32_MAX)
+	{
+		return 0;
+	}
+
+	size_t slots = 1;
+	while (slots * 2 <= want)
+	{
+		slots *= 2;
+	}
+	return want == 0 ? 0 : slots;
+}
+
+/**
+* calculate hash bits of compressor table a ring buffer should have.
+* one entry for every 64 bytes, a small ring buffer holds small elements which need no big table.
+* @param size	memory size available for table and cache
+* @return		hash bits. 0 means no table, elements are not compressed
+*/
+inline static unsigned _ring_buffer_lz_bits(size_t size)
+{
+	unsigned bits = 0;
+	while (bits < RING_BUFFER_LZ_HASH_BITS && ((size_t)2 << bits) <= size / 64)
+	{
+		bits++;
+	}
+	return bits < 4 ? 0 : bits;
+}
+
+/**
+* find a node by walking chain_time, start from the nearer end.
+*/
+inline static ring_buffer_node_t* _ring_buffer_find_by_walk(ring_buffer_t* rb, uint64_t seq)
+{
+	if (rb->TAIL == NULL || seq < rb->TAIL->token.seq || seq > rb->HEAD->token.seq)
+	{
+		return NULL;
+	}
+
+	ring_buffer_node_t* node;
+	if (seq - rb->TAIL->token.seq < rb->HEAD->token.seq - seq)
+	{
+		for (node = rb->TAIL; node != NULL && node->token.seq < seq; node = node->chain_time.p_newer);
+	}
+	else
+	{
+		for (node = rb->HEAD; node != NULL && node->token.seq > seq; node = node->chain_time.p_older);
+	}
+
+	return (node != NULL && node->token.seq == seq) ? node : NULL;
+}
+
+/**
+* find a resident node by sequence number
+* @param rb		ring buffer
+* @param seq	sequence number
+* @return		node, or NULL if not resident
+*/
+inline static ring_buffer_node_t* _ring_buffer_find(ring_buffer_t* rb, uint64_t seq)
+{
+	ring_buffer_node_t* node = NULL;
+
+	if (rb->index.slots != NULL)
+	{
+		uint32_t value = *_ring_buffer_index_slot(rb, seq);
+		node = value != 0 ? (ring_buffer_node_t*)(rb->cfg.cache + (value - 1) * sizeof(void*)) : NULL;
+	}
+
+	if (node != NULL && node->token.seq == seq)
+	{
+		return node;
+	}
+
+	/* slot may be taken by a newer node */
+	if (rb->index.slots == NULL || seq < rb->index.walk_below)
+	{
+		return _ring_buffer_find_by_walk(rb, seq);
+	}
+	return NULL;
+}
+
+/**
+* find the oldest resident node whose sequence number is not less than `seq`
+*/
+inline static ring_buffer_node_t* _ring_buffer_find_from(ring_buffer_t* rb, uint64_t seq)
+{
+	if (rb->TAIL == NULL || seq > rb->HEAD->token.seq)
+	{
+		return NULL;
+	}
+	if (seq <= rb->TAIL->token.seq)
+	{
+		return rb->TAIL;
+	}
+
+	/* holes are left by removed nodes, short ones are skipped by index */
+	ring_buffer_node_t* node;
+	const uint64_t seq_end = seq + 16;
+	for (; seq < seq_end; seq++)
+	{
+		if ((node = _ring_buffer_find(rb, seq)) != NULL)
+		{
+			return node;
+		}
+	}
+
+	if (seq - rb->TAIL->token.seq < rb->HEAD->token.seq - seq)
+	{
+		for (node = rb->TAIL; node->token.seq < seq; node = node->chain_time.p_newer);
+	}
+	else
+	{
+		for (node = rb->HEAD; node->chain_time.p_older != NULL && node->chain_time.p_older->token.seq >= seq;
+			node = node->chain_time.p_older);
+	}
+	return node;
+}
+
+/**
+* find the newest resident node whose sequence number is not greater than `seq`
+*/
+inline static ring_buffer_node_t* _ring_buffer_find_to(ring_buffer_t* rb, uint64_t seq)
+{
+	if (rb->TAIL == NULL || seq < rb->TAIL->token.seq)
+	{
+		return NULL;
+	}
+	if (seq >= rb->HEAD->token.seq)
+	{
+		return rb->HEAD;
+	}
+
+	/* same as `_ring_buffer_find_from`, in the other direction */
+	ring_buffer_node_t* node;
+	int i;
+	for (i = 0; i < 16; i++, seq--)	/* TAIL is always found, so seq never go below it */
+	{
+		if ((node = _ring_buffer_find(rb, seq)) != NULL)
+		{
+			return node;
+		}
+	}
+
+	if (seq - rb->TAIL->token.seq < rb->HEAD->token.seq - seq)
+	{
+		for (node = rb->TAIL; node->chain_time.p_newer != NULL && node->chain_time.p_newer->token.seq <= seq;
+			node = node->chain_time.p_newer);
+	}
+	else
+	{
+		for (node = rb->HEAD; node->token.seq > seq; node = node->chain_time.p_older);
+	}
+	return node;
+}
+
+size_t ring_buffer_heap_cost(void)
+{
+	/* need to align with machine size */
+	return ALIGN_SIZE(sizeof(struct ring_buffer), sizeof(void*));
+}
+
+size_t ring_buffer_node_cost(size_t len)
+{
+	return _ring_buffer_node_cost(len);
+}
+
+ring_buffer_t* ring_buffer_init(void* buffer, size_t size)
+{
+	ring_buffer_t* rb = ALIGN_PTR(buffer, sizeof(void*));
+
+	/* ring buffer must start from aligned address */
+	const size_t leading_align_size = (uint8_t*)rb - (uint8_t*)buffer;
+
+	/* check if buffer has enough space */
+	if (leading_align_size + ring_buffer_heap_cost() >= size)
+	{/* out of range */
+		return NULL;
+	}
+
+	/* setup index */
+	const size_t left_size = size - leading_align_size - ring_buffer_heap_cost();
+	const size_t slots = _ring_buffer_index_slots(left_size);
+	const size_t index_size = ALIGN_SIZE(slots * sizeof(uint32_t), sizeof(void*));
+	rb->index.slots = slots != 0 ? (uint32_t*)((uint8_t*)rb + ring_buffer_heap_cost()) : NULL;
+	rb->index.mask = slots != 0 ? slots - 1 : 0;
+	rb->index.walk_below = 0;
+	if (rb->index.slots != NULL)
+	{
+		memset(rb->index.slots, 0, index_size);
+	}
+
+	/* setup compressor table after index, it is cleared by every compression */
+	const unsigned lz_bits = _ring_buffer_lz_bits(left_size - index_size);
+	const size_t lz_size = lz_bits != 0 ? ((size_t)1 << lz_bits) * sizeof(uint32_t) : 0;
+	rb->lz.table = lz_bits != 0 ? (uint32_t*)((uint8_t*)rb + ring_buffer_heap_cost() + index_size) : NULL;
+	rb->lz.bits = lz_bits;
+
+	/* setup necessary field */
+	rb->cfg.cache = (uint8_t*)rb + ring_buffer_heap_cost() + index_size + lz_size;
+	rb->cfg.capacity = left_size - index_size - lz_size;
+	rb->cfg.checksum = 0;
+	rb->cfg.compress = 0;
+	rb->large.threshold = 0;
+	rb->large.bytes = 0;
+	rb->counter.lost = 0;
+	rb->counter.seq = 0;
+	rb->counter.used = 0;
+	rb->counter.count = 0;
+	rb->counter.expired = 0;
+	rb->counter.conflated = 0;
+	rb->counter.corrupted = 0;
+	rb->clock.now = NULL;
+	rb->expiry.count = 0;
+	rb->expiry.next = 0;
+	rb->watermark.cb = NULL;
+	memset(rb->producers, 0, sizeof(rb->producers));
+	memset(&rb->timer, 0, sizeof(rb->timer));
+	memset(&rb->conflate, 0, sizeof(rb->conflate));
+	atomic_init(&rb->view.generation, 0);
+	rb->view.dirty = 0;
+	rb->view.layout = 0;
+	memset(&rb->reclaim, 0, sizeof(rb->reclaim));
+	rb->snapshot.active = 0;
+	memset(&rb->spill, 0, sizeof(rb->spill));
+	rb->spill.fd = -1;
+	rb->sink.started = 0;
+	atomic_init(&rb->sink.stop, 0);
+	atomic_init(&rb->sink.durable, 0);
+	rb->uring.ctx = NULL;
+	memset(&rb->segment, 0, sizeof(rb->segment));
+	rb->segment.base = rb;
+	rb->segment.write = rb;
+	rb->segment.read = rb;
+	rb->segment.memory = buffer;
+	rb->segment.memory_size = size;
+
+	/* credits */
+	pthread_mutex_init(&rb->credit.mutex, NULL);
+	pthread_cond_init(&rb->credit.cond, NULL);
+	atomic_init(&rb->credit.waiters, 0);
+	size_t i;
+	for (i = 0; i < RING_BUFFER_PRODUCER_MAX; i++)
+	{
+		atomic_init(&rb->credit.producers[i].avail, 0);
+		rb->credit.producers[i].limit = 0;
+	}
+
+	/* initialize */
+	_ring_buffer_reinit(rb);
+
+	return rb;
+}
+
+int ring_buffer_exit(ring_buffer_t* rb)
+{
+	while (rb->segment.next != NULL)
+	{
+		ring_buffer_t* segment = rb->segment.next;
+		rb->segment.next = segment->segment.next;
+		segment->segment.next = NULL;
+		ring_buffer_exit(segment);
+		if (rb->segment.release != NULL)
+		{
+			rb->segment.release(segment->segment.memory, segment->segment.memory_size, rb->segment.arg);
+		}
+	}
+
+	ring_buffer_node_t* node;
+	for (node = rb->TAIL; node != NULL; node = node->chain_time.p_newer)
+	{
+		if (node->flags & ring_buffer_node_flag_external)
+		{
+			_ring_buffer_large_release(rb, node);
+		}
+	}
+
+	pthread_cond_destroy(&rb->credit.cond);
+	pthread_mutex_destroy(&rb->credit.mutex);
+	return 0;
+}
+
+ring_buffer_token_t* ring_buffer_reserve(ring_buffer_t* rb, size_t len, int flags)
+{
+	return ring_buffer_reserve_ex(rb, len, flags, NULL);
+}
+
+ring_buffer_token_t* ring_buffer_reserve_ex(ring_buffer_t* rb, size_t len, int flags, const ring_buffer_reserve_opt_t* opt)
+{
+	/* an element reserved now would be consumed before older ones in spill file */
+	if (rb->spill.blocked)
+	{
+		return NULL;
+	}
+	/* a delayed element gets its sequence number from its own segment when due, so it is only taken before growing */
+	if (opt != NULL && opt->not_before != 0 && rb->segment.next != NULL)
+	{
+		return NULL;
+	}
+	return rb->segment.write == rb && rb->segment.size == 0 ?
+		_ring_buffer_reserve_ex(rb, len, flags, opt) :
+		_ring_buffer_segment_reserve(rb, len, flags, opt);
+}
+
+ring_buffer_token_t* _ring_buffer_reserve_ex(ring_buffer_t* rb, size_t len, int flags, const ring_buffer_reserve_opt_t* opt)
+{
+	const unsigned producer = opt != NULL ? opt->producer : 0;
+	if (producer >= RING_BUFFER_PRODUCER_MAX)
+	{
+		return NULL;
+	}
+
+	/* delayed node need a clock, and carry a timer after data */
+	const uint64_t not_before = opt != NULL ? opt->not_before : 0;
+	if (not_before != 0 && rb->clock.now == NULL)
+	{
+		return NULL;
+	}
+
+	/* conflation key is kept after data. delayed elements are not conflated */
+	const int keyed = (flags & ring_buffer_flag_conflate) && rb->conflate.slots != NULL && not_before == 0;
+
+	/* node must aligned. optional fields are only paid by nodes using them */
+	const uint64_t expire = opt != NULL ? opt->expire : 0;
+	const size_t node_size = _ring_buffer_node_cost(len) + (not_before != 0 ? sizeof(ring_buffer_node_timer_t) : 0)
+		+ (keyed ? sizeof(ring_buffer_node_key_t) : 0) + (rb->cfg.checksum ? sizeof(ring_buffer_node_crc_t) : 0)
+		+ (expire != 0 ? sizeof(ring_buffer_node_expire_t) : 0);
+
+	ring_buffer_token_t* token = _ring_buffer_reserve_space(rb, len, node_size);
+
+	/* expired nodes go first, live ones are only overwritten when no expired node is left */
+	if (token == NULL && (flags & ring_buffer_flag_overwrite) && _ring_buffer_drop_expired_all(rb) != 0)
+	{
+		token = _ring_buffer_reserve_space(rb, len, node_size);
+	}
+	if (token == NULL && (flags & ring_buffer_flag_overwrite))
+	{
+		token = _ring_buffer_reserve_overwrite(rb, len, node_size, producer);
+	}
+
+	if (token != NULL)
+	{
+		ring_buffer_node_t* node = CONTAINER_FOR(token, ring_buffer_node_t, token);
+		node->producer = (uint8_t)producer;
+		node->flags = 0;
+		if (not_before != 0)
+		{
+			node->flags |= ring_buffer_node_flag_timer;
+			_ring_buffer_node_timer(node)->not_before = not_before;
+		}
+		if (keyed)
+		{
+			node->flags |= ring_buffer_node_flag_key;
+			_ring_buffer_node_key(node)->key = opt->key;
+		}
+		if (rb->cfg.checksum)
+		{
+			node->flags |= ring_buffer_node_flag_crc;
+		}
+		if (expire != 0)
+		{
+			node->flags |= ring_buffer_node_flag_expire;
+			_ring_buffer_node_expire(node)->expire = expire;
+		}
+		if ((flags & ring_buffer_flag_credit) && rb->segment.base->credit.producers[producer].limit != 0)
+		{
+			node->flags |= ring_buffer_node_flag_credit;
+		}
+		_ring_buffer_node_attach(rb, node);
+		_ring_buffer_watermark_check(rb);
+	}
+	return token;
+}
+
+ring_buffer_token_t* ring_buffer_reserve_delayed(ring_buffer_t* rb, size_t len, uint64_t not_before, int flags)
+{
+	ring_buffer_reserve_opt_t opt;
+	memset(&opt, 0, sizeof(opt));
+	opt.not_before = not_before;
+
+	return ring_buffer_reserve_ex(rb, len, flags, &opt);
+}
+
+/**
+* check crc32c of a node
+* @return	0 if it matches or node has no crc, otherwise -1
+*/
+inline static int _ring_buffer_node_verify(ring_buffer_node_t* node)
+{
+	if (!(node->flags & ring_buffer_node_flag_crc))
+	{
+		return 0;
+	}
+	size_t len;
+	const uint8_t* data = _ring_buffer_node_payload(node, &len);
+	return _ring_buffer_crc32c(data, len) == _ring_buffer_node_crc(node)->crc ? 0 : -1;
+}
+
+inline static ring_buffer_token_t* _ring_buffer_consume_segment(ring_buffer_t* rb, size_t* lost, int verify)
+{
+	if (rb->timer.pending != 0)
+	{
+		_ring_buffer_timer_advance(rb);
+	}
+	_ring_buffer_skip_claimed(rb);
+
+	if (_ring_buffer_drop_expired_oldest(rb) != 0)
+	{
+		_ring_buffer_watermark_check(rb);
+	}
+
+	ring_buffer_node_t* token_node;
+	for (;;)
+	{
+		if (rb->oldest_reserve == NULL || !_ring_buffer_node_is_free(rb->oldest_reserve))
+		{
+			return NULL;
+		}
+
+		token_node = rb->oldest_reserve;
+		rb->oldest_reserve = rb->oldest_reserve->chain_time.p_newer;
+		token_node->state = reading;
+
+		if (!verify || _ring_buffer_node_verify(token_node) == 0)
+		{
+			break;
+		}
+
+		/* corrupted element is dropped, it is not counted as lost. counted in first segment, which is never given back */
+		rb->segment.base->counter.corrupted++;
+		_ring_buffer_delete_node(rb, token_node);
+		_ring_buffer_watermark_check(rb);
+		_ring_buffer_skip_claimed(rb);
+	}
+
+	if(lost != NULL)
+	{
+		*lost = rb->counter.lost;
+	}
 	rb->counter.lost = 0;
 
-	/* initialize */
-	_ring_buffer_reinit(rb);
+	return &token_node->token;
+}
+
+ring_buffer_token_t* _ring_buffer_consume(ring_buffer_t* rb, size_t* lost, int verify)
+{
+	/* elements in ring buffer are older than those in spill file, refilled ones go after them */
+	if (rb->spill.pending != 0)
+	{
+		_ring_buffer_spill_refill(rb);
+	}
+
+	if (rb->segment.next == NULL)
+	{
+		return _ring_buffer_consume_segment(rb, lost, verify);
+	}
+
+	for (;;)
+	{
+		ring_buffer_t* read = rb->segment.read;
+		ring_buffer_token_t* token = _ring_buffer_consume_segment(read, lost, verify);
+		if (token != NULL || read == rb->segment.write || read->oldest_reserve != NULL || read->timer.pending != 0)
+		{
+			return token;
+		}
+
+		/* nothing is left or will come to this segment, move to the newer one */
+		rb->segment.read = read->segment.next;
+		_ring_buffer_segment_trim(rb);
+	}
+}
+
+ring_buffer_token_t* ring_buffer_consume(ring_buffer_t* rb, size_t* lost)
+{
+	return _ring_buffer_consume(rb, lost, 1);
+}
+
+int ring_buffer_verify(ring_buffer_t* rb, const ring_buffer_token_t* token)
+{
+	(void)rb;
+	return _ring_buffer_node_verify(CONTAINER_FOR(token, ring_buffer_node_t, token));
+}
+
+ring_buffer_token_t* ring_buffer_consume_latest(ring_buffer_t* rb, int flags, size_t* dropped)
+{
+	/* newest element is in another segment, and older ones would be dropped in first segment only */
+	if (rb->segment.next != NULL)
+	{
+		return NULL;
+	}
+	if (rb->timer.pending != 0)
+	{
+		_ring_buffer_timer_advance(rb);
+	}
+	_ring_buffer_skip_claimed(rb);
+
+	/* walk back from newest node, nodes older than oldest_reserve are already consumed */
+	const uint64_t now = rb->clock.now != NULL ? rb->clock.now(rb->clock.arg) : 0;
+	ring_buffer_node_t* token_node;
+	for (token_node = rb->oldest_reserve != NULL ? rb->HEAD : NULL; token_node != NULL; token_node = token_node->chain_time.p_older)
+	{
+		if (_ring_buffer_node_is_free(token_node)
+			&& !(rb->clock.now != NULL && _ring_buffer_node_is_expired(token_node, now)))
+		{
+			break;
+		}
+		if (token_node == rb->oldest_reserve)
+		{
+			token_node = NULL;
+			break;
+		}
+	}
+
+	if (dropped != NULL)
+	{
+		*dropped = 0;
+	}
+	if (token_node == NULL)
+	{
+		return NULL;
+	}
+	token_node->state = reading;
+
+	/* older nodes are never going to be consumed, unless they are being written */
+	if (flags & ring_buffer_flag_drop_older)
+	{
+		ring_buffer_node_t* node = rb->oldest_reserve;
+		while (node != token_node)
+		{
+			ring_buffer_node_t* node_newer = node->chain_time.p_newer;
+			if (_ring_buffer_node_is_free(node))
+			{
+				_ring_buffer_delete_node(rb, node);
+				if (dropped != NULL)
+				{
+					(*dropped)++;
+				}
+			}
+			node = node_newer;
+		}
+		_ring_buffer_watermark_check(rb);
+	}
+
+	_ring_buffer_skip_claimed(rb);
+	return &token_node->token;
+}
+
+/**
+* claim a run in one segment
+* @return	0 on success, -1 if there is nothing to consume in this segment
+*/
+inline static int _ring_buffer_consume_run_segment(ring_buffer_t* rb, ring_buffer_span_t* span, size_t max_bytes, size_t max_count, size_t* count)
+{
+	if (rb->timer.pending != 0)
+	{
+		_ring_buffer_timer_advance(rb);
+	}
+	_ring_buffer_skip_claimed(rb);
+
+	if (_ring_buffer_drop_expired_oldest(rb) != 0)
+	{
+		_ring_buffer_watermark_check(rb);
+	}
 
-	return rb;
+	ring_buffer_node_t* node_start = rb->oldest_reserve;
+	if (node_start == NULL || !_ring_buffer_node_is_free(node_start))
+	{
+		return -1;
+	}
+
+	/* next node in time must be the next one in memory without gap */
+	ring_buffer_node_t* node_end = node_start;
+	size_t len = _ring_buffer_node_size(node_start);
+	size_t cnt = 1;
+	node_start->state = reading;
+	for (;;)
+	{
+		ring_buffer_node_t* node_newer = node_end->chain_time.p_newer;
+		if (node_newer == NULL || !_ring_buffer_node_is_free(node_newer)
+			|| (uint8_t*)node_end + _ring_buffer_node_size(node_end) != (uint8_t*)node_newer
+			|| len + _ring_buffer_node_size(node_newer) > max_bytes
+			|| cnt == max_count)
+		{
+			break;
+		}
+
+		node_end = node_newer;
+		node_end->state = reading;
+		len += _ring_buffer_node_size(node_end);
+		cnt++;
+	}
+
+	rb->oldest_reserve = node_end->chain_time.p_newer;
+	_ring_buffer_skip_claimed(rb);
+
+	span->ptr = node_start;
+	span->len = len;
+	if (count != NULL)
+	{
+		*count = cnt;
+	}
+	return 0;
 }
 
-int ring_buffer_exit(ring_buffer_t* rb)
+int ring_buffer_consume_run(ring_buffer_t* rb, ring_buffer_span_t* span, size_t max_bytes, size_t* count)
 {
-	(void)rb;
-	// do nothing
-	return 0;
+	return ring_buffer_consume_run_ex(rb, span, max_bytes, 0, count);
 }
 
-ring_buffer_token_t* ring_buffer_reserve(ring_buffer_t* rb, size_t len, int flags)
+int ring_buffer_consume_run_ex(ring_buffer_t* rb, ring_buffer_span_t* span, size_t max_bytes, size_t max_count, size_t* count)
 {
-	/* node must aligned */
-	const size_t node_size = _ring_buffer_node_cost(len);
+	/* the same order as `_ring_buffer_consume` */
+	if (rb->spill.pending != 0)
+	{
+		_ring_buffer_spill_refill(rb);
+	}
 
-	/* empty ring buffer */
-	if (rb->TAIL == NULL)
+	if (rb->segment.next == NULL)
 	{
-		return _ring_buffer_reserve_empty(rb, len, node_size);
+		return _ring_buffer_consume_run_segment(rb, span, max_bytes, max_count, count);
 	}
 
-	/* non empty ring buffer */
-	return _ring_buffer_reserve_none_empty(rb, len, node_size, flags);
+	for (;;)
+	{
+		ring_buffer_t* read = rb->segment.read;
+		if (_ring_buffer_consume_run_segment(read, span, max_bytes, max_count, count) == 0)
+		{
+			return 0;
+		}
+		if (read == rb->segment.write || read->oldest_reserve != NULL || read->timer.pending != 0)
+		{
+			return -1;
+		}
+
+		/* a span never crosses segments, go on with the newer one */
+		rb->segment.read = read->segment.next;
+		_ring_buffer_segment_trim(rb);
+	}
 }
 
-ring_buffer_token_t* ring_buffer_consume(ring_buffer_t* rb, size_t* lost)
+ring_buffer_token_t* ring_buffer_span_next(const ring_buffer_span_t* span, const ring_buffer_token_t* token)
+{
+	const uint8_t* pos = span->ptr;
+	if (token != NULL)
+	{
+		const ring_buffer_node_t* node = CONTAINER_FOR(token, ring_buffer_node_t, token);
+		pos = (const uint8_t*)node + _ring_buffer_node_size(node);
+	}
+
+	return pos < (const uint8_t*)span->ptr + span->len ? &((ring_buffer_node_t*)pos)->token : NULL;
+}
+
+/**
+* commit a span in the segment it belongs to
+*/
+inline static int _ring_buffer_commit_run_segment(ring_buffer_t* rb, const ring_buffer_span_t* span, int flags)
+{
+	ring_buffer_node_t* node_start = (ring_buffer_node_t*)span->ptr;
+	ring_buffer_node_t* node_end = node_start;
+	while ((uint8_t*)node_end + _ring_buffer_node_size(node_end) < (uint8_t*)span->ptr + span->len)
+	{
+		node_end = node_end->chain_time.p_newer;
+	}
+
+	/* same rule as a single token: discard only if no newer token is being consumed, in this or newer segments */
+	ring_buffer_node_t* node_newer = node_end->chain_time.p_newer;
+	ring_buffer_t* segment;
+	for (segment = rb->segment.next; node_newer == NULL && segment != NULL; segment = segment->segment.next)
+	{
+		node_newer = segment->TAIL;
+	}
+	int discard = (flags & ring_buffer_flag_discard) != 0;
+	if (discard && node_newer != NULL && node_newer->state == reading)
+	{
+		if (!(flags & ring_buffer_flag_consume_on_error))
+		{
+			return -1;
+		}
+		discard = 0;
+	}
+
+	ring_buffer_node_t* node = node_start;
+	for (;;)
+	{
+		ring_buffer_node_t* node_newer = node->chain_time.p_newer;
+		const int last = node == node_end;
+		if (discard)
+		{
+			node->state = committed;
+		}
+		else
+		{
+			_ring_buffer_delete_node(rb, node);
+		}
+		if (last)
+		{
+			break;
+		}
+		node = node_newer;
+	}
+
+	if (discard && (rb->oldest_reserve == NULL || node_start->token.seq < rb->oldest_reserve->token.seq))
+	{
+		rb->oldest_reserve = node_start;
+	}
+
+	_ring_buffer_watermark_check(rb);
+	return discard;
+}
+
+int _ring_buffer_commit_run(ring_buffer_t* rb, const ring_buffer_span_t* span, int flags)
+{
+	if (rb->segment.next == NULL)
+	{
+		return _ring_buffer_commit_run_segment(rb, span, flags);
+	}
+
+	ring_buffer_t* segment = _ring_buffer_segment_of(rb, (const ring_buffer_node_t*)span->ptr);
+	const int ret = _ring_buffer_commit_run_segment(segment, span, flags);
+
+	/* elements given back to a segment consumers have left must be consumed before newer segments */
+	if (ret > 0)
+	{
+		_ring_buffer_segment_rewind(rb, segment);
+	}
+	_ring_buffer_segment_trim(rb);
+	return ret;
+}
+
+int ring_buffer_commit_run(ring_buffer_t* rb, const ring_buffer_span_t* span, int flags)
 {
-	if (rb->oldest_reserve == NULL || rb->oldest_reserve->state != committed)
+	return _ring_buffer_commit_run(rb, span, flags) < 0 ? -1 : 0;
+}
+
+ring_buffer_token_t* ring_buffer_get(ring_buffer_t* rb, uint64_t seq)
+{
+	/* seq index belongs to first segment */
+	if (rb->segment.next != NULL)
 	{
 		return NULL;
 	}
+	ring_buffer_node_t* node = _ring_buffer_find(rb, seq);
+	return (node != NULL && node->state != writing) ? &node->token : NULL;
+}
 
-	if(lost != NULL)
+size_t ring_buffer_peek(ring_buffer_t* rb, const ring_buffer_token_t** tokens, size_t n, uint64_t* gen)
+{
+	if (gen != NULL)
 	{
-		*lost = rb->counter.lost;
+		*gen = atomic_load_explicit(&rb->view.generation, memory_order_relaxed);
+	}
+	if (rb->segment.next != NULL)
+	{
+		return 0;
+	}
+
+	/* same order as consume: delayed nodes are skipped, expired nodes are going to be dropped */
+	const uint64_t now = rb->clock.now != NULL ? rb->clock.now(rb->clock.arg) : 0;
+	size_t cnt = 0;
+	ring_buffer_node_t* node;
+	for (node = rb->oldest_reserve; node != NULL && cnt < n; node = node->chain_time.p_newer)
+	{
+		if (node->state == delayed || node->state == reading
+			|| (rb->clock.now != NULL && _ring_buffer_node_is_expired(node, now)))
+		{
+			continue;
+		}
+		if (!_ring_buffer_node_is_free(node))
+		{
+			break;
+		}
+		tokens[cnt++] = &node->token;
 	}
-	rb->counter.lost = 0;
 
-	ring_buffer_node_t* token_node = rb->oldest_reserve;
-	rb->oldest_reserve = rb->oldest_reserve->chain_time.p_newer;
+	return cnt;
+}
 
-	token_node->state = reading;
-	return &token_node->token;
+int ring_buffer_peek_valid(ring_buffer_t* rb, uint64_t gen)
+{
+	atomic_thread_fence(memory_order_acquire);
+	return atomic_load_explicit(&rb->view.generation, memory_order_relaxed) == gen;
 }
 
-int ring_buffer_commit(ring_buffer_t* rb, ring_buffer_token_t* token, int flags)
+ring_buffer_token_t* ring_buffer_consume_from(ring_buffer_t* rb, ring_buffer_consumer_t* consumer, size_t* lost)
 {
-	ring_buffer_node_t* node = CONTAINER_FOR(token, ring_buffer_node_t, token);
+	if (rb->segment.next != NULL)
+	{
+		return NULL;
+	}
+	if (rb->timer.pending != 0)
+	{
+		_ring_buffer_timer_advance(rb);
+	}
+
+	/* delayed nodes get new sequence number when released */
+	ring_buffer_node_t* node = _ring_buffer_find_from(rb, consumer->offset);
+	while (node != NULL && node->state == delayed)
+	{
+		node = node->chain_time.p_newer;
+	}
+
+	/* keep order: stop at a writing node */
+	if (node == NULL || node->state != committed)
+	{
+		return NULL;
+	}
+
+	if (lost != NULL)
+	{
+		*lost = (size_t)(node->token.seq - consumer->offset);
+	}
+	consumer->offset = node->token.seq + 1;
+
+	node->refs++;
+	return &node->token;
+}
+
+int ring_buffer_seek(ring_buffer_t* rb, ring_buffer_consumer_t* consumer, uint64_t seq)
+{
+	/* only resident elements or the end of ring buffer can be seek to */
+	if (rb->segment.next != NULL || seq > rb->counter.seq || (seq < rb->counter.seq && _ring_buffer_find(rb, seq) == NULL))
+	{
+		return -1;
+	}
+
+	consumer->offset = seq;
+	return 0;
+}
 
-	return node->state == writing ?
+inline static int _ring_buffer_commit_node(ring_buffer_t* rb, ring_buffer_node_t* node, int flags)
+{
+	int ret = node->state == writing ?
 		_ring_buffer_commit_for_write(rb, node, flags) :
 		_ring_buffer_commit_for_consume(rb, node, flags);
+
+	_ring_buffer_watermark_check(rb);
+	return ret;
+}
+
+int ring_buffer_commit(ring_buffer_t* rb, ring_buffer_token_t* token, int flags)
+{
+	ring_buffer_node_t* node = CONTAINER_FOR(token, ring_buffer_node_t, token);
+	if (rb->segment.next == NULL)
+	{
+		return _ring_buffer_commit_node(rb, node, flags);
+	}
+
+	const int ret = _ring_buffer_commit_node(_ring_buffer_segment_of(rb, node), node, flags);
+	_ring_buffer_segment_trim(rb);
+	return ret;
+}
+
+int ring_buffer_set_watermark(ring_buffer_t* rb, int unit, size_t high, size_t low,
+	ring_buffer_watermark_cb_t cb, void* arg)
+{
+	if (cb != NULL && high <= low)
+	{
+		return -1;
+	}
+
+	rb->watermark.cb = cb;
+	rb->watermark.arg = arg;
+	rb->watermark.unit = unit;
+	rb->watermark.high = high;
+	rb->watermark.low = low;
+	rb->watermark.above = (unit == ring_buffer_watermark_count ? rb->counter.count : rb->counter.used) >= high;
+	return 0;
 }
 
 int ring_buffer_foreach(ring_buffer_t* rb,
@@ -496,3 +1974,227 @@ int ring_buffer_foreach(ring_buffer_t* rb,
 
 	return counter;
 }
+
+size_t ring_buffer_split(ring_buffer_t* rb, ring_buffer_token_t** starts, size_t n)
+{
+	if (rb->TAIL == NULL || rb->segment.next != NULL || n == 0)
+	{
+		return 0;
+	}
+
+	/* split sequence numbers evenly, holes make chunks a little different */
+	const uint64_t first = rb->TAIL->token.seq;
+	const uint64_t span = rb->HEAD->token.seq - first + 1;
+	size_t cnt = 0;
+	size_t i;
+	for (i = 0; i < n; i++)
+	{
+		ring_buffer_node_t* node = _ring_buffer_find_from(rb, first + span / n * i + span % n * i / n);
+		if (node != NULL && (cnt == 0 || node->token.seq > starts[cnt - 1]->seq))
+		{
+			starts[cnt++] = &node->token;
+		}
+	}
+
+	return cnt;
+}
+
+ring_buffer_token_t* ring_buffer_next(ring_buffer_t* rb, ring_buffer_token_t* token)
+{
+	(void)rb;
+	ring_buffer_node_t* node = CONTAINER_FOR(token, ring_buffer_node_t, token)->chain_time.p_newer;
+	return node != NULL ? &node->token : NULL;
+}
+
+int ring_buffer_token_state(ring_buffer_t* rb, const ring_buffer_token_t* token)
+{
+	(void)rb;
+	return CONTAINER_FOR(token, ring_buffer_node_t, token)->state;
+}
+
+void ring_buffer_iter_init(ring_buffer_t* rb, ring_buffer_iter_t* iter, uint64_t seq, int states, int flags)
+{
+	iter->seq = seq;
+	iter->states = states;
+	iter->flags = (flags & ring_buffer_iter_reverse) | (rb->segment.next != NULL ? ring_buffer_iter_end : 0);
+	iter->node = NULL;
+	iter->generation = 0;
+}
+
+ring_buffer_token_t* ring_buffer_iter_next(ring_buffer_t* rb, ring_buffer_iter_t* iter)
+{
+	const int reverse = iter->flags & ring_buffer_iter_reverse;
+	if ((iter->flags & ring_buffer_iter_end) || rb->segment.next != NULL)
+	{
+		return NULL;
+	}
+
+	/* continue from cached node if nothing is removed or moved, otherwise locate by sequence number */
+	ring_buffer_node_t* node;
+	if (iter->node != NULL && iter->generation == rb->view.layout)
+	{
+		node = (ring_buffer_node_t*)iter->node;
+		node = reverse ? node->chain_time.p_older : node->chain_time.p_newer;
+	}
+	else
+	{
+		node = reverse ? _ring_buffer_find_to(rb, iter->seq) : _ring_buffer_find_from(rb, iter->seq);
+	}
+
+	while (node != NULL && !(iter->states & (0x01 << node->state)))
+	{
+		node = reverse ? node->chain_time.p_older : node->chain_time.p_newer;
+	}
+	if (node == NULL)
+	{
+		return NULL;
+	}
+
+	iter->node = node;
+	iter->generation = rb->view.layout;
+	if (!reverse)
+	{
+		iter->seq = node->token.seq + 1;
+	}
+	else if (node->token.seq != 0)
+	{
+		iter->seq = node->token.seq - 1;
+	}
+	else
+	{
+		iter->flags |= ring_buffer_iter_end;
+	}
+	return &node->token;
+}
+
+int ring_buffer_set_quota(ring_buffer_t* rb, unsigned producer, size_t bytes)
+{
+	if (producer >= RING_BUFFER_PRODUCER_MAX)
+	{
+		return -1;
+	}
+
+	rb->producers[producer].quota = bytes;
+	return 0;
+}
+
+int ring_buffer_producer_stat(ring_buffer_t* rb, unsigned producer, ring_buffer_producer_stat_t* stat)
+{
+	if (producer >= RING_BUFFER_PRODUCER_MAX)
+	{
+		return -1;
+	}
+
+	stat->used = rb->producers[producer].used;
+	stat->quota = rb->producers[producer].quota;
+	stat->lost = rb->producers[producer].lost;
+	return 0;
+}
+
+void ring_buffer_set_clock(ring_buffer_t* rb, ring_buffer_clock_cb_t now, void* arg)
+{
+	/* attached segments behave the same as first segment */
+	ring_buffer_t* segment;
+	for (segment = rb; segment != NULL; segment = segment->segment.next)
+	{
+		segment->clock.now = now;
+		segment->clock.arg = arg;
+	}
+}
+
+void ring_buffer_stat(ring_buffer_t* rb, ring_buffer_stat_t* stat)
+{
+	memset(stat, 0, sizeof(*stat));
+	stat->segments = rb->segment.count;
+	stat->reclaimed = rb->reclaim.released;
+	stat->spilled = rb->spill.pending;
+	stat->corrupted = rb->counter.corrupted;
+
+	ring_buffer_t* segment;
+	for (segment = rb; segment != NULL; segment = segment->segment.next)
+	{
+		stat->used += segment->counter.used;
+		stat->count += segment->counter.count;
+		stat->expired += segment->counter.expired;
+		stat->conflated += segment->counter.conflated;
+		stat->external += segment->large.bytes;
+	}
+}
+
+void ring_buffer_set_checksum(ring_buffer_t* rb, int enable)
+{
+	ring_buffer_t* segment;
+	for (segment = rb; segment != NULL; segment = segment->segment.next)
+	{
+		segment->cfg.checksum = enable != 0;
+	}
+}
+
+void ring_buffer_set_compress(ring_buffer_t* rb, int enable)
+{
+	ring_buffer_t* segment;
+	for (segment = rb; segment != NULL; segment = segment->segment.next)
+	{
+		segment->cfg.compress = enable != 0;
+	}
+}
+
+void _ring_buffer_shrink(ring_buffer_t* rb, ring_buffer_token_t* token, size_t len)
+{
+	ring_buffer_node_t* node = CONTAINER_FOR(token, ring_buffer_node_t, token);
+	rb = _ring_buffer_segment_of(rb, node);
+	const size_t cost = _ring_buffer_node_cost(node->token.len);
+	const size_t size = _ring_buffer_node_size(node);
+
+	/* next node is placed by size of this node, so space after it is free at once */
+	memmove((uint8_t*)node + _ring_buffer_node_cost(len), (uint8_t*)node + cost, size - cost);
+	*(size_t*)&node->token.len = len;
+
+	const size_t freed = size - _ring_buffer_node_size(node);
+	rb->counter.used -= freed;
+	rb->producers[node->producer].used -= freed;
+
+	/* credits are kept in first segment, the same as `_ring_buffer_node_detach` */
+	if ((node->flags & ring_buffer_node_flag_credit) && rb->segment.base->credit.producers[node->producer].limit != 0)
+	{
+		_ring_buffer_credit_refund(rb->segment.base, node->producer, cost - _ring_buffer_node_cost(len));
+	}
+	_ring_buffer_watermark_check(rb);
+}
+
+int ring_buffer_set_conflate(ring_buffer_t* rb, size_t slots)
+{
+	if (rb->TAIL != NULL)
+	{
+		return -1;
+	}
+
+	/* give back memory of old key index first */
+	uint8_t* base = rb->cfg.cache - rb->conflate.size;
+	const size_t capacity = rb->cfg.capacity + rb->conflate.size;
+	if (slots >= capacity / sizeof(uint32_t))
+	{
+		return -1;
+	}
+
+	/* one more slot is always empty */
+	size_t cnt = 0;
+	if (slots != 0)
+	{
+		for (cnt = 2; cnt <= slots; cnt *= 2);
+	}
+	const size_t size = ALIGN_SIZE(cnt * sizeof(uint32_t), sizeof(void*));
+	if (size >= capacity)
+	{
+		return -1;
+	}
+
+	memset(base, 0, size);
+	rb->conflate.slots = cnt != 0 ? (uint32_t*)base : NULL;
+	rb->conflate.mask = cnt != 0 ? cnt - 1 : 0;
+	rb->conflate.count = 0;
+	rb->conflate.size = size;
+	rb->cfg.cache = base + size;
+	rb->cfg.capacity = capacity - size;
+	return 0;
+}
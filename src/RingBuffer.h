@@ -7,21 +7,197 @@ extern "C" {
 #include <stddef.h>
 #include <stdint.h>
 
+#define RING_BUFFER_PRODUCER_MAX	32	/** producer id must less than this */
+#define RING_BUFFER_COPY_NT_THRESHOLD	(512 * 1024)	/** `ring_buffer_push` and `ring_buffer_pop` bypass cache from this length */
+#define RING_BUFFER_COMPRESS_MIN		64				/** `ring_buffer_push` tries to compress from this length */
+
 typedef struct ring_buffer ring_buffer_t;
 
 typedef struct ring_buffer_token
 {
+	const uint64_t	seq;		/** sequence number, monotonically increasing in reserve order */
 	const size_t	len;		/** length */
 	uint8_t			data[];		/** data */
 }ring_buffer_token_t;
 
+/**
+* a consumer reading by sequence number. elements read this way stay resident until overwritten,
+* so the consumer can seek back and replay them.
+*/
+typedef struct ring_buffer_consumer
+{
+	uint64_t		offset;		/** sequence number to consume next. zero initialize to start from the oldest element */
+}ring_buffer_consumer_t;
+
+/**
+* physically contiguous elements claimed together, see `ring_buffer_consume_run`
+*/
+typedef struct ring_buffer_span
+{
+	const void*		ptr;		/** start of the first element, including internal header */
+	size_t			len;		/** bytes from `ptr` to the end of the last element */
+}ring_buffer_span_t;
+
 typedef enum ring_buffer_flag
 {
 	ring_buffer_flag_overwrite			= 0x01 << 0x00,	/** overwrite exist data if no empty room. Default action is drop */
 	ring_buffer_flag_discard			= 0x01 << 0x01,	/** discard operation */
 	ring_buffer_flag_consume_on_error	= 0x01 << 0x02,	/** if user want to discard a consuming token but failed, force consume this token */
+	ring_buffer_flag_nonblock			= 0x01 << 0x03,	/** fail instead of waiting for credits */
+	ring_buffer_flag_conflate			= 0x01 << 0x04,	/** replace pending element with the same key, see `ring_buffer_set_conflate` */
+	ring_buffer_flag_drop_older			= 0x01 << 0x05,	/** drop older elements not consumed yet, see `ring_buffer_consume_latest` */
+	ring_buffer_flag_credit				= 0x01 << 0x06,	/** element takes credits got by `ring_buffer_credit_acquire`, see `ring_buffer_credit_set` */
 }ring_buffer_flag_t;
 
+/**
+* extra options for reserve. zero initialize fields you don't care.
+*/
+typedef struct ring_buffer_reserve_opt
+{
+	unsigned		producer;	/** producer id, less than `RING_BUFFER_PRODUCER_MAX`. credits are given back to this producer */
+	uint64_t		expire;		/** element is dropped when clock reach this time, see `ring_buffer_set_clock`. 0 means never */
+	uint64_t		not_before;	/** element cannot be consumed before this time, see `ring_buffer_reserve_delayed`. 0 means no delay */
+	uint64_t		key;		/** conflation key, only used with `ring_buffer_flag_conflate` */
+}ring_buffer_reserve_opt_t;
+
+/**
+* a producer packing small records into one element, see `ring_buffer_frame_append`.
+* zero initialize it, then set `size`, `max_age` and `flags`.
+*/
+typedef struct ring_buffer_frame
+{
+	size_t					size;		/** bytes reserved for a frame, it is sealed when no more record fits */
+	uint64_t				max_age;	/** frame is sealed by the append after this much time since it is opened, see `ring_buffer_set_clock`. 0 means no limit */
+	int						flags;		/** reserve flags. can be: `ring_buffer_flag_overwrite` */
+	ring_buffer_token_t*	token;		/** open frame, NULL if none */
+	size_t					used;		/** bytes appended to open frame */
+	uint64_t				opened;		/** time when open frame is reserved */
+}ring_buffer_frame_t;
+
+/**
+* state of element, given to `ring_buffer_foreach` as `1 << state` is in this mask
+*/
+typedef enum ring_buffer_state
+{
+	ring_buffer_state_writing			= 0x01 << 0x00,	/** reserved, not committed yet */
+	ring_buffer_state_committed			= 0x01 << 0x01,	/** can be consumed */
+	ring_buffer_state_reading			= 0x01 << 0x02,	/** being consumed */
+	ring_buffer_state_delayed			= 0x01 << 0x03,	/** committed, waiting for its time, see `ring_buffer_reserve_delayed` */
+	ring_buffer_state_all				= 0x0F,
+}ring_buffer_state_t;
+
+typedef enum ring_buffer_iter_flag
+{
+	ring_buffer_iter_reverse			= 0x01 << 0x00,	/** walk from newer elements to older ones */
+	ring_buffer_iter_end				= 0x01 << 0x01,	/** set by ring buffer when a reverse iterator passed sequence number 0 */
+}ring_buffer_iter_flag_t;
+
+/**
+* iterator over resident elements. it can be kept and resumed after ring buffer changed,
+* so a scan only visits elements added since last time.
+* setup by `ring_buffer_iter_init`, do not modify fields.
+*/
+typedef struct ring_buffer_iter
+{
+	uint64_t		seq;		/** sequence number to visit next, or the nearest one in walking direction */
+	int				states;		/** `ring_buffer_state_t` mask of elements to visit */
+	int				flags;		/** `ring_buffer_iter_flag_t` */
+	void*			node;		/** last visited position, only used when generation not changed */
+	uint64_t		generation;	/** layout generation when `node` is cached */
+}ring_buffer_iter_t;
+
+typedef enum ring_buffer_watermark_unit
+{
+	ring_buffer_watermark_bytes,		/** fill level is measured by bytes taken, see `ring_buffer_node_cost` */
+	ring_buffer_watermark_count,		/** fill level is measured by number of elements */
+}ring_buffer_watermark_unit_t;
+
+typedef struct ring_buffer_stat
+{
+	size_t			used;		/** bytes taken by all elements */
+	size_t			count;		/** number of elements */
+	size_t			expired;	/** how many elements are dropped because of expire, since ring buffer initialized */
+	size_t			conflated;	/** how many elements are replaced by newer ones with the same key, since ring buffer initialized */
+	size_t			corrupted;	/** how many elements are dropped because of crc32c mismatch or broken compressed data, since ring buffer initialized */
+	size_t			external;	/** bytes of large elements held out of ring buffer, see `ring_buffer_set_large` */
+	size_t			segments;	/** number of attached segments, see `ring_buffer_attach` */
+	size_t			reclaimed;	/** bytes given back to operating system by `ring_buffer_reclaim`, since ring buffer initialized */
+	size_t			spilled;	/** number of elements waiting in spill file, see `ring_buffer_set_spill` */
+}ring_buffer_stat_t;
+
+typedef struct ring_buffer_producer_stat
+{
+	size_t			used;		/** bytes taken by elements of this producer */
+	size_t			quota;		/** quota in bytes, 0 means no quota */
+	size_t			lost;		/** how many elements of this producer are overwritten, since ring buffer initialized */
+}ring_buffer_producer_stat_t;
+
+/**
+* clock callback
+* @param arg	user defined arg
+* @return		current time, in any unit the same as `ring_buffer_reserve_opt_t::expire`
+*/
+typedef uint64_t(*ring_buffer_clock_cb_t)(void* arg);
+
+/**
+* lock callback, the same lock held by producers and consumers
+* @param arg	user defined arg
+*/
+typedef void(*ring_buffer_lock_cb_t)(void* arg);
+
+/**
+* watermark callback
+* @param rb		ring buffer
+* @param high	1 if fill level reached high watermark, 0 if fill level fell to low watermark
+* @param arg	user defined arg
+*/
+typedef void(*ring_buffer_watermark_cb_t)(ring_buffer_t* rb, int high, void* arg);
+
+/**
+* memory allocation callback
+* @param len	length
+* @param arg	user defined arg
+* @return		memory, NULL on failure
+*/
+typedef void*(*ring_buffer_alloc_cb_t)(size_t len, void* arg);
+
+/**
+* memory free callback
+* @param ptr	memory got from `ring_buffer_alloc_cb_t`
+* @param len	length passed to `ring_buffer_alloc_cb_t`
+* @param arg	user defined arg
+*/
+typedef void(*ring_buffer_free_cb_t)(void* ptr, size_t len, void* arg);
+
+/**
+* options of log sink, see `ring_buffer_sink_start`
+*/
+typedef struct ring_buffer_sink_opt
+{
+	const char*		dir;		/** directory of log segments, must stay valid until `ring_buffer_sink_stop` */
+	size_t			segment_size;	/** a new log segment is started once current one reaches this size */
+	size_t			max_bytes;	/** max bytes of elements written by one group commit */
+	uint64_t		interval;	/** microseconds to wait when nothing can be drained */
+	void			(*lock)(void* arg);		/** lock ring buffer, the same lock held by producers and consumers */
+	void			(*unlock)(void* arg);	/** unlock ring buffer */
+	void			(*durable)(uint64_t seq, void* arg);	/** called after a group commit, elements up to `seq` are durable. can be NULL */
+	void*			arg;		/** user defined arg */
+}ring_buffer_sink_opt_t;
+
+/**
+* options of io_uring drain, see `ring_buffer_uring_start`
+*/
+typedef struct ring_buffer_uring_opt
+{
+	int				fd;			/** file to write */
+	uint64_t		offset;		/** file offset of the first write */
+	unsigned		depth;		/** max writes in flight, at most 256 */
+	size_t			max_bytes;	/** max bytes of elements claimed for one write */
+	void			(*lock)(void* arg);		/** lock ring buffer, the same lock held by producers and consumers */
+	void			(*unlock)(void* arg);	/** unlock ring buffer */
+	void*			arg;		/** user defined arg */
+}ring_buffer_uring_opt_t;
+
 /**
 * initialize a ring buffer on the buffer
 * @param buffer		trunk of memory
@@ -46,13 +222,475 @@ int ring_buffer_exit(ring_buffer_t* rb);
 */
 ring_buffer_token_t* ring_buffer_reserve(ring_buffer_t* rb, size_t len, int flags);
 
+/**
+* request a token to write, with extra options.
+* @param rb		ring buffer
+* @param len	the data length you want to write
+* @param flags	control flags. can be: `ring_buffer_flag_overwrite`, `ring_buffer_flag_conflate`, `ring_buffer_flag_credit`
+* @param opt	options, NULL is same as `ring_buffer_reserve`
+* @return		A token which can be write to. After write finish, you need to commit it ether as success or discard.
+*/
+ring_buffer_token_t* ring_buffer_reserve_ex(ring_buffer_t* rb, size_t len, int flags, const ring_buffer_reserve_opt_t* opt);
+
+/**
+* set the clock used for element expire. without a clock, elements never expire.
+* expired elements are dropped when consumers reach them, and before an overwrite takes live elements.
+* @param rb		ring buffer
+* @param now	clock callback, NULL to disable
+* @param arg	user defined arg
+*/
+void ring_buffer_set_clock(ring_buffer_t* rb, ring_buffer_clock_cb_t now, void* arg);
+
+/**
+* get statistic of ring buffer
+* @param rb		ring buffer
+* @param stat	[out] statistic
+*/
+void ring_buffer_stat(ring_buffer_t* rb, ring_buffer_stat_t* stat);
+
+/**
+* set quota of a producer. it only affects `ring_buffer_flag_overwrite`:
+* when ring buffer is full, a producer over its quota can only overwrite its own oldest elements, otherwise it is dropped.
+* elements of producers within their quota are never overwritten, so sum of quotas should be less than capacity.
+* @param rb			ring buffer
+* @param producer	producer id
+* @param bytes		quota in bytes, 0 means no quota
+* @return			0 on success, otherwise failed
+*/
+int ring_buffer_set_quota(ring_buffer_t* rb, unsigned producer, size_t bytes);
+
+/**
+* get statistic of a producer
+* @param rb			ring buffer
+* @param producer	producer id
+* @param stat		[out] statistic
+* @return			0 on success, otherwise failed
+*/
+int ring_buffer_producer_stat(ring_buffer_t* rb, unsigned producer, ring_buffer_producer_stat_t* stat);
+
+/**
+* request a token to write, which cannot be consumed before `not_before`.
+* delayed elements wait in a timing wheel inside ring buffer, they cannot be overwritten.
+* the element gets a new sequence number when it is due, so it is consumed after elements already committed.
+* a clock is required, see `ring_buffer_set_clock`. one clock unit is one tick of timing wheel,
+* delays longer than 2^24 ticks are checked again every 2^24 ticks.
+* it fails while ring buffer has grown, see `ring_buffer_attach`.
+* @param rb			ring buffer
+* @param len		the data length you want to write
+* @param not_before	time the element can be consumed
+* @param flags		control flags. can be: `ring_buffer_flag_overwrite`
+* @return			A token which can be write to. After write finish, you need to commit it ether as success or discard.
+*/
+ring_buffer_token_t* ring_buffer_reserve_delayed(ring_buffer_t* rb, size_t len, uint64_t not_before, int flags);
+
+/**
+* assign credits to a producer. a producer with credits need to acquire credits, then pass its id in options and
+* `ring_buffer_flag_credit` to `ring_buffer_reserve_ex`, and credits are given back when the element leaves ring buffer
+* (consumed, discarded or overwritten). elements reserved without `ring_buffer_flag_credit` take no credits,
+* so each acquire must be matched by exactly one such reserve, or by `ring_buffer_credit_release` if reserve failed.
+* set credits before the producer starts to reserve.
+* @param rb			ring buffer
+* @param producer	producer id
+* @param bytes		total credits in bytes, 0 to disable credits for this producer
+* @return			0 on success, otherwise failed
+*/
+int ring_buffer_credit_set(ring_buffer_t* rb, unsigned producer, size_t bytes);
+
+/**
+* acquire credits for an element. this is lock free and must be called without holding the lock of ring buffer,
+* because waiting producers are only woken up by commits.
+* @param rb			ring buffer
+* @param producer	producer id
+* @param len		the data length you want to write
+* @param flags		control flags. can be: `ring_buffer_flag_nonblock`
+* @return			0 on success, otherwise failed
+*/
+int ring_buffer_credit_acquire(ring_buffer_t* rb, unsigned producer, size_t len, int flags);
+
+/**
+* give back credits acquired but not used, for example `ring_buffer_reserve_ex` failed.
+* @param rb			ring buffer
+* @param producer	producer id
+* @param len		the data length passed to `ring_buffer_credit_acquire`
+*/
+void ring_buffer_credit_release(ring_buffer_t* rb, unsigned producer, size_t len);
+
+/**
+* enable last-value conflation. when an element reserved with `ring_buffer_flag_conflate` is committed,
+* a pending (not consumed) element with the same key is replaced: the old one is removed, or the new value is
+* copied into it when they take the same space. either way the value is consumed at the place and with the
+* sequence number of the new element.
+* so consumers see at most one pending element per key. replaced elements are not counted as lost.
+* delayed elements are not conflated. when more than `slots` keys are pending, new keys are not conflated.
+* the key index takes 4 bytes per slot from ring buffer capacity, ring buffer must be empty.
+* @param rb		ring buffer
+* @param slots	number of keys can be indexed. 0 to disable
+* @return		0 on success, otherwise failed
+*/
+int ring_buffer_set_conflate(ring_buffer_t* rb, size_t slots);
+
+/**
+* store crc32c of data with each element reserved from now on, to find torn or corrupted elements
+* in shared or persistent memory. crc32c is computed at commit, `ring_buffer_consume` drops elements
+* failed the check. `ring_buffer_push` and `ring_buffer_pop` compute it while copying, so data is read once.
+* each element takes 8 more bytes.
+* @param rb		ring buffer
+* @param enable	0 to disable
+*/
+void ring_buffer_set_checksum(ring_buffer_t* rb, int enable);
+
+/**
+* check crc32c of a committed element, for example when ring buffer is recovered from shared memory
+* @param rb		ring buffer
+* @param token	token
+* @return		0 if data is intact or element has no crc32c, otherwise -1
+*/
+int ring_buffer_verify(ring_buffer_t* rb, const ring_buffer_token_t* token);
+
+/**
+* compress elements pushed by `ring_buffer_push` from now on, with a built-in lz codec.
+* an element is stored as it is if compression does not save space. the codec uses a hash table taken from
+* the memory given to `ring_buffer_init`, up to 16 KiB, a ring buffer of about 1 KiB or less never compresses.
+* compressed elements are restored by `ring_buffer_pop` and `ring_buffer_read`,
+* other functions give tokens with compressed data, `ring_buffer_snapshot_tail` copies them as stored.
+* @param rb		ring buffer
+* @param enable	0 to disable
+*/
+void ring_buffer_set_compress(ring_buffer_t* rb, int enable);
+
+/**
+* attach a new segment, new elements go to it from now on, so ring buffer grows without moving any element.
+* elements are consumed in order across segments, a segment is given back by `ring_buffer_set_growth` callback
+* once it is drained. when everything is drained, first segment is used again.
+* `ring_buffer_reserve`, `ring_buffer_commit`, `ring_buffer_consume`, `ring_buffer_consume_run`, `ring_buffer_commit_run`,
+* `ring_buffer_push`, `ring_buffer_pop`, `ring_buffer_stat` and `ring_buffer_snapshot` work across segments,
+* so do the log sink and io_uring drain built on them. `ring_buffer_get`, `ring_buffer_seek`, `ring_buffer_consume_from`,
+* `ring_buffer_peek`, `ring_buffer_consume_latest`, `ring_buffer_iter_next`, `ring_buffer_split`, `ring_buffer_foreach_parallel`
+* and `ring_buffer_snapshot_tail` fail while ring buffer has grown, other functions only see first segment.
+* an attached segment copies checksum, compress, clock and large element settings, and later changes go to every segment,
+* not key index or watermark.
+* it fails while delayed elements are pending, delayed elements cannot be reserved until ring buffer shrinks back.
+* @param rb		ring buffer, the first segment
+* @param buffer	trunk of memory
+* @param size	memory size
+* @return		0 on success, otherwise failed
+*/
+int ring_buffer_attach(ring_buffer_t* rb, void* buffer, size_t size);
+
+/**
+* grow ring buffer automatically. when reserve does not fit, a segment is allocated and attached,
+* see `ring_buffer_attach`. growing is tried before `ring_buffer_flag_overwrite` takes effect.
+* @param rb			ring buffer, the first segment
+* @param size		size of new segment, it is larger if an element does not fit. 0 to disable
+* @param max		max number of attached segments
+* @param alloc		allocate a segment
+* @param release	give back a drained segment, also used for segments attached by `ring_buffer_attach`. can be NULL
+* @param arg		user defined arg
+* @return			0 on success, otherwise failed
+*/
+int ring_buffer_set_growth(ring_buffer_t* rb, size_t size, size_t max, ring_buffer_alloc_cb_t alloc, ring_buffer_free_cb_t release, void* arg);
+
+/**
+* give back memory pages in free space of ring buffer to operating system. a page is free if no element overlaps it,
+* it is mapped again when an element is placed there, with zeros for anonymous memory or file content for a private
+* file mapping. memory in a shared mapping is skipped, since nothing can be freed there without touching the file
+* or shared memory object. it walks every element, so call it from a maintenance thread or timer, not from the path
+* of producers or consumers.
+* @param rb		ring buffer
+* @return		bytes given back, 0 if it is called again within the interval set by `ring_buffer_set_reclaim`
+*/
+size_t ring_buffer_reclaim(ring_buffer_t* rb);
+
+/**
+* limit how often `ring_buffer_reclaim` really works, by the clock of `ring_buffer_set_clock`
+* @param rb			ring buffer
+* @param interval	min time between two reclaims. 0 means no limit
+*/
+void ring_buffer_set_reclaim(ring_buffer_t* rb, uint64_t interval);
+
+/**
+* keep elements in a file when ring buffer is full, instead of dropping or overwriting them.
+* when `ring_buffer_push` does not fit, the element is appended to the file, and so are all elements pushed after it
+* until the file is empty again, so order is kept. appends are batched in `buffer` and written sequentially.
+* `ring_buffer_consume` and `ring_buffer_pop` move elements back into ring buffer in large reads as space is free,
+* with their sequence numbers kept. `ring_buffer_reserve` fails meanwhile, use `ring_buffer_push`.
+* an element which would not fit even in an empty ring buffer is not spilled, `ring_buffer_push` fails,
+* unless `ring_buffer_set_large` or `ring_buffer_set_growth` makes room for it. elements in the file are not
+* included by snapshots.
+* @param rb		ring buffer, the first segment
+* @param fd		file opened for reading and writing, its content is discarded. -1 to disable
+* @param buffer	staging memory, half for writes and half for reads. it decides the size of each write and read
+* @param size	size of buffer
+* @return		0 on success, -1 if elements are still in the file or buffer is too small
+*/
+int ring_buffer_set_spill(ring_buffer_t* rb, int fd, void* buffer, size_t size);
+
+/**
+* start a thread that makes elements durable in an append-only log. it claims runs of committed elements
+* by `ring_buffer_consume_run`, writes them to the log with `writev` without holding the lock, and then
+* one `fdatasync` covers every producer in the group before the elements are removed.
+* the log is split into segment files named by the sequence number of their first element, each element
+* is stored as a record of sequence number, length and encoding flags followed by data, as in a snapshot.
+* the thread is the consumer of ring buffer, every segment is drained.
+* @param rb		ring buffer
+* @param opt	options, copied
+* @return		0 on success, otherwise failed
+*/
+int ring_buffer_sink_start(ring_buffer_t* rb, const ring_buffer_sink_opt_t* opt);
+
+/**
+* stop the log sink after ring buffer is drained. call it before `ring_buffer_exit`, without holding the lock.
+* @param rb		ring buffer
+* @return		0 on success, otherwise errno which stopped the sink early. elements not written are left in ring buffer,
+*				unless another consumer was reading newer elements: then they are removed without being durable,
+*				and reported as lost by the next `ring_buffer_consume`
+*/
+int ring_buffer_sink_stop(ring_buffer_t* rb);
+
+/**
+* get how far elements are durable, for producers which poll instead of waiting for the callback
+* @param rb		ring buffer
+* @return		sequence number after the last durable element, 0 if none
+*/
+uint64_t ring_buffer_sink_durable(ring_buffer_t* rb);
+
+/**
+* drain ring buffer to a file with io_uring, linux only. each write is a run of committed elements claimed by
+* `ring_buffer_consume_run_ex`, written with `writev` from where elements are, so data is never copied in user space.
+* up to `depth` writes are in flight, and a run is removed from ring buffer only when its write and writes of all
+* runs before it complete. elements are stored as records the same as `ring_buffer_sink_start`, in sequence order
+* at increasing offsets.
+* no io_uring library is needed, it talks to kernel by system calls.
+* @param rb		ring buffer
+* @param opt	options, copied
+* @return		0 on success, otherwise failed. errno is ENOSYS if io_uring is not available
+*/
+int ring_buffer_uring_start(ring_buffer_t* rb, const ring_buffer_uring_opt_t* opt);
+
+/**
+* handle completed writes, and start writes for elements committed since last call. call it from the drain thread
+* without holding the lock, the lock is taken by the callbacks in options.
+* @param rb		ring buffer
+* @param wait	whether to wait until a write completes, if any is in flight
+* @return		number of elements written since last call which did not fail, -1 while a failed write is not written yet.
+*				a failed write is tried again at the same offset by each call, no new run is claimed meanwhile
+*/
+int ring_buffer_uring_drain(ring_buffer_t* rb, int wait);
+
+/**
+* wait for writes in flight and release io_uring. call it before `ring_buffer_exit`, without holding the lock.
+* runs not written, and runs after them, are given back and the file is truncated to where they start,
+* so it ends with the last removed element. if another consumer reads newer elements they cannot be given back,
+* they are removed without being written and reported as lost by the next `ring_buffer_consume`.
+* @param rb		ring buffer
+* @return		0 on success, otherwise errno of the last failed write
+*/
+int ring_buffer_uring_stop(ring_buffer_t* rb);
+
+/**
+* store large elements out of ring buffer. the payload of an element pushed by `ring_buffer_push` is allocated
+* out of ring buffer if it is not shorter than `threshold`, or it can never fit in ring buffer.
+* only a small descriptor element takes its place in ring buffer, so order is kept, and the payload is freed
+* when the element is removed by any means. use `ring_buffer_payload` to get the payload from a token.
+* `ring_buffer_snapshot_tail` skips these elements.
+* @param rb			ring buffer
+* @param threshold	payload from this length is allocated out of ring buffer. 0 to disable
+* @param alloc		allocate payload. NULL to map anonymous pages
+* @param release	free payload. NULL if `alloc` is NULL
+* @param arg		user defined arg
+* @return			0 on success, otherwise failed
+*/
+int ring_buffer_set_large(ring_buffer_t* rb, size_t threshold, ring_buffer_alloc_cb_t alloc, ring_buffer_free_cb_t release, void* arg);
+
+/**
+* get user data of an element, which is out of ring buffer for large elements
+* @param token	token being read
+* @param len	[out] length of user data
+* @return		user data
+*/
+const void* ring_buffer_payload(const ring_buffer_token_t* token, size_t* len);
+
+/**
+* copy data of an element out, compressed element is decompressed
+* @param rb		ring buffer
+* @param token	token being read
+* @param buf	buffer
+* @param cap	size of buffer
+* @param len	[out] length of data
+* @return		0 on success, -1 if buffer is too small or compressed data is corrupted
+*/
+int ring_buffer_read(ring_buffer_t* rb, const ring_buffer_token_t* token, void* buf, size_t cap, size_t* len);
+
+/**
+* copy data into a new element and commit it.
+* data larger than `RING_BUFFER_COPY_NT_THRESHOLD` is written without polluting cache.
+* if compression is enabled, space is reserved for raw data and the rest is given back after compression.
+* if spill file is enabled, data that does not fit goes to the file, see `ring_buffer_set_spill`.
+* @param rb		ring buffer
+* @param data	data
+* @param len	length of data
+* @param flags	control flags. can be: `ring_buffer_flag_overwrite`
+* @return		0 on success, otherwise failed
+*/
+int ring_buffer_push(ring_buffer_t* rb, const void* data, size_t len, int flags);
+
+/**
+* append a small record to a frame. each record is stored with a varint length before it, so a frame saves
+* the header of an element for every record. a frame is reserved on the first append, and committed as one
+* element when the next record does not fit, or `max_age` passed. a record larger than `size` gets a frame of its own.
+* an open frame is a writing element, so elements after it cannot be consumed until it is sealed.
+* @param rb		ring buffer
+* @param frame	frame
+* @param data	data
+* @param len	length of data
+* @return		0 on success, otherwise failed
+*/
+int ring_buffer_frame_append(ring_buffer_t* rb, ring_buffer_frame_t* frame, const void* data, size_t len);
+
+/**
+* commit an open frame now, unused space is given back. call it when the producer is idle, or from a timer.
+* @param rb		ring buffer
+* @param frame	frame
+* @return		0 on success, otherwise failed
+*/
+int ring_buffer_frame_flush(ring_buffer_t* rb, ring_buffer_frame_t* frame);
+
+/**
+* walk records in a consumed element. an element not written by `ring_buffer_frame_append` is one record,
+* the same as `ring_buffer_payload`.
+* @param token	token being read
+* @param pos	[in/out] position in element, set to 0 to get the first record
+* @param len	[out] length of record
+* @return		start of record, NULL if no more
+*/
+const void* ring_buffer_frame_next(const ring_buffer_token_t* token, size_t* pos, size_t* len);
+
+/**
+* copy the oldest element out and remove it. the element is removed as soon as it is copied.
+* elements failed crc32c check are dropped, the next one is copied. compressed elements are decompressed.
+* @param rb		ring buffer
+* @param buf	buffer
+* @param cap	size of buffer
+* @param len	[out] length of the element. if it is larger than `cap`, the element is left in ring buffer,
+*				unless it cannot be discarded (see `ring_buffer_flag_consume_on_error`), then it is dropped
+* @return		0 on success, otherwise failed
+*/
+int ring_buffer_pop(ring_buffer_t* rb, void* buf, size_t cap, size_t* len);
+
 /**
 * request a token to consume.
 * @param rb		ring buffer
+* expired elements before the token are dropped, they are not counted as lost.
+* @param lost	[out] how many elements were overwritten or dropped for lack of space since last consume.
+*				this counter is the only loss signal: a gap in `seq` does not mean loss, since discarded writes,
+*				conflation, expiry and released delayed elements leave gaps as well
 * @return		A token which can be consume. After consume finish, you need to commit it ether as success or discard.
 */
 ring_buffer_token_t* ring_buffer_consume(ring_buffer_t* rb, size_t* lost);
 
+/**
+* request the newest token to consume. calling it again gives the next newest one, so elements are consumed newest first.
+* it can be mixed with `ring_buffer_consume`, which still starts from the oldest element.
+* a token got here can only be discarded when no newer token is being consumed, as `ring_buffer_consume`.
+* @param rb			ring buffer
+* @param flags		control flags. can be: `ring_buffer_flag_drop_older` to drop all older elements at once
+* @param dropped	[out] how many elements are dropped by `ring_buffer_flag_drop_older`, can be NULL
+* @return			A token which can be consume. After consume finish, you need to commit it ether as success or discard.
+*/
+ring_buffer_token_t* ring_buffer_consume_latest(ring_buffer_t* rb, int flags, size_t* dropped);
+
+/**
+* claim the longest run of committed elements which follow each other in both time and memory,
+* starting from the oldest element, as one span. it is useful to process many small elements as one buffer.
+* a span never crosses segments, the next call goes on with the newer segment.
+* @param rb			ring buffer
+* @param span		[out] span, walk elements in it by `ring_buffer_span_next`
+* @param max_bytes	max length of span, the first element is always claimed even if it is longer
+* @param count		[out] number of elements, can be NULL
+* @return			0 on success, -1 if there is nothing to consume
+*/
+int ring_buffer_consume_run(ring_buffer_t* rb, ring_buffer_span_t* span, size_t max_bytes, size_t* count);
+
+/**
+* the same as `ring_buffer_consume_run`, and also limit number of elements, for example to fit an iovec array
+* @param rb			ring buffer
+* @param span		[out] span, walk elements in it by `ring_buffer_span_next`
+* @param max_bytes	max length of span, the first element is always claimed even if it is longer
+* @param max_count	max number of elements, 0 means no limit
+* @param count		[out] number of elements, can be NULL
+* @return			0 on success, -1 if there is nothing to consume
+*/
+int ring_buffer_consume_run_ex(ring_buffer_t* rb, ring_buffer_span_t* span, size_t max_bytes, size_t max_count, size_t* count);
+
+/**
+* walk elements in a span
+* @param span	span
+* @param token	current element, NULL to get the first one
+* @return		next element, NULL if no more
+*/
+ring_buffer_token_t* ring_buffer_span_next(const ring_buffer_span_t* span, const ring_buffer_token_t* token);
+
+/**
+* commit all elements in a span as consumed or discard, same as `ring_buffer_commit` on each of them.
+* @param rb		ring buffer
+* @param span	span got by `ring_buffer_consume_run`
+* @param flags	control flags. can be: `ring_buffer_flag_discard` or `ring_buffer_flag_consume_on_error`
+* @return		0 on success, otherwise failed
+*/
+int ring_buffer_commit_run(ring_buffer_t* rb, const ring_buffer_span_t* span, int flags);
+
+/**
+* find a resident token by sequence number.
+* the returned token is for read only, it does not change the state of the token.
+* @param rb		ring buffer
+* @param seq	sequence number
+* @return		the token, or NULL if the element is no longer resident or still being written
+*/
+ring_buffer_token_t* ring_buffer_get(ring_buffer_t* rb, uint64_t seq);
+
+/**
+* look at the next committed elements in consume order, without claiming them.
+* call it like other functions, it only takes a short walk. tokens can be read after that,
+* even without holding the lock of ring buffer, but they may be overwritten meanwhile, and payload of
+* large elements is freed once they are removed: copy what you need, then check with `ring_buffer_peek_valid`.
+* @param rb		ring buffer
+* @param tokens	[out] read only tokens
+* @param n		max number of tokens
+* @param gen	[out] generation of tokens, can be NULL
+* @return		number of tokens
+*/
+size_t ring_buffer_peek(ring_buffer_t* rb, const ring_buffer_token_t** tokens, size_t n, uint64_t* gen);
+
+/**
+* check if tokens got by `ring_buffer_peek` were valid while you read them.
+* this never blocks and can be called without holding the lock of ring buffer.
+* @param rb		ring buffer
+* @param gen	generation got by `ring_buffer_peek`
+* @return		non-zero if no token was overwritten, 0 if what you read may be broken
+*/
+int ring_buffer_peek_valid(ring_buffer_t* rb, uint64_t gen);
+
+/**
+* request a token to consume by sequence number, without removing it from ring buffer.
+* elements are only freed when overwritten, so producers should reserve with `ring_buffer_flag_overwrite`.
+* @param rb			ring buffer
+* @param consumer	consumer. its offset move to the next element
+* @param lost		[out] how many sequence numbers between old offset and this token are skipped. it is not
+*					only overwritten elements, discarded, conflated, expired and delayed elements leave gaps too
+* @return			A token which can be consume. After consume finish, you need to commit it.
+*					Commit (both success and discard) only release the token, use `ring_buffer_seek` to replay.
+*/
+ring_buffer_token_t* ring_buffer_consume_from(ring_buffer_t* rb, ring_buffer_consumer_t* consumer, size_t* lost);
+
+/**
+* move a consumer to a sequence number.
+* @param rb			ring buffer
+* @param consumer	consumer
+* @param seq		a resident sequence number, or the sequence number of next reserved element
+* @return			0 on success, otherwise failed
+*/
+int ring_buffer_seek(ring_buffer_t* rb, ring_buffer_consumer_t* consumer, uint64_t seq);
+
 /**
 * commit a token as operation success or discard.
 * @param rb		ring buffer
@@ -61,6 +699,81 @@ ring_buffer_token_t* ring_buffer_consume(ring_buffer_t* rb, size_t* lost);
 */
 int ring_buffer_commit(ring_buffer_t* rb, ring_buffer_token_t* token, int flags);
 
+/**
+* set fill level watermarks. fill level includes elements in any state.
+* callback is called once when fill level reaches `high`, and once again when it falls to `low`.
+* it is called from inside `ring_buffer_reserve` or `ring_buffer_commit`, so it must not call ring buffer functions.
+* @param rb		ring buffer
+* @param unit	`ring_buffer_watermark_unit_t`
+* @param high	high watermark
+* @param low	low watermark, must less than `high`
+* @param cb		callback. NULL to disable watermarks
+* @param arg	user defined arg
+* @return		0 on success, otherwise failed
+*/
+int ring_buffer_set_watermark(ring_buffer_t* rb, int unit, size_t high, size_t low,
+	ring_buffer_watermark_cb_t cb, void* arg);
+
+/**
+* walk though all elements with several threads. elements are split into chunks of about the same size in
+* time order, each chunk is walked by one thread. ring buffer must not be modified until it returns.
+* @param rb			ring buffer
+* @param cb			call back, called concurrently for different chunks. return <0 if want to stop all
+* @param reduce		called on calling thread in chunk order after all chunks are walked, can be NULL
+* @param arg		user defined arg
+* @param nthreads	max number of threads including calling thread, also max number of chunks
+* @return			how many elements you walk though, or -1 if failed
+*/
+int ring_buffer_foreach_parallel(ring_buffer_t* rb,
+	int (*cb)(ring_buffer_token_t* token, int state, unsigned chunk, void* arg),
+	void (*reduce)(unsigned chunk, void* arg), void* arg, unsigned nthreads);
+
+/**
+* split elements into chunks of about the same size in time order, chunk `i` is from `starts[i]` to the element
+* before `starts[i + 1]`, the last chunk ends at the newest element. walk a chunk by `ring_buffer_next`.
+* @param rb		ring buffer
+* @param starts	[out] first element of each chunk
+* @param n		max number of chunks
+* @return		number of chunks
+*/
+size_t ring_buffer_split(ring_buffer_t* rb, ring_buffer_token_t** starts, size_t n);
+
+/**
+* get the next newer element
+* @param rb		ring buffer
+* @param token	a resident element
+* @return		next newer element, NULL if it is the newest
+*/
+ring_buffer_token_t* ring_buffer_next(ring_buffer_t* rb, ring_buffer_token_t* token);
+
+/**
+* get state of a resident element
+* @param rb		ring buffer
+* @param token	a resident element
+* @return		state, the same value passed to `ring_buffer_foreach`
+*/
+int ring_buffer_token_state(ring_buffer_t* rb, const ring_buffer_token_t* token);
+
+/**
+* setup an iterator
+* @param rb		ring buffer
+* @param iter	iterator
+* @param seq	start sequence number. forward iterator visits elements not less than it, 0 to start from the oldest.
+*				reverse iterator visits elements not greater than it, `UINT64_MAX` to start from the newest.
+* @param states	`ring_buffer_state_t` mask of elements to visit
+* @param flags	`ring_buffer_iter_reverse` or 0
+*/
+void ring_buffer_iter_init(ring_buffer_t* rb, ring_buffer_iter_t* iter, uint64_t seq, int states, int flags);
+
+/**
+* get next element of an iterator. when NULL is returned, forward iterator can be called again later to visit new elements.
+* the returned token is for read only, it does not change the state of the token.
+* @param rb		ring buffer
+* @param iter	iterator
+* @return		token, or NULL if no more element
+*/
+ring_buffer_token_t* ring_buffer_iter_next(ring_buffer_t* rb, ring_buffer_iter_t* iter);
+
 /**
 * walk though all elements
 * @param rb		ring buffer
@@ -71,6 +784,55 @@ int ring_buffer_commit(ring_buffer_t* rb, ring_buffer_token_t* token, int flags)
 int ring_buffer_foreach(ring_buffer_t* rb,
 	int(*cb)(ring_buffer_token_t* token, int state, void* arg), void* arg);
 
+/**
+* write all committed elements to a file, in time order. it is called with the lock held and keeps it
+* for the whole write, use `ring_buffer_snapshot_ex` to let producers and consumers go on meanwhile.
+* elements being written or consumed are not included.
+* @param rb		ring buffer
+* @param fd		file descriptor to write to
+* @return		0 on success, otherwise failed
+*/
+int ring_buffer_snapshot(ring_buffer_t* rb, int fd);
+
+/**
+* the same as `ring_buffer_snapshot`, but called without the lock. the cut is every committed element when it starts,
+* written in batches: a batch is pinned under the lock, written without the lock, and unpinned when the next one is taken.
+* producers and consumers go on meanwhile, only the pinned batch cannot be overwritten and consumers wait at it,
+* so elements of the cut consumed before their batch is taken are not in the snapshot.
+* only one snapshot runs at a time.
+* @param rb		ring buffer
+* @param fd		file descriptor to write to
+* @param lock	lock ring buffer. NULL if caller holds the lock, then it is the same as `ring_buffer_snapshot`
+* @param unlock	unlock ring buffer
+* @param arg	user defined arg
+* @return		0 on success, otherwise failed
+*/
+int ring_buffer_snapshot_ex(ring_buffer_t* rb, int fd, ring_buffer_lock_cb_t lock, ring_buffer_lock_cb_t unlock, void* arg);
+
+/**
+* restore elements from a file written by `ring_buffer_snapshot`. sequence numbers are kept, and new elements
+* go on from the snapshot, so a drained ring buffer can be restored again. if ring buffer is smaller than the snapshot,
+* older elements are lost.
+* @param rb		ring buffer, must be empty
+* @param fd		file descriptor to read from
+* @return		0 on success, otherwise failed
+*/
+int ring_buffer_restore(ring_buffer_t* rb, int fd);
+
+/**
+* copy the newest committed elements. this can be called without holding the lock of ring buffer,
+* it never blocks producers or consumers: each element is checked after copied, if it was overwritten
+* meanwhile the copy starts again, and gives up after several times.
+* elements are copied newest first, each one is a `ring_buffer_token_t` followed by data,
+* the next one starts after `sizeof(ring_buffer_token_t) + len` rounded up to the size of pointer.
+* @param rb			ring buffer
+* @param dst		destination, aligned to the size of pointer
+* @param dst_size	size of destination
+* @param n			max number of elements
+* @return			number of elements copied, -1 if elements keep being overwritten
+*/
+int ring_buffer_snapshot_tail(ring_buffer_t* rb, void* dst, size_t dst_size, size_t n);
+
 /**
 * the internal heap size for the ring buffer
 * @return		size of heap
@@ -0,0 +1,100 @@
+#ifndef __RINGBUFFER_HPP__
+#define __RINGBUFFER_HPP__
+
+#include "RingBuffer.h"
+#include <cstddef>
+#include <iterator>
+#include <vector>
+
+/**
+* range adapter for C++ algorithms. a ring buffer is split into chunks, chunks are a random access range,
+* so they can be processed by parallel algorithms, elements in a chunk are walked in time order:
+*
+*	std::vector<ring_buffer_range::chunk> chunks = ring_buffer_range::split(rb, std::thread::hardware_concurrency());
+*	std::for_each(std::execution::par, chunks.begin(), chunks.end(), [](const ring_buffer_range::chunk& c)
+*	{
+*		for (ring_buffer_token_t& token : c) { ... }
+*	});
+*
+* ring buffer must not be modified while ranges are in use.
+*/
+namespace ring_buffer_range
+{
+	/**
+	* forward iterator over elements in time order
+	*/
+	class iterator
+	{
+	public:
+		typedef std::forward_iterator_tag	iterator_category;
+		typedef ring_buffer_token_t			value_type;
+		typedef std::ptrdiff_t				difference_type;
+		typedef ring_buffer_token_t*		pointer;
+		typedef ring_buffer_token_t&		reference;
+
+		iterator() : rb_(NULL), token_(NULL) {}
+		iterator(ring_buffer_t* rb, ring_buffer_token_t* token) : rb_(rb), token_(token) {}
+
+		reference operator*() const { return *token_; }
+		pointer operator->() const { return token_; }
+		iterator& operator++() { token_ = ring_buffer_next(rb_, token_); return *this; }
+		iterator operator++(int) { iterator it = *this; ++*this; return it; }
+		bool operator==(const iterator& other) const { return token_ == other.token_; }
+		bool operator!=(const iterator& other) const { return token_ != other.token_; }
+
+		/** state of current element, see `ring_buffer_foreach` */
+		int state() const { return ring_buffer_token_state(rb_, token_); }
+
+	private:
+		ring_buffer_t*			rb_;
+		ring_buffer_token_t*	token_;
+	};
+
+	/**
+	* elements from one element to the element before another
+	*/
+	class chunk
+	{
+	public:
+		chunk(ring_buffer_t* rb, ring_buffer_token_t* first, ring_buffer_token_t* last)
+			: begin_(rb, first), end_(rb, last) {}
+
+		iterator begin() const { return begin_; }
+		iterator end() const { return end_; }
+
+	private:
+		iterator	begin_;
+		iterator	end_;
+	};
+
+	/**
+	* split elements into chunks of about the same size
+	* @param rb	ring buffer
+	* @param n	max number of chunks
+	* @return	chunks in time order
+	*/
+	inline std::vector<chunk> split(ring_buffer_t* rb, std::size_t n)
+	{
+		std::vector<ring_buffer_token_t*> starts(n);
+		starts.resize(ring_buffer_split(rb, starts.data(), n));
+
+		std::vector<chunk> chunks;
+		chunks.reserve(starts.size());
+		for (std::size_t i = 0; i < starts.size(); i++)
+		{
+			chunks.push_back(chunk(rb, starts[i], i + 1 < starts.size() ? starts[i + 1] : NULL));
+		}
+		return chunks;
+	}
+
+	/**
+	* all elements in time order
+	*/
+	inline chunk all(ring_buffer_t* rb)
+	{
+		ring_buffer_token_t* first = NULL;
+		return chunk(rb, ring_buffer_split(rb, &first, 1) != 0 ? first : NULL, NULL);
+	}
+}
+
+#endif
@@ -0,0 +1,284 @@
+#include "RingBufferInternal.h"
+#include <string.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || (defined(__i386__) && defined(__SSE2__)))
+#define RING_BUFFER_COPY_X86
+#include <immintrin.h>
+#endif
+
+typedef void (*ring_buffer_copy_fn_t)(void* dst, const void* src, size_t len);
+
+static pthread_once_t _ring_buffer_copy_once = PTHREAD_ONCE_INIT;
+static ring_buffer_copy_fn_t _ring_buffer_copy_nt = NULL;	/** copy bypassing cache, selected at first use */
+
+/**
+* copy at most 64 bytes. fixed size copies become vector loads and stores, overlapped at tail.
+*/
+inline static void _ring_buffer_copy_small(uint8_t* dst, const uint8_t* src, size_t len)
+{
+	if (len >= 32)
+	{
+		memcpy(dst, src, 32);
+		memcpy(dst + len - 32, src + len - 32, 32);
+	}
+	else if (len >= 16)
+	{
+		memcpy(dst, src, 16);
+		memcpy(dst + len - 16, src + len - 16, 16);
+	}
+	else if (len >= 8)
+	{
+		memcpy(dst, src, 8);
+		memcpy(dst + len - 8, src + len - 8, 8);
+	}
+	else if (len >= 4)
+	{
+		memcpy(dst, src, 4);
+		memcpy(dst + len - 4, src + len - 4, 4);
+	}
+	else if (len > 0)
+	{
+		dst[0] = src[0];
+		dst[len >> 1] = src[len >> 1];
+		dst[len - 1] = src[len - 1];
+	}
+}
+
+#if defined(RING_BUFFER_COPY_X86)
+/**
+* streaming stores with SSE2, which every x86_64 cpu has
+*/
+static void _ring_buffer_copy_nt_sse2(void* dst, const void* src, size_t len)
+{
+	uint8_t* d = dst;
+	const uint8_t* s = src;
+
+	/* streaming stores need aligned destination */
+	const size_t head = (16 - ((uintptr_t)d & 15)) & 15;
+	memcpy(d, s, head);
+	d += head;
+	s += head;
+	len -= head;
+
+	for (; len >= 64; len -= 64, d += 64, s += 64)
+	{
+		__m128i x0 = _mm_loadu_si128((const __m128i*)s);
+		__m128i x1 = _mm_loadu_si128((const __m128i*)(s + 16));
+		__m128i x2 = _mm_loadu_si128((const __m128i*)(s + 32));
+		__m128i x3 = _mm_loadu_si128((const __m128i*)(s + 48));
+		_mm_stream_si128((__m128i*)d, x0);
+		_mm_stream_si128((__m128i*)(d + 16), x1);
+		_mm_stream_si128((__m128i*)(d + 32), x2);
+		_mm_stream_si128((__m128i*)(d + 48), x3);
+	}
+
+	/* streaming stores are weakly ordered, make them visible before commit */
+	_mm_sfence();
+	memcpy(d, s, len);
+}
+
+__attribute__((target("avx")))
+static void _ring_buffer_copy_nt_avx(void* dst, const void* src, size_t len)
+{
+	uint8_t* d = dst;
+	const uint8_t* s = src;
+
+	const size_t head = (32 - ((uintptr_t)d & 31)) & 31;
+	memcpy(d, s, head);
+	d += head;
+	s += head;
+	len -= head;
+
+	for (; len >= 128; len -= 128, d += 128, s += 128)
+	{
+		__m256i y0 = _mm256_loadu_si256((const __m256i*)s);
+		__m256i y1 = _mm256_loadu_si256((const __m256i*)(s + 32));
+		__m256i y2 = _mm256_loadu_si256((const __m256i*)(s + 64));
+		__m256i y3 = _mm256_loadu_si256((const __m256i*)(s + 96));
+		_mm256_stream_si256((__m256i*)d, y0);
+		_mm256_stream_si256((__m256i*)(d + 32), y1);
+		_mm256_stream_si256((__m256i*)(d + 64), y2);
+		_mm256_stream_si256((__m256i*)(d + 96), y3);
+	}
+
+	_mm_sfence();
+	memcpy(d, s, len);
+}
+#else
+/**
+* no streaming stores on this cpu, plain copy
+*/
+static void _ring_buffer_copy_nt_plain(void* dst, const void* src, size_t len)
+{
+	memcpy(dst, src, len);
+}
+#endif
+
+static void _ring_buffer_copy_select(void)
+{
+#if defined(RING_BUFFER_COPY_X86)
+	__builtin_cpu_init();
+	_ring_buffer_copy_nt = __builtin_cpu_supports("avx") ? _ring_buffer_copy_nt_avx : _ring_buffer_copy_nt_sse2;
+#else
+	_ring_buffer_copy_nt = _ring_buffer_copy_nt_plain;
+#endif
+}
+
+void _ring_buffer_copy(void* dst, const void* src, size_t len)
+{
+	if (len <= 64)
+	{
+		_ring_buffer_copy_small(dst, src, len);
+		return;
+	}
+	if (len < RING_BUFFER_COPY_NT_THRESHOLD)
+	{
+		memcpy(dst, src, len);
+		return;
+	}
+
+	pthread_once(&_ring_buffer_copy_once, _ring_buffer_copy_select);
+	_ring_buffer_copy_nt(dst, src, len);
+}
+
+/**
+* compress data into a node just reserved for raw data, and give back what is saved
+* @return	0 on success, -1 if it does not save space
+*/
+static int _ring_buffer_push_compress(ring_buffer_t* rb, ring_buffer_node_t* node, const void* data, size_t len)
+{
+	if (len < RING_BUFFER_COMPRESS_MIN || rb->lz.table == NULL)
+	{
+		return -1;
+	}
+
+	/* 8 bytes less than raw data saves at least one alignment unit */
+	const size_t packed = _ring_buffer_lz_compress(node->token.data, len - sizeof(void*), data, len, rb->lz.table, rb->lz.bits);
+	if (packed == 0)
+	{
+		return -1;
+	}
+
+	_ring_buffer_shrink(rb, &node->token, packed);
+	node->flags |= ring_buffer_node_flag_lz;
+	if (node->flags & ring_buffer_node_flag_crc)
+	{
+		/* compressed data is still in cache */
+		_ring_buffer_node_crc(node)->crc = _ring_buffer_crc32c(node->token.data, packed);
+		node->flags |= ring_buffer_node_flag_crc_ready;
+	}
+	return 0;
+}
+
+int ring_buffer_push(ring_buffer_t* rb, const void* data, size_t len, int flags)
+{
+	/* with spill file, elements are kept instead of overwriting old ones */
+	if (rb->spill.fd >= 0)
+	{
+		if (rb->spill.blocked)
+		{
+			return _ring_buffer_spill_push(rb, data, len);
+		}
+		flags &= ~ring_buffer_flag_overwrite;
+	}
+
+	uint8_t* dst;
+	ring_buffer_token_t* token = _ring_buffer_reserve_payload(rb, len, flags, &dst);
+	if (token == NULL)
+	{
+		return rb->spill.fd >= 0 ? _ring_buffer_spill_push(rb, data, len) : -1;
+	}
+
+	ring_buffer_node_t* node = CONTAINER_FOR(token, ring_buffer_node_t, token);
+	if (rb->cfg.compress && !(node->flags & ring_buffer_node_flag_external) && _ring_buffer_push_compress(rb, node, data, len) == 0)
+	{
+		return ring_buffer_commit(rb, token, 0);
+	}
+
+	if (node->flags & ring_buffer_node_flag_crc)
+	{
+		_ring_buffer_node_crc(node)->crc = _ring_buffer_copy_crc32c(dst, data, len);
+		node->flags |= ring_buffer_node_flag_crc_ready;
+	}
+	else
+	{
+		_ring_buffer_copy(dst, data, len);
+	}
+	return ring_buffer_commit(rb, token, 0);
+}
+
+int ring_buffer_read(ring_buffer_t* rb, const ring_buffer_token_t* token, void* buf, size_t cap, size_t* len)
+{
+	(void)rb;
+	ring_buffer_node_t* node = CONTAINER_FOR(token, ring_buffer_node_t, token);
+	size_t stored;
+	const uint8_t* data = _ring_buffer_node_payload(node, &stored);
+	const size_t raw_len = (node->flags & ring_buffer_node_flag_lz) ? _ring_buffer_lz_raw_len(data, stored) : stored;
+	if (len != NULL)
+	{
+		*len = raw_len;
+	}
+	if (raw_len > cap)
+	{
+		return -1;
+	}
+
+	if (node->flags & ring_buffer_node_flag_lz)
+	{
+		return _ring_buffer_lz_decompress(buf, cap, data, stored);
+	}
+	_ring_buffer_copy(buf, data, stored);
+	return 0;
+}
+
+int ring_buffer_pop(ring_buffer_t* rb, void* buf, size_t cap, size_t* len)
+{
+	for (;;)
+	{
+		/* crc32c is checked while copying, instead of reading data twice */
+		ring_buffer_token_t* token = _ring_buffer_consume(rb, NULL, 0);
+		if (token == NULL)
+		{
+			return -1;
+		}
+
+		ring_buffer_node_t* node = CONTAINER_FOR(token, ring_buffer_node_t, token);
+		size_t stored;
+		const uint8_t* data = _ring_buffer_node_payload(node, &stored);
+		const size_t raw_len = (node->flags & ring_buffer_node_flag_lz) ? _ring_buffer_lz_raw_len(data, stored) : stored;
+		if (len != NULL)
+		{
+			*len = raw_len;
+		}
+		if (raw_len > cap)
+		{
+			ring_buffer_commit(rb, token, ring_buffer_flag_discard | ring_buffer_flag_consume_on_error);
+			return -1;
+		}
+
+		int intact;
+		if (node->flags & ring_buffer_node_flag_lz)
+		{
+			/* compressed data is small, check it before it is expanded */
+			intact = (!(node->flags & ring_buffer_node_flag_crc)
+					|| _ring_buffer_crc32c(data, stored) == _ring_buffer_node_crc(node)->crc)
+				&& _ring_buffer_lz_decompress(buf, cap, data, stored) == 0;
+		}
+		else if (node->flags & ring_buffer_node_flag_crc)
+		{
+			intact = _ring_buffer_copy_crc32c(buf, data, stored) == _ring_buffer_node_crc(node)->crc;
+		}
+		else
+		{
+			_ring_buffer_copy(buf, data, stored);
+			return ring_buffer_commit(rb, token, 0);
+		}
+
+		ring_buffer_commit(rb, token, 0);
+		if (intact)
+		{
+			return 0;
+		}
+		rb->counter.corrupted++;
+	}
+}
@@ -0,0 +1,185 @@
+#include "RingBufferInternal.h"
+#include <string.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define RING_BUFFER_CRC_X86
+#include <immintrin.h>
+#endif
+
+#define RING_BUFFER_CRC_POLY	0x82F63B78	/** crc32c (Castagnoli), reflected */
+
+typedef uint32_t (*ring_buffer_crc_fn_t)(uint32_t crc, const uint8_t* src, size_t len);
+typedef uint32_t (*ring_buffer_copy_crc_fn_t)(uint32_t crc, uint8_t* dst, const uint8_t* src, size_t len);
+
+static pthread_once_t _ring_buffer_crc_once = PTHREAD_ONCE_INIT;
+static uint32_t _ring_buffer_crc_table[8][256];					/** slicing-by-8 table, filled at first use */
+static ring_buffer_crc_fn_t _ring_buffer_crc_update = NULL;		/** selected at first use */
+static ring_buffer_copy_crc_fn_t _ring_buffer_copy_crc_update = NULL;
+
+/**
+* process 8 bytes with table, bytes are taken in little endian order
+*/
+inline static uint32_t _ring_buffer_crc_table_8(uint32_t crc, const uint8_t* p)
+{
+	const uint32_t lo = crc ^ ((uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24);
+	return _ring_buffer_crc_table[7][lo & 0xFF] ^ _ring_buffer_crc_table[6][(lo >> 8) & 0xFF]
+		^ _ring_buffer_crc_table[5][(lo >> 16) & 0xFF] ^ _ring_buffer_crc_table[4][lo >> 24]
+		^ _ring_buffer_crc_table[3][p[4]] ^ _ring_buffer_crc_table[2][p[5]]
+		^ _ring_buffer_crc_table[1][p[6]] ^ _ring_buffer_crc_table[0][p[7]];
+}
+
+static uint32_t _ring_buffer_crc_table_update(uint32_t crc, const uint8_t* src, size_t len)
+{
+	for (; len >= 8; len -= 8, src += 8)
+	{
+		crc = _ring_buffer_crc_table_8(crc, src);
+	}
+	for (; len > 0; len--, src++)
+	{
+		crc = _ring_buffer_crc_table[0][(crc ^ *src) & 0xFF] ^ (crc >> 8);
+	}
+	return crc;
+}
+
+/**
+* each 8 bytes is checksummed from the copy already in register, so source is read once
+*/
+static uint32_t _ring_buffer_copy_crc_table_update(uint32_t crc, uint8_t* dst, const uint8_t* src, size_t len)
+{
+	for (; len >= 8; len -= 8, dst += 8, src += 8)
+	{
+		uint8_t v[8];
+		memcpy(v, src, 8);
+		crc = _ring_buffer_crc_table_8(crc, v);
+		memcpy(dst, v, 8);
+	}
+	for (; len > 0; len--, dst++, src++)
+	{
+		const uint8_t v = *src;
+		crc = _ring_buffer_crc_table[0][(crc ^ v) & 0xFF] ^ (crc >> 8);
+		*dst = v;
+	}
+	return crc;
+}
+
+#if defined(RING_BUFFER_CRC_X86)
+__attribute__((target("sse4.2")))
+static uint32_t _ring_buffer_crc_sse42_update(uint32_t crc, const uint8_t* src, size_t len)
+{
+#if defined(__x86_64__)
+	uint64_t crc64 = crc;
+	for (; len >= 8; len -= 8, src += 8)
+	{
+		uint64_t v;
+		memcpy(&v, src, 8);
+		crc64 = _mm_crc32_u64(crc64, v);
+	}
+	crc = (uint32_t)crc64;
+#endif
+	for (; len >= 4; len -= 4, src += 4)
+	{
+		uint32_t v;
+		memcpy(&v, src, 4);
+		crc = _mm_crc32_u32(crc, v);
+	}
+	for (; len > 0; len--, src++)
+	{
+		crc = _mm_crc32_u8(crc, *src);
+	}
+	return crc;
+}
+
+__attribute__((target("sse4.2")))
+static uint32_t _ring_buffer_copy_crc_sse42_update(uint32_t crc, uint8_t* dst, const uint8_t* src, size_t len)
+{
+#if defined(__x86_64__)
+	uint64_t crc64 = crc;
+	if (len >= RING_BUFFER_COPY_NT_THRESHOLD)
+	{
+		/* same as `_ring_buffer_copy`, large copies bypass cache. movnti needs aligned destination */
+		for (; ((uintptr_t)dst & 7) != 0; len--, dst++, src++)
+		{
+			*dst = *src;
+			crc64 = _mm_crc32_u8((uint32_t)crc64, *src);
+		}
+		for (; len >= 8; len -= 8, dst += 8, src += 8)
+		{
+			long long v;
+			memcpy(&v, src, 8);
+			crc64 = _mm_crc32_u64(crc64, (uint64_t)v);
+			_mm_stream_si64((long long*)dst, v);
+		}
+		_mm_sfence();
+	}
+	for (; len >= 8; len -= 8, dst += 8, src += 8)
+	{
+		uint64_t v;
+		memcpy(&v, src, 8);
+		crc64 = _mm_crc32_u64(crc64, v);
+		memcpy(dst, &v, 8);
+	}
+	crc = (uint32_t)crc64;
+#endif
+	for (; len >= 4; len -= 4, dst += 4, src += 4)
+	{
+		uint32_t v;
+		memcpy(&v, src, 4);
+		crc = _mm_crc32_u32(crc, v);
+		memcpy(dst, &v, 4);
+	}
+	for (; len > 0; len--, dst++, src++)
+	{
+		const uint8_t v = *src;
+		crc = _mm_crc32_u8(crc, v);
+		*dst = v;
+	}
+	return crc;
+}
+#endif
+
+static void _ring_buffer_crc_select(void)
+{
+	uint32_t i;
+	for (i = 0; i < 256; i++)
+	{
+		uint32_t crc = i;
+		int bit;
+		for (bit = 0; bit < 8; bit++)
+		{
+			crc = (crc >> 1) ^ ((crc & 1) ? RING_BUFFER_CRC_POLY : 0);
+		}
+		_ring_buffer_crc_table[0][i] = crc;
+	}
+	for (i = 0; i < 256; i++)
+	{
+		int k;
+		for (k = 1; k < 8; k++)
+		{
+			const uint32_t prev = _ring_buffer_crc_table[k - 1][i];
+			_ring_buffer_crc_table[k][i] = _ring_buffer_crc_table[0][prev & 0xFF] ^ (prev >> 8);
+		}
+	}
+
+	_ring_buffer_crc_update = _ring_buffer_crc_table_update;
+	_ring_buffer_copy_crc_update = _ring_buffer_copy_crc_table_update;
+#if defined(RING_BUFFER_CRC_X86)
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("sse4.2"))
+	{
+		_ring_buffer_crc_update = _ring_buffer_crc_sse42_update;
+		_ring_buffer_copy_crc_update = _ring_buffer_copy_crc_sse42_update;
+	}
+#endif
+}
+
+uint32_t _ring_buffer_crc32c(const void* data, size_t len)
+{
+	pthread_once(&_ring_buffer_crc_once, _ring_buffer_crc_select);
+	return ~_ring_buffer_crc_update(~(uint32_t)0, data, len);
+}
+
+uint32_t _ring_buffer_copy_crc32c(void* dst, const void* src, size_t len)
+{
+	pthread_once(&_ring_buffer_crc_once, _ring_buffer_crc_select);
+	return ~_ring_buffer_copy_crc_update(~(uint32_t)0, dst, src, len);
+}
@@ -0,0 +1,102 @@
+#include "RingBufferInternal.h"
+
+/**
+* take credits if there are enough
+* @return	1 if success, otherwise 0
+*/
+static int _ring_buffer_credit_try_acquire(struct ring_buffer_credit_producer* producer, long long cost)
+{
+	long long avail = atomic_load(&producer->avail);
+	while (avail >= cost)
+	{
+		if (atomic_compare_exchange_weak(&producer->avail, &avail, avail - cost))
+		{
+			return 1;
+		}
+	}
+	return 0;
+}
+
+void _ring_buffer_credit_refund(ring_buffer_t* rb, unsigned producer, size_t cost)
+{
+	atomic_fetch_add(&rb->credit.producers[producer].avail, (long long)cost);
+
+	/* waiters register themselves before checking credits again, so no wake up is missed */
+	if (atomic_load(&rb->credit.waiters) != 0)
+	{
+		pthread_mutex_lock(&rb->credit.mutex);
+		pthread_cond_broadcast(&rb->credit.cond);
+		pthread_mutex_unlock(&rb->credit.mutex);
+	}
+}
+
+int ring_buffer_credit_set(ring_buffer_t* rb, unsigned producer, size_t bytes)
+{
+	if (producer >= RING_BUFFER_PRODUCER_MAX)
+	{
+		return -1;
+	}
+
+	/* credits in use are kept, only the difference is applied */
+	struct ring_buffer_credit_producer* p = &rb->credit.producers[producer];
+	const long long delta = (long long)bytes - (long long)p->limit;
+	p->limit = bytes;
+	atomic_fetch_add(&p->avail, delta);
+
+	/* waiters may be able to go on */
+	_ring_buffer_credit_refund(rb, producer, 0);
+
+	return 0;
+}
+
+int ring_buffer_credit_acquire(ring_buffer_t* rb, unsigned producer, size_t len, int flags)
+{
+	if (producer >= RING_BUFFER_PRODUCER_MAX)
+	{
+		return -1;
+	}
+
+	struct ring_buffer_credit_producer* p = &rb->credit.producers[producer];
+	const size_t cost = _ring_buffer_node_cost(len);
+
+	/* no credit control */
+	if (p->limit == 0)
+	{
+		return 0;
+	}
+
+	/* would never success */
+	if (cost > p->limit)
+	{
+		return -1;
+	}
+
+	if (_ring_buffer_credit_try_acquire(p, (long long)cost))
+	{
+		return 0;
+	}
+	if (flags & ring_buffer_flag_nonblock)
+	{
+		return -1;
+	}
+
+	/* slow path */
+	pthread_mutex_lock(&rb->credit.mutex);
+	atomic_fetch_add(&rb->credit.waiters, 1);
+	while (!_ring_buffer_credit_try_acquire(p, (long long)cost))
+	{
+		pthread_cond_wait(&rb->credit.cond, &rb->credit.mutex);
+	}
+	atomic_fetch_sub(&rb->credit.waiters, 1);
+	pthread_mutex_unlock(&rb->credit.mutex);
+
+	return 0;
+}
+
+void ring_buffer_credit_release(ring_buffer_t* rb, unsigned producer, size_t len)
+{
+	if (producer < RING_BUFFER_PRODUCER_MAX && rb->credit.producers[producer].limit != 0)
+	{
+		_ring_buffer_credit_refund(rb, producer, _ring_buffer_node_cost(len));
+	}
+}
@@ -0,0 +1,119 @@
+#include "RingBufferInternal.h"
+#include <string.h>
+
+inline static size_t _ring_buffer_frame_varint_size(size_t value)
+{
+	size_t size = 1;
+	for (; value >= 0x80; value >>= 7)
+	{
+		size++;
+	}
+	return size;
+}
+
+/**
+* seal open frame, unused space is given back
+*/
+static int _ring_buffer_frame_seal(ring_buffer_t* rb, ring_buffer_frame_t* frame)
+{
+	ring_buffer_token_t* token = frame->token;
+	frame->token = NULL;
+	if (frame->used == 0)
+	{
+		return ring_buffer_commit(rb, token, ring_buffer_flag_discard);
+	}
+
+	_ring_buffer_shrink(rb, token, frame->used);
+	CONTAINER_FOR(token, ring_buffer_node_t, token)->flags |= ring_buffer_node_flag_frame;
+	return ring_buffer_commit(rb, token, 0);
+}
+
+int ring_buffer_frame_append(ring_buffer_t* rb, ring_buffer_frame_t* frame, const void* data, size_t len)
+{
+	const size_t need = _ring_buffer_frame_varint_size(len) + len;
+	if (frame->token != NULL && need > frame->token->len - frame->used)
+	{
+		_ring_buffer_frame_seal(rb, frame);
+	}
+
+	if (frame->token == NULL)
+	{
+		frame->token = ring_buffer_reserve(rb, need > frame->size ? need : frame->size, frame->flags);
+		if (frame->token == NULL)
+		{
+			return -1;
+		}
+		frame->used = 0;
+		frame->opened = rb->clock.now != NULL ? rb->clock.now(rb->clock.arg) : 0;
+	}
+
+	uint8_t* pos = frame->token->data + frame->used;
+	size_t value = len;
+	for (; value >= 0x80; value >>= 7)
+	{
+		*pos++ = (uint8_t)(value | 0x80);
+	}
+	*pos++ = (uint8_t)value;
+	memcpy(pos, data, len);
+	frame->used += need;
+
+	/* nothing but an empty record fits */
+	if (frame->token->len - frame->used < 2)
+	{
+		return _ring_buffer_frame_seal(rb, frame);
+	}
+	if (frame->max_age != 0 && rb->clock.now != NULL && rb->clock.now(rb->clock.arg) - frame->opened >= frame->max_age)
+	{
+		return _ring_buffer_frame_seal(rb, frame);
+	}
+	return 0;
+}
+
+int ring_buffer_frame_flush(ring_buffer_t* rb, ring_buffer_frame_t* frame)
+{
+	return frame->token != NULL ? _ring_buffer_frame_seal(rb, frame) : 0;
+}
+
+const void* ring_buffer_frame_next(const ring_buffer_token_t* token, size_t* pos, size_t* len)
+{
+	const ring_buffer_node_t* node = CONTAINER_FOR(token, ring_buffer_node_t, token);
+	if (!(node->flags & ring_buffer_node_flag_frame))
+	{
+		/* the whole element is the only record */
+		if (*pos != 0)
+		{
+			return NULL;
+		}
+		*pos = 1;
+		return _ring_buffer_node_payload((ring_buffer_node_t*)node, len);
+	}
+
+	/* lengths are checked, a broken frame ends early instead of reading out of element */
+	size_t value = 0;
+	unsigned shift = 0;
+	for (;;)
+	{
+		if (*pos >= token->len || shift >= sizeof(size_t) * 8)
+		{
+			*pos = token->len;
+			return NULL;
+		}
+		const uint8_t b = token->data[(*pos)++];
+		value |= (size_t)(b & 0x7F) << shift;
+		if (!(b & 0x80))
+		{
+			break;
+		}
+		shift += 7;
+	}
+	if (value > token->len - *pos)
+	{
+		*pos = token->len;
+		return NULL;
+	}
+
+	const void* record = token->data + *pos;
+	*len = value;
+	*pos += value;
+	return record;
+}
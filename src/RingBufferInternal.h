@@ -0,0 +1,522 @@
+#ifndef __RINGBUFFER_INTERNAL_H__
+#define __RINGBUFFER_INTERNAL_H__
+
+#include "RingBuffer.h"
+#include <stdatomic.h>
+#include <pthread.h>
+#include <sys/uio.h>
+
+#define ALIGN_SIZE(size, align)	(((uintptr_t)(size) + ((uintptr_t)(align) - 1)) & ~((uintptr_t)(align) - 1))
+#define ALIGN_PTR(ptr, align)	(void*)(ALIGN_SIZE(ptr, align))
+#define CONTAINER_FOR(ptr, TYPE, member)	((TYPE*)((uint8_t*)(ptr) - (size_t)&((TYPE*)0)->member))
+
+#define RING_BUFFER_TIMER_BITS		6	/** each timing wheel level has 2^bits slots */
+#define RING_BUFFER_TIMER_LEVELS	4	/** timing wheel covers 2^(bits*levels) ticks, longer delays wait in overflow list */
+#define RING_BUFFER_TIMER_MASK		((1U << RING_BUFFER_TIMER_BITS) - 1)
+#define RING_BUFFER_LZ_HASH_BITS	12	/** compressor hash table has at most 2^bits entries */
+
+/**
+* `1 << state` is `ring_buffer_state_t`
+*/
+typedef enum ring_buffer_node_state
+{
+	writing,
+	committed,
+	reading,
+	delayed,	/** committed, but waiting in timing wheel */
+}ring_buffer_node_state_t;
+
+typedef enum ring_buffer_node_flag
+{
+	ring_buffer_node_flag_timer	= 0x01 << 0x00,	/** node has a `ring_buffer_node_timer_t` after data */
+	ring_buffer_node_flag_key	= 0x01 << 0x01,	/** node has a `ring_buffer_node_key_t` after data and timer */
+	ring_buffer_node_flag_crc	= 0x01 << 0x02,	/** node has a `ring_buffer_node_crc_t` after data, timer and key */
+	ring_buffer_node_flag_crc_ready	= 0x01 << 0x03,	/** crc is already computed while data was copied in, commit does not compute it again */
+	ring_buffer_node_flag_lz	= 0x01 << 0x04,	/** data is compressed, see `_ring_buffer_lz_compress` */
+	ring_buffer_node_flag_frame	= 0x01 << 0x05,	/** data is records with varint length, see `ring_buffer_frame_append` */
+	ring_buffer_node_flag_external	= 0x01 << 0x06,	/** data is a `ring_buffer_node_external_t`, payload is out of ring buffer */
+	ring_buffer_node_flag_pinned	= 0x01 << 0x07,	/** node is in the batch a running snapshot is writing, see `ring_buffer_snapshot_ex` */
+	ring_buffer_node_flag_credit	= 0x01 << 0x08,	/** node took credits of its producer, they are given back when it leaves */
+	ring_buffer_node_flag_expire	= 0x01 << 0x09,	/** node has a `ring_buffer_node_expire_t` after data, timer, key and crc */
+}ring_buffer_node_flag_t;
+
+typedef struct ring_buffer_node
+{
+	struct ring_buffer_node_chain_pos
+	{
+		struct ring_buffer_node* p_forward;		/** next position */
+		struct ring_buffer_node* p_backward;	/** previous position */
+	}chain_pos;
+
+	struct ring_buffer_node_chain_time
+	{
+		struct ring_buffer_node* p_newer;		/** newer node */
+		struct ring_buffer_node* p_older;		/** older node */
+	}chain_time;
+
+	uint8_t						state;			/** node state, `ring_buffer_node_state_t` */
+	uint8_t						producer;		/** producer id */
+	uint16_t					flags;			/** `ring_buffer_node_flag_t` */
+	uint16_t					refs;			/** how many consumers are reading a committed node by sequence */
+	uint16_t					version;		/** odd while data is modified in place or after node is removed, a node placed here later gets a new even value */
+	ring_buffer_token_t			token;			/** user data */
+}ring_buffer_node_t;
+
+/**
+* extra field of delayed node, placed after aligned data, so other nodes do not pay for it
+*/
+typedef struct ring_buffer_node_timer
+{
+	struct ring_buffer_node*	p_next;			/** next node in the same timing wheel slot, the list is circular */
+	uint64_t					not_before;		/** node can be consumed after this time */
+}ring_buffer_node_timer_t;
+
+/**
+* extra field of node reserved with `ring_buffer_flag_conflate`
+*/
+typedef struct ring_buffer_node_key
+{
+	uint64_t					key;			/** conflation key */
+}ring_buffer_node_key_t;
+
+/**
+* data of node whose payload is allocated out of ring buffer, see `ring_buffer_set_large`
+*/
+typedef struct ring_buffer_node_external
+{
+	void*						ptr;			/** payload */
+	size_t						len;			/** length of payload */
+}ring_buffer_node_external_t;
+
+/**
+* extra field of node reserved when checksum is enabled
+*/
+typedef struct ring_buffer_node_crc
+{
+	uint32_t					crc;			/** crc32c of data, computed at commit */
+	uint32_t					padding;		/** keep next node aligned */
+}ring_buffer_node_crc_t;
+
+/**
+* extra field of node reserved with an expire time
+*/
+typedef struct ring_buffer_node_expire
+{
+	uint64_t					expire;			/** node is dropped when clock reach this time */
+}ring_buffer_node_expire_t;
+
+#define RING_BUFFER_SNAPSHOT_FLAGS		(ring_buffer_node_flag_lz | ring_buffer_node_flag_frame)	/** node flags kept in snapshot and log */
+
+/**
+* an element written to a file by `ring_buffer_snapshot` or the log sink, followed by its data
+*/
+typedef struct ring_buffer_snapshot_record
+{
+	uint64_t	seq;		/** sequence number */
+	uint64_t	len;		/** length of data follow this record */
+	uint64_t	flags;		/** `RING_BUFFER_SNAPSHOT_FLAGS` of node, how data is encoded. not in version 1 */
+}ring_buffer_snapshot_record_t;
+
+typedef struct ring_buffer_uring_ctx ring_buffer_uring_ctx_t;	/** see RingBufferUring.c */
+
+struct ring_buffer
+{
+	struct ring_buffer_cfg
+	{
+		uint8_t*			cache;				/** start of usable address */
+		size_t				capacity;			/** length of usable address */
+		int					checksum;			/** new nodes carry crc32c of data */
+		int					compress;			/** `ring_buffer_push` compresses data */
+	}cfg;
+
+	struct ring_buffer_counter
+	{
+		size_t				lost;				/** the number of lost elements form last consume */
+		uint64_t			seq;				/** sequence number for next reserved node */
+		size_t				used;				/** bytes taken by all nodes */
+		size_t				count;				/** number of nodes */
+		size_t				expired;			/** the number of expired elements */
+		size_t				conflated;			/** the number of elements replaced by newer ones with the same key */
+		size_t				corrupted;			/** the number of elements dropped because crc32c mismatch or broken compressed data, only in first segment */
+	}counter;
+
+	struct ring_buffer_clock
+	{
+		ring_buffer_clock_cb_t	now;			/** get current time, NULL if not set */
+		void*				arg;				/** user defined arg */
+	}clock;
+
+	struct ring_buffer_expiry
+	{
+		size_t				count;				/** the number of nodes carry an expire time */
+		uint64_t			next;				/** no node expires before this time */
+	}expiry;
+
+	struct ring_buffer_watermark
+	{
+		ring_buffer_watermark_cb_t	cb;			/** callback, NULL if not set */
+		void*				arg;				/** user defined arg */
+		int					unit;				/** `ring_buffer_watermark_unit_t` */
+		int					above;				/** whether fill level reached high and not yet fall to low */
+		size_t				high;				/** high watermark */
+		size_t				low;				/** low watermark */
+	}watermark;
+
+	struct ring_buffer_index
+	{
+		uint32_t*			slots;				/** seq -> (offset / alignment + 1), 0 means empty */
+		size_t				mask;				/** number of slots - 1 */
+		uint64_t			walk_below;			/** nodes with smaller sequence number may have lost their slot to newer nodes */
+	}index;
+
+	struct ring_buffer_lz
+	{
+		uint32_t*			table;				/** hash table of compressor, taken from memory after index. NULL if too small */
+		unsigned			bits;				/** table has 2^bits entries */
+	}lz;
+
+	struct ring_buffer_view
+	{
+		atomic_ullong		generation;			/** increased before memory of removed nodes is written, peeked tokens are invalid since then */
+		int					dirty;				/** some node is removed since last increase */
+		uint64_t			layout;				/** increased when a node is removed or moved in chain_time, cached node pointers are invalid since then */
+	}view;
+
+	struct ring_buffer_snapshot
+	{
+		int					active;				/** a snapshot is pinning nodes, only one can run at a time */
+	}snapshot;
+
+	struct ring_buffer_large
+	{
+		size_t				threshold;			/** payload from this length is allocated out of ring buffer. 0 if not enabled */
+		ring_buffer_alloc_cb_t	alloc;			/** allocate payload */
+		ring_buffer_free_cb_t	release;		/** free payload */
+		void*				arg;				/** user defined arg */
+		size_t				bytes;				/** bytes of payloads held now */
+	}large;
+
+	struct ring_buffer_reclaim
+	{
+		uint64_t			interval;			/** min time between two reclaims, 0 means no limit */
+		uint64_t			last;				/** time of last reclaim */
+		size_t				released;			/** bytes given back to operating system */
+		int					mapping;			/** 1 if cache is in private mappings, -1 if not, 0 if not checked yet */
+	}reclaim;
+
+	struct ring_buffer_segment
+	{
+		ring_buffer_t*		base;				/** first segment, it is the handle user holds */
+		ring_buffer_t*		next;				/** next newer segment, NULL if none */
+		ring_buffer_t*		write;				/** segment new elements go to. only used in first segment */
+		ring_buffer_t*		read;				/** oldest segment may have elements to consume. only used in first segment */
+		size_t				count;				/** number of attached segments. only used in first segment */
+		size_t				max;				/** max number of attached segments, for automatic growth */
+		size_t				size;				/** size of automatically allocated segment, 0 if growth is not enabled */
+		ring_buffer_alloc_cb_t	alloc;			/** allocate a segment */
+		ring_buffer_free_cb_t	release;		/** give back a drained segment, NULL if nothing to do */
+		void*				arg;				/** user defined arg */
+		void*				memory;				/** memory of this segment, passed to `ring_buffer_init` */
+		size_t				memory_size;		/** size of memory */
+	}segment;
+
+	struct ring_buffer_spill
+	{
+		int					fd;					/** spill file, -1 if not enabled */
+		int					blocked;			/** older elements are in spill file, new elements must follow them */
+		uint8_t*			buffer;				/** staging memory, first half batches writes and second half batches reads */
+		size_t				half;				/** size of each half */
+		size_t				wpos;				/** bytes batched in write half */
+		size_t				wcount;				/** elements batched in write half */
+		size_t				rpos;				/** bytes consumed in read half */
+		size_t				rlen;				/** bytes valid in read half */
+		uint64_t			write_off;			/** file offset where write half goes */
+		uint64_t			read_off;			/** file offset next read starts from */
+		size_t				pending;			/** elements in spill, not yet back in ring buffer */
+	}spill;
+
+	struct ring_buffer_sink
+	{
+		ring_buffer_sink_opt_t	opt;			/** options given to `ring_buffer_sink_start` */
+		pthread_t			thread;				/** sink thread */
+		int					started;			/** whether sink thread is running */
+		atomic_int			stop;				/** set to stop sink thread once ring buffer is drained */
+		atomic_ullong		durable;			/** sequence number after the last durable element */
+		int					error;				/** errno which stopped sink thread, 0 if none */
+		int					dir_fd;				/** directory of log segments */
+		int					fd;					/** current log segment, -1 if none */
+		uint64_t			size;				/** bytes written to current log segment */
+	}sink;
+
+	struct ring_buffer_uring
+	{
+		ring_buffer_uring_ctx_t*	ctx;		/** io_uring drain, NULL if not started */
+	}uring;
+
+	struct ring_buffer_conflate
+	{
+		uint32_t*			slots;				/** key -> (offset / alignment + 1) of pending node, linear probing. NULL if not enabled */
+		size_t				mask;				/** number of slots - 1 */
+		size_t				count;				/** number of used slots */
+		size_t				size;				/** bytes taken from the front of cache */
+	}conflate;
+
+	struct ring_buffer_producer
+	{
+		size_t				used;				/** bytes taken by nodes of this producer */
+		size_t				quota;				/** in overwrite mode, nodes are protected when `used` not exceed quota. 0 means no quota */
+		size_t				lost;				/** the number of lost elements of this producer */
+	}producers[RING_BUFFER_PRODUCER_MAX];
+
+	struct ring_buffer_credit
+	{
+		pthread_mutex_t		mutex;				/** only used by producers waiting for credits */
+		pthread_cond_t		cond;				/** signaled when credits are given back while someone is waiting */
+		atomic_int			waiters;			/** how many producers are waiting */
+		struct ring_buffer_credit_producer
+		{
+			atomic_llong	avail;				/** credits can be acquired */
+			size_t			limit;				/** total credits, 0 if credit is not enabled */
+		}producers[RING_BUFFER_PRODUCER_MAX];
+	}credit;
+
+	struct ring_buffer_timer
+	{
+		uint64_t			current;			/** time processed so far */
+		size_t				pending;			/** number of delayed nodes */
+		uint64_t			bitmap[RING_BUFFER_TIMER_LEVELS];	/** which slots are not empty */
+		ring_buffer_node_t*	slots[RING_BUFFER_TIMER_LEVELS][RING_BUFFER_TIMER_MASK + 1];	/** last node of each slot */
+		ring_buffer_node_t*	overflow;			/** last node of delays too long for the wheel */
+	}timer;
+
+	ring_buffer_node_t*		HEAD;				/** point to newest reading/writing/committed node */
+	ring_buffer_node_t*		TAIL;				/** point to oldest reading/writing/committed node */
+	ring_buffer_node_t*		oldest_reserve;		/** point to oldest writing/committed node */
+	ring_buffer_node_t*		FRONTIER;			/** point to physically last reserved node, new node is placed after it */
+};
+
+/**
+* calculate how many space a data actually cost
+* @param len	data length
+* @return		actual space
+*/
+inline static size_t _ring_buffer_node_cost(size_t len)
+{
+	return ALIGN_SIZE(sizeof(ring_buffer_node_t) + len, sizeof(void*));
+}
+
+/**
+* how many space a node actually takes, including optional fields after data
+* @param node	node
+* @return		actual space
+*/
+inline static size_t _ring_buffer_node_size(const ring_buffer_node_t* node)
+{
+	return _ring_buffer_node_cost(node->token.len)
+		+ ((node->flags & ring_buffer_node_flag_timer) ? sizeof(ring_buffer_node_timer_t) : 0)
+		+ ((node->flags & ring_buffer_node_flag_key) ? sizeof(ring_buffer_node_key_t) : 0)
+		+ ((node->flags & ring_buffer_node_flag_crc) ? sizeof(ring_buffer_node_crc_t) : 0)
+		+ ((node->flags & ring_buffer_node_flag_expire) ? sizeof(ring_buffer_node_expire_t) : 0);
+}
+
+inline static ring_buffer_node_timer_t* _ring_buffer_node_timer(ring_buffer_node_t* node)
+{
+	return (ring_buffer_node_timer_t*)((uint8_t*)node + _ring_buffer_node_cost(node->token.len));
+}
+
+inline static ring_buffer_node_key_t* _ring_buffer_node_key(ring_buffer_node_t* node)
+{
+	return (ring_buffer_node_key_t*)((uint8_t*)node + _ring_buffer_node_cost(node->token.len)
+		+ ((node->flags & ring_buffer_node_flag_timer) ? sizeof(ring_buffer_node_timer_t) : 0));
+}
+
+/**
+* where user data of a node is, it is out of ring buffer for large elements
+* @param node	node
+* @param len	[out] length of user data
+* @return		start of user data
+*/
+inline static uint8_t* _ring_buffer_node_payload(ring_buffer_node_t* node, size_t* len)
+{
+	if (node->flags & ring_buffer_node_flag_external)
+	{
+		const ring_buffer_node_external_t* external = (const ring_buffer_node_external_t*)node->token.data;
+		*len = external->len;
+		return external->ptr;
+	}
+	*len = node->token.len;
+	return node->token.data;
+}
+
+inline static ring_buffer_node_crc_t* _ring_buffer_node_crc(ring_buffer_node_t* node)
+{
+	return (ring_buffer_node_crc_t*)((uint8_t*)node + _ring_buffer_node_cost(node->token.len)
+		+ ((node->flags & ring_buffer_node_flag_timer) ? sizeof(ring_buffer_node_timer_t) : 0)
+		+ ((node->flags & ring_buffer_node_flag_key) ? sizeof(ring_buffer_node_key_t) : 0));
+}
+
+inline static ring_buffer_node_expire_t* _ring_buffer_node_expire(ring_buffer_node_t* node)
+{
+	return (ring_buffer_node_expire_t*)((uint8_t*)node + _ring_buffer_node_cost(node->token.len)
+		+ ((node->flags & ring_buffer_node_flag_timer) ? sizeof(ring_buffer_node_timer_t) : 0)
+		+ ((node->flags & ring_buffer_node_flag_key) ? sizeof(ring_buffer_node_key_t) : 0)
+		+ ((node->flags & ring_buffer_node_flag_crc) ? sizeof(ring_buffer_node_crc_t) : 0));
+}
+
+/**
+* give credits back to producer and wake up waiters
+* @param rb			ring buffer
+* @param producer	producer id
+* @param cost		credits
+*/
+void _ring_buffer_credit_refund(ring_buffer_t* rb, unsigned producer, size_t cost);
+
+/**
+* copy data into or out of ring buffer. large copies bypass cache, the routine is selected by cpu features.
+* @param dst	destination
+* @param src	source
+* @param len	length
+*/
+void _ring_buffer_copy(void* dst, const void* src, size_t len);
+
+/**
+* crc32c of data, the routine is selected by cpu features
+* @param data	data
+* @param len	length
+* @return		crc32c
+*/
+uint32_t _ring_buffer_crc32c(const void* data, size_t len);
+
+/**
+* copy data and compute crc32c of it in one pass
+* @param dst	destination
+* @param src	source
+* @param len	length
+* @return		crc32c
+*/
+uint32_t _ring_buffer_copy_crc32c(void* dst, const void* src, size_t len);
+
+/**
+* compress data, output starts with raw length
+* @param dst	destination
+* @param cap	size of destination
+* @param src	source
+* @param len	length of source
+* @param table	hash table of 2^bits entries, cleared here
+* @param bits	hash bits, no more than `RING_BUFFER_LZ_HASH_BITS`
+* @return		compressed length, 0 if it does not fit in `cap`
+*/
+size_t _ring_buffer_lz_compress(void* dst, size_t cap, const void* src, size_t len, uint32_t* table, unsigned bits);
+
+/**
+* raw length of compressed data
+* @return	raw length
+*/
+size_t _ring_buffer_lz_raw_len(const void* src, size_t len);
+
+/**
+* decompress data
+* @param dst	destination
+* @param cap	size of destination
+* @param src	compressed data
+* @param len	length of compressed data
+* @return		0 on success, -1 if destination is too small or data is corrupted
+*/
+int _ring_buffer_lz_decompress(void* dst, size_t cap, const void* src, size_t len);
+
+/**
+* give back tail of a writing node, optional fields after data are moved
+* @param rb		ring buffer
+* @param token	token being written
+* @param len	new length, not larger than current length
+*/
+void _ring_buffer_shrink(ring_buffer_t* rb, ring_buffer_token_t* token, size_t len);
+
+/**
+* reserve an element, payload is allocated out of ring buffer if it is large, see `ring_buffer_set_large`
+* @param rb		ring buffer
+* @param len	length of payload
+* @param flags	control flags, the same as `ring_buffer_reserve`
+* @param data	[out] where payload should be written
+* @return		token, NULL on failure
+*/
+ring_buffer_token_t* _ring_buffer_reserve_payload(ring_buffer_t* rb, size_t len, int flags, uint8_t** data);
+
+/**
+* free out of line payload of a node being removed
+* @param rb		ring buffer
+* @param node	node with `ring_buffer_node_flag_external`
+*/
+void _ring_buffer_large_release(ring_buffer_t* rb, ring_buffer_node_t* node);
+
+/**
+* same as `ring_buffer_reserve_ex`, but only in this segment
+*/
+ring_buffer_token_t* _ring_buffer_reserve_ex(ring_buffer_t* rb, size_t len, int flags, const ring_buffer_reserve_opt_t* opt);
+
+/**
+* reserve when more than one segment may be used, see `ring_buffer_attach`
+*/
+ring_buffer_token_t* _ring_buffer_segment_reserve(ring_buffer_t* rb, size_t len, int flags, const ring_buffer_reserve_opt_t* opt);
+
+/**
+* find segment a node belongs to
+* @param rb		first segment
+* @param node	node
+* @return		segment
+*/
+ring_buffer_t* _ring_buffer_segment_of(ring_buffer_t* rb, const ring_buffer_node_t* node);
+
+/**
+* release attached segments which are drained and will not get new elements
+* @param rb		first segment
+*/
+void _ring_buffer_segment_trim(ring_buffer_t* rb);
+
+/**
+* move read segment back to a segment which got elements given back
+* @param rb			first segment
+* @param segment	segment elements are given back to
+*/
+void _ring_buffer_segment_rewind(ring_buffer_t* rb, ring_buffer_t* segment);
+
+/**
+* write all iovec, retry on partial write
+* @param fd		file descriptor
+* @param iov	iovec, modified as it is written
+* @param cnt	number of iovec
+* @return		0 on success, otherwise failed
+*/
+int _ring_buffer_writev(int fd, struct iovec* iov, int cnt);
+
+/**
+* same as `ring_buffer_commit_run`, but tells whether elements are given back
+* @param rb		first segment
+* @param span	span got by `ring_buffer_consume_run`
+* @param flags	control flags
+* @return		1 if given back, 0 if removed, -1 on failure
+*/
+int _ring_buffer_commit_run(ring_buffer_t* rb, const ring_buffer_span_t* span, int flags);
+
+/**
+* append an element to spill file, see `ring_buffer_set_spill`
+* @param rb		first segment
+* @param data	data
+* @param len	length of data
+* @return		0 on success, -1 on failure
+*/
+int _ring_buffer_spill_push(ring_buffer_t* rb, const void* data, size_t len);
+
+/**
+* move elements from spill file back into ring buffer, as many as fit
+* @param rb		first segment
+*/
+void _ring_buffer_spill_refill(ring_buffer_t* rb);
+
+/**
+* same as `ring_buffer_consume`
+* @param verify	whether elements failed crc32c check are dropped. if not, caller must check them
+*/
+ring_buffer_token_t* _ring_buffer_consume(ring_buffer_t* rb, size_t* lost, int verify);
+
+#endif
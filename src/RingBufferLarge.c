@@ -0,0 +1,78 @@
+#include "RingBufferInternal.h"
+#include <sys/mman.h>
+
+static void* _ring_buffer_large_map(size_t len, void* arg)
+{
+	(void)arg;
+	void* ptr = mmap(NULL, len != 0 ? len : 1, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	return ptr != MAP_FAILED ? ptr : NULL;
+}
+
+static void _ring_buffer_large_unmap(void* ptr, size_t len, void* arg)
+{
+	(void)arg;
+	munmap(ptr, len != 0 ? len : 1);
+}
+
+int ring_buffer_set_large(ring_buffer_t* rb, size_t threshold, ring_buffer_alloc_cb_t alloc, ring_buffer_free_cb_t release, void* arg)
+{
+	if ((alloc == NULL) != (release == NULL))
+	{
+		return -1;
+	}
+
+	/* every segment keeps its own count of bytes held */
+	ring_buffer_t* segment;
+	for (segment = rb; segment != NULL; segment = segment->segment.next)
+	{
+		segment->large.threshold = threshold;
+		segment->large.alloc = alloc != NULL ? alloc : _ring_buffer_large_map;
+		segment->large.release = release != NULL ? release : _ring_buffer_large_unmap;
+		segment->large.arg = arg;
+	}
+	return 0;
+}
+
+ring_buffer_token_t* _ring_buffer_reserve_payload(ring_buffer_t* rb, size_t len, int flags, uint8_t** data)
+{
+	/* a payload larger than capacity would never fit, no need to try */
+	if (rb->large.threshold == 0 || (len < rb->large.threshold && _ring_buffer_node_cost(len) <= rb->cfg.capacity))
+	{
+		ring_buffer_token_t* token = ring_buffer_reserve(rb, len, flags);
+		*data = token != NULL ? token->data : NULL;
+		return token;
+	}
+
+	/* descriptor first, so nothing is allocated when ring buffer is full */
+	ring_buffer_token_t* token = ring_buffer_reserve(rb, sizeof(ring_buffer_node_external_t), flags);
+	if (token == NULL)
+	{
+		return NULL;
+	}
+
+	ring_buffer_node_external_t* external = (ring_buffer_node_external_t*)token->data;
+	external->ptr = rb->large.alloc(len, rb->large.arg);
+	if (external->ptr == NULL)
+	{
+		ring_buffer_commit(rb, token, ring_buffer_flag_discard);
+		return NULL;
+	}
+	external->len = len;
+	_ring_buffer_segment_of(rb, CONTAINER_FOR(token, ring_buffer_node_t, token))->large.bytes += len;
+
+	CONTAINER_FOR(token, ring_buffer_node_t, token)->flags |= ring_buffer_node_flag_external;
+	*data = external->ptr;
+	return token;
+}
+
+void _ring_buffer_large_release(ring_buffer_t* rb, ring_buffer_node_t* node)
+{
+	ring_buffer_node_external_t* external = (ring_buffer_node_external_t*)node->token.data;
+	rb->large.bytes -= external->len;
+	rb->large.release(external->ptr, external->len, rb->large.arg);
+}
+
+const void* ring_buffer_payload(const ring_buffer_token_t* token, size_t* len)
+{
+	return _ring_buffer_node_payload(CONTAINER_FOR(token, ring_buffer_node_t, token), len);
+}
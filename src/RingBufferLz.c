@@ -0,0 +1,228 @@
+#include "RingBufferInternal.h"
+#include <string.h>
+
+/**
+* block format, the same idea as lz4:
+* [raw length: 4 bytes] then sequences of
+* [token: literal length << 4 | (match length - 4)][more literal length][literals][offset: 2 bytes][more match length]
+* a length nibble of 15 is followed by bytes added to it until a byte less than 255.
+* the last sequence only has literals.
+*/
+#define RING_BUFFER_LZ_MIN_MATCH	4
+#define RING_BUFFER_LZ_MAX_OFFSET	65535
+#define RING_BUFFER_LZ_HEADER		sizeof(uint32_t)
+
+inline static uint32_t _ring_buffer_lz_read32(const uint8_t* p)
+{
+	uint32_t v;
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+inline static uint32_t _ring_buffer_lz_hash(uint32_t v, unsigned bits)
+{
+	return (v * 2654435761U) >> (32 - bits);
+}
+
+/**
+* write extra bytes of a length
+* @return	next output position
+*/
+inline static uint8_t* _ring_buffer_lz_put_length(uint8_t* op, size_t len)
+{
+	for (; len >= 255; len -= 255)
+	{
+		*op++ = 255;
+	}
+	*op++ = (uint8_t)len;
+	return op;
+}
+
+/**
+* write one sequence, match_len 0 means the last sequence
+* @return	next output position, NULL if it does not fit
+*/
+static uint8_t* _ring_buffer_lz_put_sequence(uint8_t* op, const uint8_t* op_end,
+	const uint8_t* literals, size_t lit_len, size_t offset, size_t match_len)
+{
+	/* token, literal length, literals, offset, match length */
+	const size_t need = 1 + (lit_len >= 15 ? lit_len / 255 + 1 : 0) + lit_len
+		+ (match_len != 0 ? 2 + (match_len - RING_BUFFER_LZ_MIN_MATCH >= 15 ? (match_len - RING_BUFFER_LZ_MIN_MATCH) / 255 + 1 : 0) : 0);
+	if (need > (size_t)(op_end - op))
+	{
+		return NULL;
+	}
+
+	const size_t ml = match_len != 0 ? match_len - RING_BUFFER_LZ_MIN_MATCH : 0;
+	uint8_t* token = op++;
+	*token = (uint8_t)(((lit_len < 15 ? lit_len : 15) << 4) | (ml < 15 ? ml : 15));
+	if (lit_len >= 15)
+	{
+		op = _ring_buffer_lz_put_length(op, lit_len - 15);
+	}
+	memcpy(op, literals, lit_len);
+	op += lit_len;
+
+	if (match_len != 0)
+	{
+		*op++ = (uint8_t)offset;
+		*op++ = (uint8_t)(offset >> 8);
+		if (ml >= 15)
+		{
+			op = _ring_buffer_lz_put_length(op, ml - 15);
+		}
+	}
+	return op;
+}
+
+size_t _ring_buffer_lz_compress(void* dst, size_t cap, const void* src, size_t len, uint32_t* table, unsigned bits)
+{
+	if (cap < RING_BUFFER_LZ_HEADER || len > UINT32_MAX || bits == 0 || bits > RING_BUFFER_LZ_HASH_BITS)
+	{
+		return 0;
+	}
+
+	uint8_t* op = (uint8_t*)dst + RING_BUFFER_LZ_HEADER;
+	const uint8_t* op_end = (uint8_t*)dst + cap;
+	const uint8_t* base = src;
+	const uint32_t raw_len = (uint32_t)len;
+	memcpy(dst, &raw_len, sizeof(raw_len));
+
+	/* position + 1 of last occurrence of a hash, 0 means none */
+	memset(table, 0, ((size_t)1 << bits) * sizeof(uint32_t));
+
+	size_t anchor = 0;
+	size_t ip = 0;
+	while (ip + RING_BUFFER_LZ_MIN_MATCH <= len)
+	{
+		const uint32_t v = _ring_buffer_lz_read32(base + ip);
+		const uint32_t h = _ring_buffer_lz_hash(v, bits);
+		const size_t ref = table[h];
+		table[h] = (uint32_t)(ip + 1);
+
+		if (ref == 0 || ip + 1 - ref > RING_BUFFER_LZ_MAX_OFFSET || _ring_buffer_lz_read32(base + ref - 1) != v)
+		{
+			/* step faster through data that does not compress */
+			ip += 1 + ((ip - anchor) >> 6);
+			continue;
+		}
+
+		size_t match_len = RING_BUFFER_LZ_MIN_MATCH;
+		while (ip + match_len < len && base[ref - 1 + match_len] == base[ip + match_len])
+		{
+			match_len++;
+		}
+
+		op = _ring_buffer_lz_put_sequence(op, op_end, base + anchor, ip - anchor, ip + 1 - ref, match_len);
+		if (op == NULL)
+		{
+			return 0;
+		}
+		ip += match_len;
+		anchor = ip;
+	}
+
+	op = _ring_buffer_lz_put_sequence(op, op_end, base + anchor, len - anchor, 0, 0);
+	return op != NULL ? (size_t)(op - (uint8_t*)dst) : 0;
+}
+
+size_t _ring_buffer_lz_raw_len(const void* src, size_t len)
+{
+	uint32_t raw_len;
+	if (len < RING_BUFFER_LZ_HEADER)
+	{
+		return 0;
+	}
+	memcpy(&raw_len, src, sizeof(raw_len));
+	return raw_len;
+}
+
+/**
+* read extra bytes of a length
+* @return	0 on success, -1 if input ends
+*/
+inline static int _ring_buffer_lz_get_length(const uint8_t** ip, const uint8_t* ip_end, size_t* len)
+{
+	uint8_t b;
+	do
+	{
+		if (*ip >= ip_end)
+		{
+			return -1;
+		}
+		b = *(*ip)++;
+		*len += b;
+	} while (b == 255);
+	return 0;
+}
+
+int _ring_buffer_lz_decompress(void* dst, size_t cap, const void* src, size_t len)
+{
+	const size_t raw_len = _ring_buffer_lz_raw_len(src, len);
+	if (len < RING_BUFFER_LZ_HEADER || raw_len > cap)
+	{
+		return -1;
+	}
+
+	/* every length is checked, so corrupted input never reads or writes out of bounds */
+	const uint8_t* ip = (const uint8_t*)src + RING_BUFFER_LZ_HEADER;
+	const uint8_t* ip_end = (const uint8_t*)src + len;
+	uint8_t* op = dst;
+	uint8_t* op_end = (uint8_t*)dst + raw_len;
+	while (ip < ip_end)
+	{
+		const uint8_t token = *ip++;
+		size_t lit_len = token >> 4;
+		if (lit_len == 15 && _ring_buffer_lz_get_length(&ip, ip_end, &lit_len) < 0)
+		{
+			return -1;
+		}
+		if (lit_len > (size_t)(ip_end - ip) || lit_len > (size_t)(op_end - op))
+		{
+			return -1;
+		}
+		memcpy(op, ip, lit_len);
+		ip += lit_len;
+		op += lit_len;
+
+		/* last sequence */
+		if (ip == ip_end)
+		{
+			break;
+		}
+
+		if (ip_end - ip < 2)
+		{
+			return -1;
+		}
+		const size_t offset = (size_t)ip[0] | (size_t)ip[1] << 8;
+		ip += 2;
+		size_t match_len = token & 0x0F;
+		if (match_len == 15 && _ring_buffer_lz_get_length(&ip, ip_end, &match_len) < 0)
+		{
+			return -1;
+		}
+		match_len += RING_BUFFER_LZ_MIN_MATCH;
+		if (offset == 0 || offset > (size_t)(op - (uint8_t*)dst) || match_len > (size_t)(op_end - op))
+		{
+			return -1;
+		}
+
+		const uint8_t* ref = op - offset;
+		if (offset >= match_len)
+		{
+			memcpy(op, ref, match_len);
+			op += match_len;
+		}
+		else
+		{
+			/* overlapping match repeats the last `offset` bytes */
+			for (; match_len > 0; match_len--)
+			{
+				*op++ = *ref++;
+			}
+		}
+	}
+
+	return op == op_end ? 0 : -1;
+}
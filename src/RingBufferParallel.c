@@ -0,0 +1,108 @@
+#include "RingBufferInternal.h"
+
+#define RING_BUFFER_PARALLEL_MAX	64	/** max number of threads of `ring_buffer_foreach_parallel` */
+
+typedef struct ring_buffer_parallel_job
+{
+	int			(*cb)(ring_buffer_token_t* token, int state, unsigned chunk, void* arg);	/** user call back */
+	void*		arg;		/** user defined arg */
+	atomic_int	stop;		/** set when a call back want to stop */
+}ring_buffer_parallel_job_t;
+
+typedef struct ring_buffer_parallel_chunk
+{
+	ring_buffer_parallel_job_t*	job;		/** shared by all chunks */
+	ring_buffer_node_t*			begin;		/** first node */
+	ring_buffer_node_t*			end;		/** node after last one, NULL for the last chunk */
+	unsigned					chunk;		/** chunk index */
+	int							counter;	/** how many nodes are walked */
+	int							started;	/** whether a thread is created for it */
+	pthread_t					thread;		/** thread walking this chunk */
+}ring_buffer_parallel_chunk_t;
+
+static void* _ring_buffer_parallel_walk(void* arg)
+{
+	ring_buffer_parallel_chunk_t* chunk = arg;
+	ring_buffer_parallel_job_t* job = chunk->job;
+
+	ring_buffer_node_t* node;
+	for (node = chunk->begin; node != chunk->end; node = node->chain_time.p_newer, chunk->counter++)
+	{
+		if (atomic_load_explicit(&job->stop, memory_order_relaxed))
+		{
+			break;
+		}
+		if (job->cb(&node->token, node->state, chunk->chunk, job->arg) < 0)
+		{
+			atomic_store_explicit(&job->stop, 1, memory_order_relaxed);
+			break;
+		}
+	}
+
+	return NULL;
+}
+
+int ring_buffer_foreach_parallel(ring_buffer_t* rb,
+	int (*cb)(ring_buffer_token_t* token, int state, unsigned chunk, void* arg),
+	void (*reduce)(unsigned chunk, void* arg), void* arg, unsigned nthreads)
+{
+	if (nthreads == 0 || rb->segment.next != NULL)
+	{
+		return -1;
+	}
+
+	ring_buffer_token_t* starts[RING_BUFFER_PARALLEL_MAX];
+	const size_t cnt = ring_buffer_split(rb, starts,
+		nthreads < RING_BUFFER_PARALLEL_MAX ? nthreads : RING_BUFFER_PARALLEL_MAX);
+
+	ring_buffer_parallel_job_t job;
+	job.cb = cb;
+	job.arg = arg;
+	atomic_init(&job.stop, 0);
+
+	ring_buffer_parallel_chunk_t chunks[RING_BUFFER_PARALLEL_MAX];
+	size_t i;
+	for (i = 0; i < cnt; i++)
+	{
+		chunks[i].job = &job;
+		chunks[i].begin = CONTAINER_FOR(starts[i], ring_buffer_node_t, token);
+		chunks[i].end = i + 1 < cnt ? CONTAINER_FOR(starts[i + 1], ring_buffer_node_t, token) : NULL;
+		chunks[i].chunk = (unsigned)i;
+		chunks[i].counter = 0;
+		chunks[i].started = 0;
+	}
+
+	/* first chunk is walked by calling thread, so are chunks failed to start a thread */
+	for (i = 1; i < cnt; i++)
+	{
+		chunks[i].started = pthread_create(&chunks[i].thread, NULL, _ring_buffer_parallel_walk, &chunks[i]) == 0;
+	}
+	for (i = 0; i < cnt; i++)
+	{
+		if (!chunks[i].started)
+		{
+			_ring_buffer_parallel_walk(&chunks[i]);
+		}
+	}
+
+	int counter = 0;
+	for (i = 0; i < cnt; i++)
+	{
+		if (chunks[i].started)
+		{
+			pthread_join(chunks[i].thread, NULL);
+		}
+		counter += chunks[i].counter;
+	}
+
+	/* join gives the results of all chunks to calling thread */
+	if (reduce != NULL)
+	{
+		for (i = 0; i < cnt; i++)
+		{
+			reduce((unsigned)i, arg);
+		}
+	}
+
+	return counter;
+}
@@ -0,0 +1,161 @@
+#include "RingBufferInternal.h"
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#define RING_BUFFER_RECLAIM_CHUNK	1024	/** how many pages are checked by one mincore */
+
+/**
+* whether memory in [begin, end) is all in private mappings.
+* MADV_DONTNEED frees nothing on a shared mapping, pages stay in page cache or shared memory,
+* and MADV_REMOVE would punch holes in a file the user owns, so shared mappings are left alone.
+* @return	1 if all private, -1 if not or unknown
+*/
+static int _ring_buffer_reclaim_mapping(const uint8_t* begin, const uint8_t* end)
+{
+#if defined(__linux__)
+	FILE* fp = fopen("/proc/self/maps", "r");
+	if (fp == NULL)
+	{
+		return -1;
+	}
+
+	/* mappings are listed in address order, each line is "start-end perms ..." */
+	uintptr_t covered = (uintptr_t)begin;
+	char line[512];
+	while (covered < (uintptr_t)end && fgets(line, sizeof(line), fp) != NULL)
+	{
+		uintptr_t start, stop;
+		char perms[8];
+		if (sscanf(line, "%" SCNxPTR "-%" SCNxPTR " %7s", &start, &stop, perms) != 3 || stop <= covered)
+		{
+			continue;
+		}
+		if (start > covered || perms[3] != 'p')
+		{
+			break;
+		}
+		covered = stop;
+	}
+	fclose(fp);
+	return covered >= (uintptr_t)end ? 1 : -1;
+#else
+	(void)begin;
+	(void)end;
+	return 1;
+#endif
+}
+
+/**
+* give back resident pages inside a free range, pages partly used by nodes are kept
+* @return	bytes released
+*/
+static size_t _ring_buffer_reclaim_range(uint8_t* begin, uint8_t* end, uintptr_t page)
+{
+	uint8_t* start = ALIGN_PTR(begin, page);
+	uint8_t* stop = (uint8_t*)((uintptr_t)end & ~(page - 1));
+	size_t released = 0;
+
+	unsigned char vec[RING_BUFFER_RECLAIM_CHUNK];
+	while (start < stop)
+	{
+		const size_t left = (size_t)(stop - start) / page;
+		const size_t pages = left < RING_BUFFER_RECLAIM_CHUNK ? left : RING_BUFFER_RECLAIM_CHUNK;
+
+		/* pages never touched or already released are skipped, so they are not counted again */
+		if (mincore(start, pages * page, (void*)vec) < 0)
+		{
+			memset(vec, 1, pages);
+		}
+
+		size_t i = 0;
+		while (i < pages)
+		{
+			if (!(vec[i] & 0x01))
+			{
+				i++;
+				continue;
+			}
+
+			size_t j = i;
+			for (; j < pages && (vec[j] & 0x01); j++);
+			if (madvise(start + i * page, (j - i) * page, MADV_DONTNEED) == 0)
+			{
+				released += (j - i) * page;
+			}
+			i = j;
+		}
+		start += pages * page;
+	}
+
+	return released;
+}
+
+static size_t _ring_buffer_reclaim_segment(ring_buffer_t* rb, uintptr_t page)
+{
+	uint8_t* cursor = rb->cfg.cache;
+	uint8_t* end = rb->cfg.cache + rb->cfg.capacity;
+	if (rb->reclaim.mapping == 0)
+	{
+		rb->reclaim.mapping = _ring_buffer_reclaim_mapping(cursor, end);
+	}
+	if (rb->reclaim.mapping < 0)
+	{
+		return 0;
+	}
+
+	if (rb->TAIL == NULL)
+	{
+		return _ring_buffer_reclaim_range(cursor, end, page);
+	}
+
+	/* chain_pos is in address order except where it wraps, start from the lowest node */
+	ring_buffer_node_t* lowest = rb->FRONTIER;
+	while (lowest->chain_pos.p_forward > lowest)
+	{
+		lowest = lowest->chain_pos.p_forward;
+	}
+	lowest = lowest->chain_pos.p_forward;
+
+	size_t released = 0;
+	ring_buffer_node_t* node = lowest;
+	do
+	{
+		released += _ring_buffer_reclaim_range(cursor, (uint8_t*)node, page);
+		cursor = (uint8_t*)node + _ring_buffer_node_size(node);
+		node = node->chain_pos.p_forward;
+	} while (node != lowest);
+
+	return released + _ring_buffer_reclaim_range(cursor, end, page);
+}
+
+void ring_buffer_set_reclaim(ring_buffer_t* rb, uint64_t interval)
+{
+	rb->reclaim.interval = interval;
+}
+
+size_t ring_buffer_reclaim(ring_buffer_t* rb)
+{
+	if (rb->reclaim.interval != 0 && rb->clock.now != NULL)
+	{
+		const uint64_t now = rb->clock.now(rb->clock.arg);
+		if (rb->reclaim.last != 0 && now - rb->reclaim.last < rb->reclaim.interval)
+		{
+			return 0;
+		}
+		rb->reclaim.last = now;
+	}
+
+	const uintptr_t page = (uintptr_t)sysconf(_SC_PAGESIZE);
+	size_t released = 0;
+	ring_buffer_t* segment;
+	for (segment = rb; segment != NULL; segment = segment->segment.next)
+	{
+		released += _ring_buffer_reclaim_segment(segment, page);
+	}
+
+	rb->reclaim.released += released;
+	return released;
+}
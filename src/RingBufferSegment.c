@@ -0,0 +1,189 @@
+#include "RingBufferInternal.h"
+
+/**
+* give back a drained segment
+*/
+static void _ring_buffer_segment_release(ring_buffer_t* rb, ring_buffer_t* segment)
+{
+	rb->segment.count--;
+	segment->segment.next = NULL;
+	ring_buffer_exit(segment);
+	if (rb->segment.release != NULL)
+	{
+		rb->segment.release(segment->segment.memory, segment->segment.memory_size, rb->segment.arg);
+	}
+}
+
+/**
+* whether first segment holds a delayed element, committed or still being written
+*/
+static int _ring_buffer_segment_delayed(ring_buffer_t* rb)
+{
+	if (rb->timer.pending != 0)
+	{
+		return 1;
+	}
+	ring_buffer_node_t* node;
+	for (node = rb->TAIL; node != NULL; node = node->chain_time.p_newer)
+	{
+		if (node->state == writing && (node->flags & ring_buffer_node_flag_timer))
+		{
+			return 1;
+		}
+	}
+	return 0;
+}
+
+int ring_buffer_attach(ring_buffer_t* rb, void* buffer, size_t size)
+{
+	/* an attached segment cannot be the handle of another chain */
+	if (rb->segment.base != rb)
+	{
+		return -1;
+	}
+
+	/* a delayed element would get its sequence number behind elements in newer segments */
+	if (_ring_buffer_segment_delayed(rb))
+	{
+		return -1;
+	}
+
+	ring_buffer_t* segment = ring_buffer_init(buffer, size);
+	if (segment == NULL)
+	{
+		return -1;
+	}
+
+	/* behave the same as first segment */
+	segment->cfg.checksum = rb->cfg.checksum;
+	segment->cfg.compress = rb->cfg.compress;
+	segment->clock = rb->clock;
+	segment->large = rb->large;
+	segment->large.bytes = 0;
+	segment->segment.base = rb;
+
+	/* sequence number continues from where it is */
+	ring_buffer_t* last = rb->segment.write;
+	segment->counter.seq = last->counter.seq;
+	last->segment.next = segment;
+	rb->segment.write = segment;
+	rb->segment.count++;
+	return 0;
+}
+
+int ring_buffer_set_growth(ring_buffer_t* rb, size_t size, size_t max, ring_buffer_alloc_cb_t alloc, ring_buffer_free_cb_t release, void* arg)
+{
+	if (rb->segment.base != rb || (size != 0 && alloc == NULL))
+	{
+		return -1;
+	}
+
+	rb->segment.size = size;
+	rb->segment.max = max;
+	rb->segment.alloc = alloc;
+	rb->segment.release = release;
+	rb->segment.arg = arg;
+	return 0;
+}
+
+/**
+* allocate and attach a new segment, which can hold an element of `len` at least
+* @return	0 on success, otherwise failed
+*/
+static int _ring_buffer_segment_grow(ring_buffer_t* rb, size_t len)
+{
+	if (rb->segment.size == 0 || rb->segment.count >= rb->segment.max)
+	{
+		return -1;
+	}
+
+	/* a new segment is of no use if the element does not fit in an empty one */
+	const size_t need = ring_buffer_heap_cost() + 2 * _ring_buffer_node_cost(len + sizeof(ring_buffer_node_timer_t)
+		+ sizeof(ring_buffer_node_key_t) + sizeof(ring_buffer_node_crc_t));
+	const size_t size = rb->segment.size > need ? rb->segment.size : need;
+	void* memory = rb->segment.alloc(size, rb->segment.arg);
+	if (memory == NULL)
+	{
+		return -1;
+	}
+	if (ring_buffer_attach(rb, memory, size) < 0)
+	{
+		if (rb->segment.release != NULL)
+		{
+			rb->segment.release(memory, size, rb->segment.arg);
+		}
+		return -1;
+	}
+	return 0;
+}
+
+ring_buffer_token_t* _ring_buffer_segment_reserve(ring_buffer_t* rb, size_t len, int flags, const ring_buffer_reserve_opt_t* opt)
+{
+	/* growing is preferred to overwriting */
+	const int no_overwrite = flags & ~ring_buffer_flag_overwrite;
+	ring_buffer_token_t* token = _ring_buffer_reserve_ex(rb->segment.write, len, no_overwrite, opt);
+	if (token == NULL && _ring_buffer_segment_grow(rb, len) == 0)
+	{
+		token = _ring_buffer_reserve_ex(rb->segment.write, len, no_overwrite, opt);
+	}
+	if (token == NULL && (flags & ring_buffer_flag_overwrite))
+	{
+		token = _ring_buffer_reserve_ex(rb->segment.write, len, flags, opt);
+	}
+	return token;
+}
+
+ring_buffer_t* _ring_buffer_segment_of(ring_buffer_t* rb, const ring_buffer_node_t* node)
+{
+	ring_buffer_t* segment;
+	for (segment = rb; segment->segment.next != NULL; segment = segment->segment.next)
+	{
+		if ((const uint8_t*)node >= segment->cfg.cache && (const uint8_t*)node < segment->cfg.cache + segment->cfg.capacity)
+		{
+			break;
+		}
+	}
+	return segment;
+}
+
+void _ring_buffer_segment_trim(ring_buffer_t* rb)
+{
+	/* segments before read segment get no more elements, they are released once empty */
+	ring_buffer_t* prev = rb;
+	while (rb->segment.read != rb && prev->segment.next != rb->segment.read)
+	{
+		ring_buffer_t* segment = prev->segment.next;
+		if (segment->TAIL != NULL)
+		{
+			prev = segment;
+			continue;
+		}
+		prev->segment.next = segment->segment.next;
+		_ring_buffer_segment_release(rb, segment);
+	}
+
+	/* everything is drained, go back to first segment */
+	ring_buffer_t* write = rb->segment.write;
+	if (write != rb && rb->segment.read == write && rb->segment.next == write && write->TAIL == NULL && rb->TAIL == NULL)
+	{
+		rb->counter.seq = write->counter.seq;
+		rb->segment.next = NULL;
+		rb->segment.write = rb;
+		rb->segment.read = rb;
+		_ring_buffer_segment_release(rb, write);
+	}
+}
+
+void _ring_buffer_segment_rewind(ring_buffer_t* rb, ring_buffer_t* segment)
+{
+	/* only older segments are looked at, read segment never moves forward here */
+	ring_buffer_t* older;
+	for (older = rb; older != rb->segment.read; older = older->segment.next)
+	{
+		if (older == segment)
+		{
+			rb->segment.read = segment;
+			return;
+		}
+	}
+}
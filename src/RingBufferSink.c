@@ -0,0 +1,220 @@
+#include "RingBufferInternal.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+
+#define RING_BUFFER_SINK_SPANS	64		/** max runs claimed by one group commit */
+#define RING_BUFFER_SINK_BATCH	128		/** how many elements are written by one writev */
+
+/**
+* start a new log segment, named by sequence number of its first element.
+* previous segment is synced first, since the group commit only syncs the current one.
+* @return	0 on success, otherwise failed
+*/
+static int _ring_buffer_sink_open(ring_buffer_t* rb, uint64_t seq)
+{
+	if (rb->sink.fd >= 0)
+	{
+		const int ret = fdatasync(rb->sink.fd);
+		close(rb->sink.fd);
+		rb->sink.fd = -1;
+		if (ret < 0)
+		{
+			return -1;
+		}
+	}
+
+	char name[32];
+	snprintf(name, sizeof(name), "%020" PRIu64 ".log", seq);
+	rb->sink.fd = openat(rb->sink.dir_fd, name, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	rb->sink.size = 0;
+
+	/* new entry of directory must be durable too */
+	return rb->sink.fd >= 0 && fsync(rb->sink.dir_fd) == 0 ? 0 : -1;
+}
+
+/**
+* claim what can be drained, write it, sync once, then remove it from ring buffer
+* @return	1 if something is written, 0 if nothing to drain, -1 on failure
+*/
+static int _ring_buffer_sink_group(ring_buffer_t* rb)
+{
+	const ring_buffer_sink_opt_t* opt = &rb->sink.opt;
+	ring_buffer_span_t spans[RING_BUFFER_SINK_SPANS];
+	size_t counts[RING_BUFFER_SINK_SPANS];
+	size_t cnt = 0;
+	size_t bytes = 0;
+
+	opt->lock(opt->arg);
+	while (cnt < RING_BUFFER_SINK_SPANS && bytes < opt->max_bytes
+		&& ring_buffer_consume_run(rb, &spans[cnt], opt->max_bytes - bytes, &counts[cnt]) == 0)
+	{
+		bytes += spans[cnt].len;
+		cnt++;
+	}
+	opt->unlock(opt->arg);
+
+	if (cnt == 0)
+	{
+		return 0;
+	}
+
+	/* claimed elements are not touched by others, so they are written without lock */
+	struct iovec iov[RING_BUFFER_SINK_BATCH * 2];
+	ring_buffer_snapshot_record_t records[RING_BUFFER_SINK_BATCH];
+	size_t batch = 0;
+	uint64_t last = 0;
+	int ret = 0;
+	size_t i;
+	for (i = 0; i < cnt && ret == 0; i++)
+	{
+		ring_buffer_token_t* token;
+		for (token = ring_buffer_span_next(&spans[i], NULL); token != NULL && ret == 0; token = ring_buffer_span_next(&spans[i], token))
+		{
+			if (rb->sink.fd < 0 || rb->sink.size >= opt->segment_size)
+			{
+				ret = _ring_buffer_writev(rb->sink.fd, iov, (int)batch * 2) < 0 || _ring_buffer_sink_open(rb, token->seq) < 0 ? -1 : 0;
+				batch = 0;
+				if (ret < 0)
+				{
+					break;
+				}
+			}
+
+			ring_buffer_node_t* node = CONTAINER_FOR(token, ring_buffer_node_t, token);
+			size_t len;
+			uint8_t* data = _ring_buffer_node_payload(node, &len);
+			records[batch].seq = token->seq;
+			records[batch].len = len;
+			records[batch].flags = node->flags & RING_BUFFER_SNAPSHOT_FLAGS;
+			iov[batch * 2].iov_base = &records[batch];
+			iov[batch * 2].iov_len = sizeof(records[batch]);
+			iov[batch * 2 + 1].iov_base = data;
+			iov[batch * 2 + 1].iov_len = len;
+			rb->sink.size += sizeof(records[batch]) + len;
+			last = token->seq;
+
+			if (++batch == RING_BUFFER_SINK_BATCH)
+			{
+				ret = _ring_buffer_writev(rb->sink.fd, iov, (int)batch * 2);
+				batch = 0;
+			}
+		}
+	}
+
+	/* one sync for every producer in this group */
+	if (ret == 0 && (_ring_buffer_writev(rb->sink.fd, iov, (int)batch * 2) < 0 || fdatasync(rb->sink.fd) < 0))
+	{
+		ret = -1;
+	}
+	if (ret < 0)
+	{
+		rb->sink.error = errno != 0 ? errno : EIO;
+	}
+
+	/*
+	* on failure elements are given back, newest first so each run has no reading element after it.
+	* if another consumer reads newer elements, they cannot be given back and are removed without being durable.
+	*/
+	opt->lock(opt->arg);
+	for (i = cnt; i > 0; i--)
+	{
+		if (_ring_buffer_commit_run(rb, &spans[i - 1], ret == 0 ? 0 : ring_buffer_flag_discard | ring_buffer_flag_consume_on_error) == 0
+			&& ret < 0)
+		{
+			rb->counter.lost += counts[i - 1];
+		}
+	}
+	opt->unlock(opt->arg);
+
+	if (ret < 0)
+	{
+		return -1;
+	}
+	atomic_store_explicit(&rb->sink.durable, last + 1, memory_order_release);
+	if (opt->durable != NULL)
+	{
+		opt->durable(last, opt->arg);
+	}
+	return 1;
+}
+
+static void* _ring_buffer_sink_run(void* arg)
+{
+	ring_buffer_t* rb = arg;
+	const struct timespec wait = { (time_t)(rb->sink.opt.interval / 1000000), (long)(rb->sink.opt.interval % 1000000) * 1000 };
+
+	for (;;)
+	{
+		/* read before draining, so elements committed before stop is asked are written */
+		const int stop = atomic_load_explicit(&rb->sink.stop, memory_order_acquire);
+		const int ret = _ring_buffer_sink_group(rb);
+		if (ret < 0 || (ret == 0 && stop))
+		{
+			break;
+		}
+		if (ret == 0)
+		{
+			nanosleep(&wait, NULL);
+		}
+	}
+
+	return NULL;
+}
+
+int ring_buffer_sink_start(ring_buffer_t* rb, const ring_buffer_sink_opt_t* opt)
+{
+	if (rb->sink.started || opt->dir == NULL || opt->lock == NULL || opt->unlock == NULL
+		|| opt->max_bytes == 0 || opt->segment_size == 0)
+	{
+		return -1;
+	}
+
+	rb->sink.dir_fd = open(opt->dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if (rb->sink.dir_fd < 0)
+	{
+		return -1;
+	}
+
+	rb->sink.opt = *opt;
+	rb->sink.fd = -1;
+	rb->sink.size = 0;
+	rb->sink.error = 0;
+	atomic_store(&rb->sink.stop, 0);
+	if (pthread_create(&rb->sink.thread, NULL, _ring_buffer_sink_run, rb) != 0)
+	{
+		close(rb->sink.dir_fd);
+		return -1;
+	}
+
+	rb->sink.started = 1;
+	return 0;
+}
+
+int ring_buffer_sink_stop(ring_buffer_t* rb)
+{
+	if (!rb->sink.started)
+	{
+		return -1;
+	}
+
+	atomic_store_explicit(&rb->sink.stop, 1, memory_order_release);
+	pthread_join(rb->sink.thread, NULL);
+	rb->sink.started = 0;
+
+	if (rb->sink.fd >= 0)
+	{
+		close(rb->sink.fd);
+		rb->sink.fd = -1;
+	}
+	close(rb->sink.dir_fd);
+	return rb->sink.error;
+}
+
+uint64_t ring_buffer_sink_durable(ring_buffer_t* rb)
+{
+	return atomic_load_explicit(&rb->sink.durable, memory_order_acquire);
+}
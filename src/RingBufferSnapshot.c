@@ -0,0 +1,419 @@
+#include "RingBufferInternal.h"
+#include <errno.h>
+#include <stddef.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/uio.h>
+
+#define RING_BUFFER_SNAPSHOT_MAGIC		0x4E534252	/** "RBSN" */
+#define RING_BUFFER_SNAPSHOT_VERSION	3
+#define RING_BUFFER_SNAPSHOT_BATCH		128			/** how many elements are written by one writev */
+#define RING_BUFFER_SNAPSHOT_RETRY		16			/** how many times `ring_buffer_snapshot_tail` restarts */
+
+/**
+* snapshot layout:
+* [header][record][data][record][data]...[end record]
+* elements are stored in time order, only committed elements are stored.
+* since version 3, records end with a record of sequence number `seq` and no data instead of `count`.
+*/
+typedef struct ring_buffer_snapshot_header
+{
+	uint32_t	magic;		/** RING_BUFFER_SNAPSHOT_MAGIC */
+	uint32_t	version;	/** RING_BUFFER_SNAPSHOT_VERSION */
+	uint64_t	count;		/** how many records follow. 0 since version 3 */
+	uint64_t	seq;		/** sequence number for next reserved element */
+}ring_buffer_snapshot_header_t;
+
+typedef struct ring_buffer_snapshot_reader
+{
+	int			fd;			/** file descriptor */
+	size_t		pos;		/** read position in cache */
+	size_t		len;		/** valid length in cache */
+	uint8_t		cache[4096];/** small reads are served from here */
+}ring_buffer_snapshot_reader_t;
+
+int _ring_buffer_writev(int fd, struct iovec* iov, int cnt)
+{
+	while (cnt > 0)
+	{
+		ssize_t ret = writev(fd, iov, cnt);
+		if (ret < 0)
+		{
+			if (errno == EINTR)
+			{
+				continue;
+			}
+			return -1;
+		}
+
+		/* skip what is written */
+		for (; cnt > 0 && (size_t)ret >= iov->iov_len; iov++, cnt--)
+		{
+			ret -= iov->iov_len;
+		}
+		if (cnt > 0)
+		{
+			iov->iov_base = (uint8_t*)iov->iov_base + ret;
+			iov->iov_len -= ret;
+		}
+	}
+
+	return 0;
+}
+
+/**
+* read exactly `size` bytes. large reads go directly to `dst`.
+* @param dst	destination, NULL to skip data
+* @return		0 on success, otherwise failed
+*/
+static int _ring_buffer_snapshot_read(ring_buffer_snapshot_reader_t* reader, void* dst, size_t size)
+{
+	while (size > 0)
+	{
+		if (reader->pos < reader->len)
+		{
+			size_t copy_size = reader->len - reader->pos < size ? reader->len - reader->pos : size;
+			if (dst != NULL)
+			{
+				memcpy(dst, reader->cache + reader->pos, copy_size);
+				dst = (uint8_t*)dst + copy_size;
+			}
+			reader->pos += copy_size;
+			size -= copy_size;
+			continue;
+		}
+
+		const int direct = dst != NULL && size >= sizeof(reader->cache);
+		ssize_t ret = read(reader->fd, direct ? dst : reader->cache, direct ? size : sizeof(reader->cache));
+		if (ret < 0 && errno == EINTR)
+		{
+			continue;
+		}
+		if (ret <= 0)
+		{
+			return -1;
+		}
+
+		if (direct)
+		{
+			dst = (uint8_t*)dst + ret;
+			size -= ret;
+		}
+		else
+		{
+			reader->pos = 0;
+			reader->len = ret;
+		}
+	}
+
+	return 0;
+}
+
+/**
+* next node in time order across segments
+* @param segment	[in, out] segment of node
+*/
+static ring_buffer_node_t* _ring_buffer_snapshot_next(ring_buffer_t** segment, ring_buffer_node_t* node)
+{
+	if (node != NULL && node->chain_time.p_newer != NULL)
+	{
+		return node->chain_time.p_newer;
+	}
+	for (*segment = node != NULL ? (*segment)->segment.next : *segment; *segment != NULL; *segment = (*segment)->segment.next)
+	{
+		if ((*segment)->TAIL != NULL)
+		{
+			return (*segment)->TAIL;
+		}
+	}
+	return NULL;
+}
+
+int ring_buffer_snapshot_ex(ring_buffer_t* rb, int fd, ring_buffer_lock_cb_t lock, ring_buffer_lock_cb_t unlock, void* arg)
+{
+	if ((lock == NULL) != (unlock == NULL))
+	{
+		return -1;
+	}
+
+	ring_buffer_snapshot_header_t header;
+	header.magic = RING_BUFFER_SNAPSHOT_MAGIC;
+	header.version = RING_BUFFER_SNAPSHOT_VERSION;
+	header.count = 0;
+
+	/* the cut is every committed element older than this sequence number */
+	if (lock != NULL)
+	{
+		lock(arg);
+	}
+	if (rb->snapshot.active)
+	{
+		if (unlock != NULL)
+		{
+			unlock(arg);
+		}
+		return -1;
+	}
+	rb->snapshot.active = 1;
+	header.seq = rb->counter.seq;
+	if (unlock != NULL)
+	{
+		unlock(arg);
+	}
+
+	struct iovec iov[RING_BUFFER_SNAPSHOT_BATCH * 2];
+	ring_buffer_snapshot_record_t records[RING_BUFFER_SNAPSHOT_BATCH];
+	ring_buffer_node_t* nodes[RING_BUFFER_SNAPSHOT_BATCH];
+	int ret = _ring_buffer_writev(fd, &(struct iovec){ &header, sizeof(header) }, 1);
+
+	/* only one batch is pinned at a time, it is collected under the lock and written without lock */
+	size_t batch = 0;
+	uint64_t next = 0;
+	ring_buffer_t* last_segment = rb;
+	for (;;)
+	{
+		if (lock != NULL)
+		{
+			lock(arg);
+		}
+
+		/* last node of previous batch is still pinned, so it is where walking goes on */
+		ring_buffer_t* segment = last_segment;
+		ring_buffer_node_t* node = _ring_buffer_snapshot_next(&segment, batch != 0 ? nodes[batch - 1] : NULL);
+		size_t i;
+		for (i = 0; i < batch; i++)
+		{
+			nodes[i]->refs--;
+			nodes[i]->flags &= ~ring_buffer_node_flag_pinned;
+		}
+
+		/* elements consumed before their batch is collected are left out, so are the ones after the cut */
+		batch = 0;
+		for (; ret == 0 && node != NULL && batch < RING_BUFFER_SNAPSHOT_BATCH; node = _ring_buffer_snapshot_next(&segment, node))
+		{
+			if (node->state != committed || node->token.seq < next || node->token.seq >= header.seq)
+			{
+				continue;
+			}
+
+			/* large payload is stored inline, restore decides where it goes */
+			size_t len;
+			uint8_t* data = _ring_buffer_node_payload(node, &len);
+			node->refs++;
+			node->flags |= ring_buffer_node_flag_pinned;
+			nodes[batch] = node;
+			last_segment = segment;
+			next = node->token.seq + 1;
+			records[batch].seq = node->token.seq;
+			records[batch].len = len;
+			records[batch].flags = node->flags & RING_BUFFER_SNAPSHOT_FLAGS;
+			iov[batch * 2].iov_base = &records[batch];
+			iov[batch * 2].iov_len = sizeof(records[batch]);
+			iov[batch * 2 + 1].iov_base = data;
+			iov[batch * 2 + 1].iov_len = len;
+			batch++;
+		}
+
+		if (batch == 0)
+		{
+			rb->snapshot.active = 0;
+		}
+		if (unlock != NULL)
+		{
+			unlock(arg);
+		}
+		if (batch == 0)
+		{
+			break;
+		}
+
+		ret = _ring_buffer_writev(fd, iov, (int)batch * 2);
+	}
+
+	/* how many records were written is only known now, so an end record closes them */
+	if (ret == 0)
+	{
+		ring_buffer_snapshot_record_t record = { header.seq, 0, 0 };
+		ret = _ring_buffer_writev(fd, &(struct iovec){ &record, sizeof(record) }, 1);
+	}
+
+	return ret;
+}
+
+int ring_buffer_snapshot(ring_buffer_t* rb, int fd)
+{
+	return ring_buffer_snapshot_ex(rb, fd, NULL, NULL, NULL);
+}
+
+int ring_buffer_restore(ring_buffer_t* rb, int fd)
+{
+	/* only empty ring buffer can be restored */
+	if (rb->TAIL != NULL || rb->segment.next != NULL || rb->spill.pending != 0)
+	{
+		return -1;
+	}
+
+	ring_buffer_snapshot_reader_t reader;
+	reader.fd = fd;
+	reader.pos = 0;
+	reader.len = 0;
+
+	ring_buffer_snapshot_header_t header;
+	if (_ring_buffer_snapshot_read(&reader, &header, sizeof(header)) < 0
+		|| header.magic != RING_BUFFER_SNAPSHOT_MAGIC
+		|| header.version < 1 || header.version > RING_BUFFER_SNAPSHOT_VERSION)
+	{
+		return -1;
+	}
+	const size_t record_size = header.version == 1 ? offsetof(ring_buffer_snapshot_record_t, flags) : sizeof(ring_buffer_snapshot_record_t);
+
+	/* sequence numbers start over from the snapshot, even behind what ring buffer has used, since it is empty */
+	rb->index.walk_below = 0;
+	uint64_t next = 0;
+
+	uint64_t i;
+	for (i = 0; header.version >= 3 || i < header.count; i++)
+	{
+		ring_buffer_snapshot_record_t record;
+		record.flags = 0;
+		if (_ring_buffer_snapshot_read(&reader, &record, record_size) < 0)
+		{
+			return -1;
+		}
+		if (header.version >= 3 && record.seq == header.seq && record.len == 0)
+		{
+			break;
+		}
+		if (record.seq < next || record.seq >= header.seq || (size_t)record.len != record.len
+			|| (record.flags & ~(uint64_t)RING_BUFFER_SNAPSHOT_FLAGS) != 0)
+		{
+			return -1;
+		}
+
+		/* keep sequence number. if ring buffer is smaller, newest elements are kept */
+		rb->counter.seq = record.seq;
+		next = record.seq + 1;
+		uint8_t* data;
+		ring_buffer_token_t* token = _ring_buffer_reserve_payload(rb, (size_t)record.len, ring_buffer_flag_overwrite, &data);
+		if (token == NULL)
+		{
+			rb->counter.lost++;
+			if (_ring_buffer_snapshot_read(&reader, NULL, (size_t)record.len) < 0)
+			{
+				return -1;
+			}
+			continue;
+		}
+
+		if (_ring_buffer_snapshot_read(&reader, data, (size_t)record.len) < 0)
+		{
+			ring_buffer_commit(rb, token, ring_buffer_flag_discard);
+			return -1;
+		}
+		CONTAINER_FOR(token, ring_buffer_node_t, token)->flags |= (uint16_t)record.flags;
+		ring_buffer_commit(rb, token, 0);
+	}
+
+	rb->counter.seq = header.seq;
+	return 0;
+}
+
+/**
+* a node pointer read without lock must point into cache before it is dereferenced
+*/
+static int _ring_buffer_snapshot_node_valid(ring_buffer_t* rb, const ring_buffer_node_t* node)
+{
+	return (const uint8_t*)node >= rb->cfg.cache
+		&& (const uint8_t*)node + sizeof(ring_buffer_node_t) <= rb->cfg.cache + rb->cfg.capacity
+		&& ((uintptr_t)node & (sizeof(void*) - 1)) == 0;
+}
+
+/**
+* copy newest elements once, fields of nodes are read as a seqlock by `version`
+* @return	number of elements, -1 if some node is changed while copying
+*/
+static int _ring_buffer_snapshot_tail(ring_buffer_t* rb, uint8_t* dst, size_t dst_size, size_t n)
+{
+	const size_t max_steps = rb->cfg.capacity / _ring_buffer_node_cost(0);
+	const ring_buffer_node_t* node = *(ring_buffer_node_t* volatile*)&rb->HEAD;
+	uint64_t seq_newer = UINT64_MAX;
+	size_t pos = 0;
+	size_t cnt = 0;
+	size_t steps;
+
+	for (steps = 0; node != NULL && cnt < n; steps++)
+	{
+		if (steps > max_steps || !_ring_buffer_snapshot_node_valid(rb, node))
+		{
+			return -1;
+		}
+
+		const volatile ring_buffer_node_t* v_node = node;
+		const uint16_t version = v_node->version;
+		const uint64_t seq = v_node->token.seq;
+		const int state = v_node->state;
+		const uint16_t flags = v_node->flags;
+		const size_t len = v_node->token.len;
+		const ring_buffer_node_t* node_older = v_node->chain_time.p_older;
+		atomic_thread_fence(memory_order_acquire);
+
+		/* removed node, or a newer node placed at where an old node was */
+		if ((version & 0x01) || seq >= seq_newer
+			|| len > (size_t)(rb->cfg.cache + rb->cfg.capacity - node->token.data))
+		{
+			return -1;
+		}
+
+		const size_t size = ALIGN_SIZE(sizeof(ring_buffer_token_t) + len, sizeof(void*));
+		/* out of line payload may be freed at any time */
+		const int copy = (state == committed || state == reading) && !(flags & ring_buffer_node_flag_external);
+		if (copy && size > dst_size - pos)
+		{
+			break;
+		}
+		if (copy)
+		{
+			ring_buffer_token_t* token = (ring_buffer_token_t*)(dst + pos);
+			*(uint64_t*)&token->seq = seq;
+			*(size_t*)&token->len = len;
+			memcpy(token->data, node->token.data, len);
+		}
+
+		atomic_thread_fence(memory_order_acquire);
+		if (v_node->version != version || v_node->token.seq != seq)
+		{
+			return -1;
+		}
+
+		if (copy)
+		{
+			pos += size;
+			cnt++;
+		}
+		seq_newer = seq;
+		node = node_older;
+	}
+
+	return (int)cnt;
+}
+
+int ring_buffer_snapshot_tail(ring_buffer_t* rb, void* dst, size_t dst_size, size_t n)
+{
+	/* newest elements are in another segment */
+	if (*(ring_buffer_t* volatile*)&rb->segment.next != NULL)
+	{
+		return -1;
+	}
+
+	int i;
+	for (i = 0; i < RING_BUFFER_SNAPSHOT_RETRY; i++)
+	{
+		int ret = _ring_buffer_snapshot_tail(rb, dst, dst_size, n);
+		if (ret >= 0)
+		{
+			return ret;
+		}
+	}
+
+	return -1;
+}
@@ -0,0 +1,294 @@
+#include "RingBufferInternal.h"
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/uio.h>
+
+/**
+* spill file layout: [record][data][record][data]... in time order.
+* the file is emptied once every element in it is back in ring buffer.
+*/
+typedef struct ring_buffer_spill_record
+{
+	uint64_t	seq;		/** sequence number */
+	uint64_t	len;		/** length of data follow this record */
+}ring_buffer_spill_record_t;
+
+/**
+* write all iovec at offset, retry on partial write
+* @return	0 on success, otherwise failed
+*/
+static int _ring_buffer_spill_pwritev(int fd, struct iovec* iov, int cnt, uint64_t offset)
+{
+	while (cnt > 0)
+	{
+		ssize_t ret = pwritev(fd, iov, cnt, (off_t)offset);
+		if (ret < 0)
+		{
+			if (errno == EINTR)
+			{
+				continue;
+			}
+			return -1;
+		}
+
+		offset += ret;
+		for (; cnt > 0 && (size_t)ret >= iov->iov_len; iov++, cnt--)
+		{
+			ret -= iov->iov_len;
+		}
+		if (cnt > 0)
+		{
+			iov->iov_base = (uint8_t*)iov->iov_base + ret;
+			iov->iov_len -= ret;
+		}
+	}
+
+	return 0;
+}
+
+/**
+* read exactly `size` bytes at offset
+* @return	0 on success, otherwise failed
+*/
+static int _ring_buffer_spill_pread(int fd, void* dst, size_t size, uint64_t offset)
+{
+	while (size > 0)
+	{
+		ssize_t ret = pread(fd, dst, size, (off_t)offset);
+		if (ret < 0 && errno == EINTR)
+		{
+			continue;
+		}
+		if (ret <= 0)
+		{
+			return -1;
+		}
+		dst = (uint8_t*)dst + ret;
+		size -= ret;
+		offset += ret;
+	}
+
+	return 0;
+}
+
+/**
+* start over once spill is empty
+*/
+static void _ring_buffer_spill_reset(ring_buffer_t* rb)
+{
+	rb->spill.blocked = 0;
+	rb->spill.wpos = 0;
+	rb->spill.wcount = 0;
+	rb->spill.rpos = 0;
+	rb->spill.rlen = 0;
+	rb->spill.write_off = 0;
+	rb->spill.read_off = 0;
+	if (ftruncate(rb->spill.fd, 0) < 0)
+	{
+		/* file keeps its size, it is overwritten from start anyway */
+	}
+}
+
+/**
+* write batched elements to file. if it fails, they are lost
+* @return	0 on success, otherwise failed
+*/
+static int _ring_buffer_spill_flush(ring_buffer_t* rb)
+{
+	struct iovec iov = { rb->spill.buffer, rb->spill.wpos };
+	const int ret = rb->spill.wpos != 0 ? _ring_buffer_spill_pwritev(rb->spill.fd, &iov, 1, rb->spill.write_off) : 0;
+	if (ret == 0)
+	{
+		rb->spill.write_off += rb->spill.wpos;
+	}
+	else
+	{
+		rb->spill.pending -= rb->spill.wcount;
+		rb->counter.lost += rb->spill.wcount;
+	}
+	rb->spill.wpos = 0;
+	rb->spill.wcount = 0;
+
+	/* nothing is left to refill, reserves must not wait for it */
+	if (rb->spill.pending == 0)
+	{
+		_ring_buffer_spill_reset(rb);
+	}
+	return ret;
+}
+
+int ring_buffer_set_spill(ring_buffer_t* rb, int fd, void* buffer, size_t size)
+{
+	/* half for writes and half for reads, each holds a record at least */
+	if (rb->spill.pending != 0 || (fd >= 0 && (buffer == NULL || size < 4 * sizeof(ring_buffer_spill_record_t))))
+	{
+		return -1;
+	}
+
+	rb->spill.fd = fd;
+	rb->spill.buffer = buffer;
+	rb->spill.half = size / 2;
+	rb->spill.blocked = 0;
+	if (fd >= 0)
+	{
+		_ring_buffer_spill_reset(rb);
+	}
+	return 0;
+}
+
+/**
+* whether an element can be placed in ring buffer once it is drained.
+* large elements are kept out of ring buffer, and a new segment is always large enough.
+*/
+static int _ring_buffer_spill_fits(ring_buffer_t* rb, size_t len)
+{
+	const ring_buffer_t* write = rb->segment.write;
+	return rb->large.threshold != 0 || rb->segment.size != 0
+		|| _ring_buffer_node_cost(len) + (write->cfg.checksum ? sizeof(ring_buffer_node_crc_t) : 0) <= write->cfg.capacity;
+}
+
+int _ring_buffer_spill_push(ring_buffer_t* rb, const void* data, size_t len)
+{
+	/* it would stay at the head of spill forever, and block every element after it */
+	if (!_ring_buffer_spill_fits(rb, len))
+	{
+		return -1;
+	}
+
+	ring_buffer_spill_record_t record;
+	record.seq = rb->segment.write->counter.seq++;
+	record.len = len;
+
+	const size_t need = sizeof(record) + len;
+	if (need > rb->spill.half - rb->spill.wpos && _ring_buffer_spill_flush(rb) < 0)
+	{
+		return -1;
+	}
+
+	/* older elements are in spill, new elements must follow them */
+	rb->spill.blocked = 1;
+	if (need <= rb->spill.half)
+	{
+		memcpy(rb->spill.buffer + rb->spill.wpos, &record, sizeof(record));
+		memcpy(rb->spill.buffer + rb->spill.wpos + sizeof(record), data, len);
+		rb->spill.wpos += need;
+		rb->spill.wcount++;
+		rb->spill.pending++;
+		return 0;
+	}
+
+	struct iovec iov[2] = { { &record, sizeof(record) }, { (void*)data, len } };
+	if (_ring_buffer_spill_pwritev(rb->spill.fd, iov, 2, rb->spill.write_off) < 0)
+	{
+		rb->counter.lost++;
+		if (rb->spill.pending == 0)
+		{
+			_ring_buffer_spill_reset(rb);
+		}
+		return -1;
+	}
+	rb->spill.write_off += need;
+	rb->spill.pending++;
+	return 0;
+}
+
+/**
+* read more of file into read half, elements still batched are written first
+* @return	0 on success, otherwise failed
+*/
+static int _ring_buffer_spill_fill(ring_buffer_t* rb)
+{
+	uint8_t* rbuf = rb->spill.buffer + rb->spill.half;
+	const size_t left = rb->spill.rlen - rb->spill.rpos;
+	memmove(rbuf, rbuf + rb->spill.rpos, left);
+	rb->spill.rpos = 0;
+	rb->spill.rlen = left;
+
+	if (rb->spill.read_off == rb->spill.write_off && _ring_buffer_spill_flush(rb) < 0)
+	{
+		return -1;
+	}
+
+	const uint64_t avail = rb->spill.write_off - rb->spill.read_off;
+	const size_t size = avail < rb->spill.half - left ? (size_t)avail : rb->spill.half - left;
+	if (_ring_buffer_spill_pread(rb->spill.fd, rbuf + left, size, rb->spill.read_off) < 0)
+	{
+		return -1;
+	}
+	rb->spill.rlen += size;
+	rb->spill.read_off += size;
+	return 0;
+}
+
+/**
+* elements in spill cannot be read back, drop all of them
+*/
+static void _ring_buffer_spill_drop(ring_buffer_t* rb)
+{
+	rb->counter.lost += rb->spill.pending;
+	rb->spill.pending = 0;
+	_ring_buffer_spill_reset(rb);
+}
+
+void _ring_buffer_spill_refill(ring_buffer_t* rb)
+{
+	uint8_t* rbuf = rb->spill.buffer + rb->spill.half;
+	while (rb->spill.pending != 0)
+	{
+		ring_buffer_spill_record_t record;
+		if (rb->spill.rlen - rb->spill.rpos < sizeof(record)
+			&& (_ring_buffer_spill_fill(rb) < 0 || rb->spill.rlen - rb->spill.rpos < sizeof(record)))
+		{
+			_ring_buffer_spill_drop(rb);
+			return;
+		}
+		memcpy(&record, rbuf + rb->spill.rpos, sizeof(record));
+
+		/* keep sequence number, the same as restoring a snapshot */
+		ring_buffer_t* write = rb->segment.write;
+		const uint64_t seq = write->counter.seq;
+		uint8_t* data;
+		write->counter.seq = record.seq;
+		rb->spill.blocked = 0;
+		ring_buffer_token_t* token = _ring_buffer_reserve_payload(rb, (size_t)record.len, 0, &data);
+		rb->spill.blocked = 1;
+		rb->segment.write->counter.seq = seq;
+		if (token == NULL && _ring_buffer_spill_fits(rb, (size_t)record.len))
+		{
+			return;
+		}
+
+		/* data in read half is copied, the rest is read from file directly */
+		rb->spill.rpos += sizeof(record);
+		const size_t buffered = rb->spill.rlen - rb->spill.rpos;
+		const size_t copy_size = record.len < buffered ? (size_t)record.len : buffered;
+
+		/* settings changed since it was spilled and it never fits, skip it */
+		if (token == NULL)
+		{
+			rb->spill.rpos += copy_size;
+			rb->spill.read_off += record.len - copy_size;
+			rb->spill.pending--;
+			rb->counter.lost++;
+			continue;
+		}
+		memcpy(data, rbuf + rb->spill.rpos, copy_size);
+		rb->spill.rpos += copy_size;
+		if (copy_size < record.len)
+		{
+			if (_ring_buffer_spill_pread(rb->spill.fd, data + copy_size, (size_t)record.len - copy_size, rb->spill.read_off) < 0)
+			{
+				ring_buffer_commit(rb, token, ring_buffer_flag_discard);
+				_ring_buffer_spill_drop(rb);
+				return;
+			}
+			rb->spill.read_off += record.len - copy_size;
+		}
+
+		ring_buffer_commit(rb, token, 0);
+		rb->spill.pending--;
+	}
+
+	_ring_buffer_spill_reset(rb);
+}
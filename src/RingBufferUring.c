@@ -0,0 +1,551 @@
+#include "RingBufferInternal.h"
+#include <errno.h>
+
+#if defined(__linux__)
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#ifndef __NR_io_uring_setup
+#define __NR_io_uring_setup		425
+#endif
+#ifndef __NR_io_uring_enter
+#define __NR_io_uring_enter		426
+#endif
+
+/**
+* the part of linux/io_uring.h used here, so it builds with old kernel headers
+*/
+#define RING_BUFFER_URING_OP_WRITEV		2
+#define RING_BUFFER_URING_ENTER_GETEVENTS	(1U << 0)
+#define RING_BUFFER_URING_FEAT_SINGLE_MMAP	(1U << 0)
+#define RING_BUFFER_URING_OFF_SQ_RING	0ULL
+#define RING_BUFFER_URING_OFF_CQ_RING	0x8000000ULL
+#define RING_BUFFER_URING_OFF_SQES		0x10000000ULL
+
+#define RING_BUFFER_URING_BATCH			512		/** max elements in one write, each takes two iovec */
+#define RING_BUFFER_URING_DEPTH_MAX		256		/** max writes in flight */
+
+typedef struct ring_buffer_uring_sqe
+{
+	uint8_t		opcode;
+	uint8_t		flags;
+	uint16_t	ioprio;
+	int32_t		fd;
+	uint64_t	off;
+	uint64_t	addr;
+	uint32_t	len;
+	uint32_t	rw_flags;
+	uint64_t	user_data;
+	uint16_t	buf_index;
+	uint16_t	personality;
+	int32_t		splice_fd_in;
+	uint64_t	addr3;
+	uint64_t	pad;
+}ring_buffer_uring_sqe_t;
+
+typedef struct ring_buffer_uring_cqe
+{
+	uint64_t	user_data;
+	int32_t		res;
+	uint32_t	flags;
+}ring_buffer_uring_cqe_t;
+
+typedef struct ring_buffer_uring_params
+{
+	uint32_t	sq_entries;
+	uint32_t	cq_entries;
+	uint32_t	flags;
+	uint32_t	sq_thread_cpu;
+	uint32_t	sq_thread_idle;
+	uint32_t	features;
+	uint32_t	wq_fd;
+	uint32_t	resv[3];
+	struct
+	{
+		uint32_t	head, tail, ring_mask, ring_entries, flags, dropped, array, resv1;
+		uint64_t	resv2;
+	}sq_off;
+	struct
+	{
+		uint32_t	head, tail, ring_mask, ring_entries, overflow, cqes, flags, resv1;
+		uint64_t	resv2;
+	}cq_off;
+}ring_buffer_uring_params_t;
+
+/**
+* a write in flight, elements of a claimed run are written from where they are
+*/
+typedef struct ring_buffer_uring_slot
+{
+	int					active;			/** whether the run is claimed */
+	int					inflight;		/** whether a write of it is in flight */
+	int					written;		/** write is done, run is removed once every run claimed before it is */
+	int					failed;			/** write failed, what is left is written again at the same offset */
+	ring_buffer_span_t	span;			/** claimed run */
+	size_t				count;			/** number of elements */
+	uint64_t			start;			/** file offset of the run */
+	uint64_t			offset;			/** file offset of what is left to write */
+	int					iov_pos;		/** first iovec left to write */
+	int					iov_cnt;		/** number of iovec */
+	struct iovec		iov[RING_BUFFER_URING_BATCH * 2];
+	ring_buffer_snapshot_record_t	records[RING_BUFFER_URING_BATCH];
+}ring_buffer_uring_slot_t;
+
+struct ring_buffer_uring_ctx
+{
+	ring_buffer_uring_opt_t	opt;		/** options given to `ring_buffer_uring_start` */
+	size_t				size;			/** mapped size of this struct */
+	int					ring_fd;		/** io_uring instance */
+	void*				sq_ring;		/** mapped submission ring */
+	size_t				sq_ring_size;
+	void*				cq_ring;		/** mapped completion ring, the same as `sq_ring` if kernel maps them once */
+	size_t				cq_ring_size;
+	ring_buffer_uring_sqe_t*	sqes;	/** mapped submission entries */
+	size_t				sqes_size;
+	atomic_uint*		sq_tail;
+	uint32_t			sq_mask;
+	uint32_t*			sq_array;
+	atomic_uint*		cq_head;
+	atomic_uint*		cq_tail;
+	uint32_t			cq_mask;
+	ring_buffer_uring_cqe_t*	cqes;
+	unsigned			to_submit;		/** entries queued since last enter */
+	unsigned			inflight;		/** writes not completed */
+	uint64_t			offset;			/** file offset of next write */
+	unsigned			order[RING_BUFFER_URING_DEPTH_MAX];	/** claimed slots in claim order */
+	unsigned			order_head;		/** oldest claimed slot in `order` */
+	unsigned			order_count;	/** number of claimed slots */
+	unsigned			failed;			/** number of slots whose write failed and is not written yet */
+	size_t				unreported;		/** elements removed by calls which returned -1 */
+	int					write_error;	/** errno of the last failed write */
+	int					error;			/** errno which stops io_uring itself, 0 if none */
+	ring_buffer_uring_slot_t	slots[];
+};
+
+static void _ring_buffer_uring_free(ring_buffer_uring_ctx_t* ctx)
+{
+	if (ctx->sqes != NULL)
+	{
+		munmap(ctx->sqes, ctx->sqes_size);
+	}
+	if (ctx->cq_ring != NULL && ctx->cq_ring != ctx->sq_ring)
+	{
+		munmap(ctx->cq_ring, ctx->cq_ring_size);
+	}
+	if (ctx->sq_ring != NULL)
+	{
+		munmap(ctx->sq_ring, ctx->sq_ring_size);
+	}
+	if (ctx->ring_fd >= 0)
+	{
+		close(ctx->ring_fd);
+	}
+	munmap(ctx, ctx->size);
+}
+
+/**
+* map rings of a new io_uring instance
+* @return	0 on success, otherwise failed
+*/
+static int _ring_buffer_uring_setup(ring_buffer_uring_ctx_t* ctx, unsigned entries)
+{
+	ring_buffer_uring_params_t p;
+	memset(&p, 0, sizeof(p));
+	ctx->ring_fd = (int)syscall(__NR_io_uring_setup, entries, &p);
+	if (ctx->ring_fd < 0)
+	{
+		return -1;
+	}
+
+	ctx->sq_ring_size = p.sq_off.array + p.sq_entries * sizeof(uint32_t);
+	ctx->cq_ring_size = p.cq_off.cqes + p.cq_entries * sizeof(ring_buffer_uring_cqe_t);
+	if (p.features & RING_BUFFER_URING_FEAT_SINGLE_MMAP)
+	{
+		ctx->sq_ring_size = ctx->cq_ring_size = ctx->sq_ring_size > ctx->cq_ring_size ? ctx->sq_ring_size : ctx->cq_ring_size;
+	}
+
+	void* ptr = mmap(NULL, ctx->sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ctx->ring_fd, RING_BUFFER_URING_OFF_SQ_RING);
+	if (ptr == MAP_FAILED)
+	{
+		return -1;
+	}
+	ctx->sq_ring = ptr;
+
+	if (p.features & RING_BUFFER_URING_FEAT_SINGLE_MMAP)
+	{
+		ctx->cq_ring = ctx->sq_ring;
+	}
+	else
+	{
+		ptr = mmap(NULL, ctx->cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ctx->ring_fd, RING_BUFFER_URING_OFF_CQ_RING);
+		if (ptr == MAP_FAILED)
+		{
+			return -1;
+		}
+		ctx->cq_ring = ptr;
+	}
+
+	ctx->sqes_size = p.sq_entries * sizeof(ring_buffer_uring_sqe_t);
+	ptr = mmap(NULL, ctx->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ctx->ring_fd, RING_BUFFER_URING_OFF_SQES);
+	if (ptr == MAP_FAILED)
+	{
+		return -1;
+	}
+	ctx->sqes = ptr;
+
+	uint8_t* sq = ctx->sq_ring;
+	uint8_t* cq = ctx->cq_ring;
+	ctx->sq_tail = (atomic_uint*)(sq + p.sq_off.tail);
+	ctx->sq_mask = *(uint32_t*)(sq + p.sq_off.ring_mask);
+	ctx->sq_array = (uint32_t*)(sq + p.sq_off.array);
+	ctx->cq_head = (atomic_uint*)(cq + p.cq_off.head);
+	ctx->cq_tail = (atomic_uint*)(cq + p.cq_off.tail);
+	ctx->cq_mask = *(uint32_t*)(cq + p.cq_off.ring_mask);
+	ctx->cqes = (ring_buffer_uring_cqe_t*)(cq + p.cq_off.cqes);
+	return 0;
+}
+
+/**
+* queue a write of what is left in a slot. submission ring has an entry for every slot, so it never fills
+*/
+static void _ring_buffer_uring_queue(ring_buffer_uring_ctx_t* ctx, ring_buffer_uring_slot_t* slot)
+{
+	const uint32_t tail = atomic_load_explicit(ctx->sq_tail, memory_order_relaxed);
+	const uint32_t index = tail & ctx->sq_mask;
+	ring_buffer_uring_sqe_t* sqe = &ctx->sqes[index];
+	memset(sqe, 0, sizeof(*sqe));
+	sqe->opcode = RING_BUFFER_URING_OP_WRITEV;
+	sqe->fd = ctx->opt.fd;
+	sqe->off = slot->offset;
+	sqe->addr = (uint64_t)(uintptr_t)&slot->iov[slot->iov_pos];
+	sqe->len = (uint32_t)(slot->iov_cnt - slot->iov_pos);
+	sqe->user_data = (uint64_t)(slot - ctx->slots);
+	ctx->sq_array[index] = index;
+
+	/* kernel sees the entry once tail is moved */
+	atomic_store_explicit(ctx->sq_tail, tail + 1, memory_order_release);
+	ctx->to_submit++;
+	ctx->inflight++;
+	slot->inflight = 1;
+}
+
+/**
+* claim a run and queue it as one write
+* @return	0 on success, -1 if nothing can be claimed
+*/
+static int _ring_buffer_uring_claim(ring_buffer_t* rb, ring_buffer_uring_ctx_t* ctx, ring_buffer_uring_slot_t* slot)
+{
+	if (ring_buffer_consume_run_ex(rb, &slot->span, ctx->opt.max_bytes, RING_BUFFER_URING_BATCH, &slot->count) < 0)
+	{
+		return -1;
+	}
+
+	/* data is written from where it is, only records are built here */
+	size_t i = 0;
+	uint64_t bytes = 0;
+	ring_buffer_token_t* token;
+	for (token = ring_buffer_span_next(&slot->span, NULL); token != NULL; token = ring_buffer_span_next(&slot->span, token), i++)
+	{
+		ring_buffer_node_t* node = CONTAINER_FOR(token, ring_buffer_node_t, token);
+		size_t len;
+		uint8_t* data = _ring_buffer_node_payload(node, &len);
+		slot->records[i].seq = token->seq;
+		slot->records[i].len = len;
+		slot->records[i].flags = node->flags & RING_BUFFER_SNAPSHOT_FLAGS;
+		slot->iov[i * 2].iov_base = &slot->records[i];
+		slot->iov[i * 2].iov_len = sizeof(slot->records[i]);
+		slot->iov[i * 2 + 1].iov_base = data;
+		slot->iov[i * 2 + 1].iov_len = len;
+		bytes += sizeof(slot->records[i]) + len;
+	}
+
+	slot->active = 1;
+	slot->written = 0;
+	slot->failed = 0;
+	slot->start = ctx->offset;
+	slot->offset = ctx->offset;
+	slot->iov_pos = 0;
+	slot->iov_cnt = (int)i * 2;
+	ctx->offset += bytes;
+	ctx->order[(ctx->order_head + ctx->order_count++) % RING_BUFFER_URING_DEPTH_MAX] = (unsigned)(slot - ctx->slots);
+	_ring_buffer_uring_queue(ctx, slot);
+	return 0;
+}
+
+/**
+* handle completed writes. a run is removed from ring buffer only when its write and writes of every run
+* claimed before it are done, so the file never has a hole before a removed element
+* @return	number of elements written
+*/
+static size_t _ring_buffer_uring_reap(ring_buffer_t* rb, ring_buffer_uring_ctx_t* ctx)
+{
+	uint32_t head = atomic_load_explicit(ctx->cq_head, memory_order_relaxed);
+	const uint32_t tail = atomic_load_explicit(ctx->cq_tail, memory_order_acquire);
+	for (; head != tail; head++)
+	{
+		const ring_buffer_uring_cqe_t* cqe = &ctx->cqes[head & ctx->cq_mask];
+		ring_buffer_uring_slot_t* slot = &ctx->slots[cqe->user_data];
+		ctx->inflight--;
+		slot->inflight = 0;
+
+		if (cqe->res <= 0)
+		{
+			ctx->write_error = cqe->res < 0 ? -cqe->res : EIO;
+			if (!slot->failed)
+			{
+				slot->failed = 1;
+				ctx->failed++;
+			}
+			continue;
+		}
+
+		/* skip what is written, the rest is written again */
+		size_t written = (size_t)cqe->res;
+		slot->offset += written;
+		for (; slot->iov_pos < slot->iov_cnt && written >= slot->iov[slot->iov_pos].iov_len; slot->iov_pos++)
+		{
+			written -= slot->iov[slot->iov_pos].iov_len;
+		}
+		if (slot->iov_pos < slot->iov_cnt)
+		{
+			slot->iov[slot->iov_pos].iov_base = (uint8_t*)slot->iov[slot->iov_pos].iov_base + written;
+			slot->iov[slot->iov_pos].iov_len -= written;
+			_ring_buffer_uring_queue(ctx, slot);
+			continue;
+		}
+
+		slot->written = 1;
+		if (slot->failed)
+		{
+			slot->failed = 0;
+			ctx->failed--;
+		}
+	}
+	atomic_store_explicit(ctx->cq_head, head, memory_order_release);
+
+	size_t done = 0;
+	while (ctx->order_count != 0)
+	{
+		ring_buffer_uring_slot_t* slot = &ctx->slots[ctx->order[ctx->order_head]];
+		if (!slot->written)
+		{
+			break;
+		}
+		ring_buffer_commit_run(rb, &slot->span, 0);
+		slot->active = 0;
+		ctx->order_head = (ctx->order_head + 1) % RING_BUFFER_URING_DEPTH_MAX;
+		ctx->order_count--;
+		done += slot->count;
+	}
+	return done;
+}
+
+/**
+* write failed runs again at their own offsets, runs claimed after them are kept until then
+*/
+static void _ring_buffer_uring_rewrite(ring_buffer_uring_ctx_t* ctx)
+{
+	size_t i;
+	for (i = 0; i < ctx->opt.depth && ctx->failed != 0; i++)
+	{
+		ring_buffer_uring_slot_t* slot = &ctx->slots[i];
+		if (slot->active && slot->failed && !slot->inflight)
+		{
+			_ring_buffer_uring_queue(ctx, slot);
+		}
+	}
+}
+
+/**
+* give back runs not removed, newest first so each one has no reading element after it.
+* file is cut back to where the oldest of them starts, so it ends with the last removed element.
+*/
+static void _ring_buffer_uring_give_back(ring_buffer_t* rb, ring_buffer_uring_ctx_t* ctx)
+{
+	if (ctx->order_count == 0)
+	{
+		return;
+	}
+
+	const uint64_t start = ctx->slots[ctx->order[ctx->order_head]].start;
+	while (ctx->order_count != 0)
+	{
+		ring_buffer_uring_slot_t* slot = &ctx->slots[ctx->order[(ctx->order_head + ctx->order_count - 1) % RING_BUFFER_URING_DEPTH_MAX]];
+		if (_ring_buffer_commit_run(rb, &slot->span, ring_buffer_flag_discard | ring_buffer_flag_consume_on_error) == 0)
+		{
+			/* another consumer reads newer elements, these are removed without being written */
+			rb->counter.lost += slot->count;
+		}
+		slot->active = 0;
+		ctx->order_count--;
+	}
+
+	if (ftruncate(ctx->opt.fd, (off_t)start) < 0)
+	{
+		/* not a regular file, what is written stays */
+	}
+}
+
+/**
+* submit queued writes
+* @param wait	whether to wait for a completion
+* @return		0 on success, otherwise failed
+*/
+static int _ring_buffer_uring_enter(ring_buffer_uring_ctx_t* ctx, int wait)
+{
+	for (;;)
+	{
+		const unsigned min_complete = wait && ctx->inflight != 0 ? 1 : 0;
+		if (ctx->to_submit == 0 && min_complete == 0)
+		{
+			return 0;
+		}
+
+		const long ret = syscall(__NR_io_uring_enter, ctx->ring_fd, ctx->to_submit, min_complete,
+			min_complete != 0 ? RING_BUFFER_URING_ENTER_GETEVENTS : 0, NULL, 0);
+		if (ret < 0)
+		{
+			if (errno == EINTR)
+			{
+				continue;
+			}
+			return -1;
+		}
+		ctx->to_submit -= (unsigned)ret;
+		if (ctx->to_submit == 0)
+		{
+			return 0;
+		}
+	}
+}
+
+int ring_buffer_uring_start(ring_buffer_t* rb, const ring_buffer_uring_opt_t* opt)
+{
+	if (rb->uring.ctx != NULL || opt->fd < 0 || opt->depth == 0 || opt->depth > RING_BUFFER_URING_DEPTH_MAX
+		|| opt->max_bytes == 0 || opt->lock == NULL || opt->unlock == NULL)
+	{
+		return -1;
+	}
+
+	const size_t size = sizeof(ring_buffer_uring_ctx_t) + opt->depth * sizeof(ring_buffer_uring_slot_t);
+	ring_buffer_uring_ctx_t* ctx = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (ctx == MAP_FAILED)
+	{
+		return -1;
+	}
+
+	/* mapped memory is zeroed */
+	ctx->opt = *opt;
+	ctx->size = size;
+	ctx->ring_fd = -1;
+	ctx->offset = opt->offset;
+
+	if (_ring_buffer_uring_setup(ctx, opt->depth) < 0)
+	{
+		const int err = errno;
+		_ring_buffer_uring_free(ctx);
+		errno = err;
+		return -1;
+	}
+
+	rb->uring.ctx = ctx;
+	return 0;
+}
+
+int ring_buffer_uring_drain(ring_buffer_t* rb, int wait)
+{
+	ring_buffer_uring_ctx_t* ctx = rb->uring.ctx;
+	if (ctx == NULL)
+	{
+		return -1;
+	}
+
+	ctx->opt.lock(ctx->opt.arg);
+	const size_t done = ctx->unreported + _ring_buffer_uring_reap(rb, ctx);
+	_ring_buffer_uring_rewrite(ctx);
+	size_t i;
+	for (i = 0; i < ctx->opt.depth && ctx->error == 0 && ctx->failed == 0; i++)
+	{
+		if (!ctx->slots[i].active && _ring_buffer_uring_claim(rb, ctx, &ctx->slots[i]) < 0)
+		{
+			break;
+		}
+	}
+	ctx->opt.unlock(ctx->opt.arg);
+
+	/* waiting is done without lock */
+	if (_ring_buffer_uring_enter(ctx, wait) < 0 && ctx->error == 0)
+	{
+		ctx->error = errno;
+	}
+	if (ctx->error != 0 || ctx->failed != 0)
+	{
+		ctx->unreported = done;
+		return -1;
+	}
+	ctx->unreported = 0;
+	return (int)done;
+}
+
+int ring_buffer_uring_stop(ring_buffer_t* rb)
+{
+	ring_buffer_uring_ctx_t* ctx = rb->uring.ctx;
+	if (ctx == NULL)
+	{
+		return -1;
+	}
+
+	/* written runs are removed, failed ones and those claimed after them are given back */
+	for (;;)
+	{
+		ctx->opt.lock(ctx->opt.arg);
+		_ring_buffer_uring_reap(rb, ctx);
+		ctx->opt.unlock(ctx->opt.arg);
+		if (ctx->inflight == 0)
+		{
+			break;
+		}
+		if (_ring_buffer_uring_enter(ctx, 1) < 0)
+		{
+			/* entries cannot complete, keep them claimed rather than freeing memory the kernel may still read */
+			ctx->error = errno;
+			rb->uring.ctx = NULL;
+			return ctx->error;
+		}
+	}
+
+	const int error = ctx->error != 0 ? ctx->error : ctx->failed != 0 ? ctx->write_error : 0;
+	ctx->opt.lock(ctx->opt.arg);
+	_ring_buffer_uring_give_back(rb, ctx);
+	ctx->opt.unlock(ctx->opt.arg);
+	_ring_buffer_uring_free(ctx);
+	rb->uring.ctx = NULL;
+	return error;
+}
+
+#else
+
+int ring_buffer_uring_start(ring_buffer_t* rb, const ring_buffer_uring_opt_t* opt)
+{
+	(void)rb;
+	(void)opt;
+	errno = ENOSYS;
+	return -1;
+}
+
+int ring_buffer_uring_drain(ring_buffer_t* rb, int wait)
+{
+	(void)rb;
+	(void)wait;
+	return -1;
+}
+
+int ring_buffer_uring_stop(ring_buffer_t* rb)
+{
+	(void)rb;
+	return -1;
+}
+
+#endif
@@ -0,0 +1,37 @@
+#ifndef __TEST_H__
+#define __TEST_H__
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+/** exit code of a test which cannot run here, see `SKIP_RETURN_CODE` */
+#define TEST_SKIP	77
+
+/**
+* abort the test if condition is false. it is not `assert`, so it works in release builds too.
+*/
+#define TEST_CHECK(cond)	\
+	do\
+	{\
+		if (!(cond))\
+		{\
+			fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond);\
+			exit(EXIT_FAILURE);\
+		}\
+	} while (0)
+
+/**
+* open a temporary file which is removed once closed
+* @return	file descriptor
+*/
+inline static int test_tmpfile(void)
+{
+	char path[] = "/tmp/ringbuffer_testXXXXXX";
+	const int fd = mkstemp(path);
+	TEST_CHECK(fd >= 0);
+	unlink(path);
+	return fd;
+}
+
+#endif
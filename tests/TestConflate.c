@@ -0,0 +1,65 @@
+#include "RingBuffer.h"
+#include "Test.h"
+#include <string.h>
+
+#define TEST_KEYS	10
+
+/**
+* consumers see at most one pending element per key, holding the latest value
+*/
+int main(void)
+{
+	static uint8_t mem[1 << 16];
+	ring_buffer_t* rb = ring_buffer_init(mem, sizeof(mem));
+	TEST_CHECK(rb != NULL);
+	TEST_CHECK(ring_buffer_set_conflate(rb, 128) == 0);
+
+	/* values of different length are replaced in place or moved */
+	ring_buffer_token_t* token;
+	for (uint64_t i = 0; i < 1000; i++)
+	{
+		ring_buffer_reserve_opt_t opt = { 0 };
+		opt.key = i % TEST_KEYS;
+		token = ring_buffer_reserve_ex(rb, 8 + (i % 2) * 16, ring_buffer_flag_conflate, &opt);
+		TEST_CHECK(token != NULL && token->seq == i);
+		memcpy(token->data, &i, sizeof(i));
+		ring_buffer_commit(rb, token, 0);
+	}
+
+	/* each key once, in order of the latest commit, with the sequence number of the new value */
+	uint64_t expect = 1000 - TEST_KEYS;
+	while ((token = ring_buffer_consume(rb, NULL)) != NULL)
+	{
+		uint64_t value;
+		memcpy(&value, token->data, sizeof(value));
+		TEST_CHECK(value == expect && token->seq == expect);
+		expect++;
+		ring_buffer_commit(rb, token, 0);
+	}
+	TEST_CHECK(expect == 1000);
+
+	ring_buffer_stat_t stat;
+	ring_buffer_stat(rb, &stat);
+	TEST_CHECK(stat.used == 0 && stat.conflated == 1000 - TEST_KEYS);
+
+	/* an element being consumed is not replaced */
+	ring_buffer_reserve_opt_t opt = { 0 };
+	opt.key = 1;
+	token = ring_buffer_reserve_ex(rb, 8, ring_buffer_flag_conflate, &opt);
+	ring_buffer_commit(rb, token, 0);
+	ring_buffer_token_t* reading = ring_buffer_consume(rb, NULL);
+	token = ring_buffer_reserve_ex(rb, 8, ring_buffer_flag_conflate, &opt);
+	ring_buffer_commit(rb, token, 0);
+	ring_buffer_commit(rb, reading, 0);
+	token = ring_buffer_consume(rb, NULL);
+	TEST_CHECK(token != NULL && token->seq == 1001);
+	ring_buffer_commit(rb, token, 0);
+
+	/* only an empty ring buffer can change key index */
+	token = ring_buffer_reserve(rb, 8, 0);
+	TEST_CHECK(ring_buffer_set_conflate(rb, 64) != 0);
+	ring_buffer_commit(rb, token, ring_buffer_flag_discard);
+	TEST_CHECK(ring_buffer_set_conflate(rb, 0) == 0);
+
+	return 0;
+}
@@ -0,0 +1,45 @@
+#include "RingBufferInternal.h"
+#include "Test.h"
+#include <string.h>
+
+/**
+* tuned copy handles any length and alignment, push and pop copy whole elements
+*/
+int main(void)
+{
+	static uint8_t mem[8 << 20];
+	static uint8_t src[(3 << 20) + 64];
+	static uint8_t dst[(3 << 20) + 64];
+	ring_buffer_t* rb = ring_buffer_init(mem, sizeof(mem));
+	TEST_CHECK(rb != NULL);
+	for (size_t i = 0; i < sizeof(src); i++)
+	{
+		src[i] = (uint8_t)(i * 7 + 3);
+	}
+
+	static const size_t lens[] = { 0, 1, 2, 3, 4, 5, 7, 8, 9, 15, 16, 17, 31, 32, 33, 63, 64, 65, 100, 1000, 4096,
+		RING_BUFFER_COPY_NT_THRESHOLD - 1, RING_BUFFER_COPY_NT_THRESHOLD, RING_BUFFER_COPY_NT_THRESHOLD + 5, (3 << 20) - 13 };
+	for (size_t off = 0; off < 3; off++)
+	{
+		for (size_t i = 0; i < sizeof(lens) / sizeof(lens[0]); i++)
+		{
+			const size_t len = lens[i];
+			memset(dst, 0, len + off + 16);
+			_ring_buffer_copy(dst + off, src + off, len);
+			TEST_CHECK(memcmp(src + off, dst + off, len) == 0 && dst[off + len] == 0);
+
+			/* too small buffer leaves element in ring buffer */
+			size_t got;
+			TEST_CHECK(ring_buffer_push(rb, src + off, len, 0) == 0);
+			TEST_CHECK(ring_buffer_pop(rb, dst, 1, &got) == (len <= 1 ? 0 : -1) && got == len);
+			if (len > 1)
+			{
+				TEST_CHECK(ring_buffer_pop(rb, dst + off, len, &got) == 0 && got == len);
+				TEST_CHECK(memcmp(src + off, dst + off, len) == 0);
+			}
+		}
+	}
+	TEST_CHECK(ring_buffer_pop(rb, dst, 10, NULL) != 0);
+
+	return 0;
+}
@@ -0,0 +1,80 @@
+#include "RingBufferInternal.h"
+#include "Test.h"
+#include <string.h>
+
+/**
+* crc32c matches the reference, and corrupted elements are dropped by consumers
+*/
+int main(void)
+{
+	static uint8_t mem[4 << 20];
+	static uint8_t src[1 << 21];
+	static uint8_t dst[1 << 21];
+	for (size_t i = 0; i < sizeof(src); i++)
+	{
+		src[i] = (uint8_t)(i * 2654435761u >> 13);
+	}
+
+	TEST_CHECK(_ring_buffer_crc32c("123456789", 9) == 0xE3069283);
+	for (size_t len = 0; len < 3000; len += 7)
+	{
+		TEST_CHECK(_ring_buffer_copy_crc32c(dst + 1, src + 3, len) == _ring_buffer_crc32c(src + 3, len));
+		TEST_CHECK(memcmp(dst + 1, src + 3, len) == 0);
+	}
+	TEST_CHECK(_ring_buffer_copy_crc32c(dst + 3, src + 1, 600000) == _ring_buffer_crc32c(src + 1, 600000));
+	TEST_CHECK(memcmp(dst + 3, src + 1, 600000) == 0);
+
+	ring_buffer_t* rb = ring_buffer_init(mem, sizeof(mem));
+	TEST_CHECK(rb != NULL);
+	ring_buffer_set_checksum(rb, 1);
+	for (int i = 0; i < 10; i++)
+	{
+		TEST_CHECK(ring_buffer_push(rb, src + i, 100 + i, 0) == 0);
+	}
+	ring_buffer_token_t* token = ring_buffer_reserve(rb, 50, 0);
+	memcpy(token->data, src, 50);
+	ring_buffer_commit(rb, token, 0);
+	TEST_CHECK(ring_buffer_push(rb, src, 700000, 0) == 0);
+
+	/* corrupt element 1 and 3 */
+	ring_buffer_get(rb, 1)->data[5] ^= 1;
+	token = ring_buffer_get(rb, 3);
+	token->data[0] ^= 1;
+	TEST_CHECK(ring_buffer_verify(rb, token) != 0);
+	TEST_CHECK(ring_buffer_verify(rb, ring_buffer_get(rb, 2)) == 0);
+
+	size_t len;
+	TEST_CHECK(ring_buffer_pop(rb, dst, sizeof(dst), &len) == 0 && len == 100 && memcmp(dst, src, 100) == 0);
+	TEST_CHECK(ring_buffer_pop(rb, dst, sizeof(dst), &len) == 0 && len == 102);
+	token = ring_buffer_consume(rb, NULL);
+	TEST_CHECK(token != NULL && token->len == 104 && ring_buffer_verify(rb, token) == 0);
+	ring_buffer_commit(rb, token, 0);
+	ring_buffer_stat_t stat;
+	ring_buffer_stat(rb, &stat);
+	TEST_CHECK(stat.corrupted == 2);
+
+	for (int i = 5; i < 10; i++)
+	{
+		TEST_CHECK(ring_buffer_pop(rb, dst, sizeof(dst), &len) == 0 && len == 100 + (size_t)i && memcmp(dst, src + i, len) == 0);
+	}
+	TEST_CHECK(ring_buffer_pop(rb, dst, sizeof(dst), &len) == 0 && len == 50 && memcmp(dst, src, 50) == 0);
+	TEST_CHECK(ring_buffer_pop(rb, dst, sizeof(dst), &len) == 0 && len == 700000 && memcmp(dst, src, len) == 0);
+	TEST_CHECK(ring_buffer_pop(rb, dst, sizeof(dst), &len) != 0);
+
+	/* value copied in place by conflation keeps a valid crc */
+	TEST_CHECK(ring_buffer_set_conflate(rb, 16) == 0);
+	ring_buffer_reserve_opt_t opt = { 0 };
+	opt.key = 7;
+	token = ring_buffer_reserve_ex(rb, 10, ring_buffer_flag_conflate, &opt);
+	memcpy(token->data, "aaaaaaaaaa", 10);
+	ring_buffer_commit(rb, token, 0);
+	token = ring_buffer_reserve_ex(rb, 10, ring_buffer_flag_conflate, &opt);
+	memcpy(token->data, "bbbbbbbbbb", 10);
+	ring_buffer_commit(rb, token, 0);
+	TEST_CHECK(ring_buffer_pop(rb, dst, sizeof(dst), &len) == 0 && len == 10 && memcmp(dst, "bbbbbbbbbb", 10) == 0);
+	TEST_CHECK(ring_buffer_pop(rb, dst, sizeof(dst), &len) != 0);
+	ring_buffer_stat(rb, &stat);
+	TEST_CHECK(stat.corrupted == 2);
+
+	return 0;
+}
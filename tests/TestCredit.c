@@ -0,0 +1,118 @@
+#include "RingBuffer.h"
+#include "Test.h"
+#include <pthread.h>
+
+#define TEST_PRODUCERS	4
+#define TEST_COUNT		20000
+
+static uint8_t s_mem[1 << 16];
+static ring_buffer_t* s_rb;
+static pthread_mutex_t s_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static uint64_t _test_clock(void* arg)
+{
+	(void)arg;
+	return 1;
+}
+
+static void* _test_producer(void* arg)
+{
+	const unsigned id = (unsigned)(size_t)arg;
+	for (int i = 0; i < TEST_COUNT; i++)
+	{
+		const size_t len = 8 + i % 40;
+		TEST_CHECK(ring_buffer_credit_acquire(s_rb, id, len, 0) == 0);
+
+		ring_buffer_reserve_opt_t opt = { id };
+		pthread_mutex_lock(&s_lock);
+		ring_buffer_token_t* token = ring_buffer_reserve_ex(s_rb, len, ring_buffer_flag_credit, &opt);
+		TEST_CHECK(token != NULL);
+		ring_buffer_commit(s_rb, token, 0);
+		pthread_mutex_unlock(&s_lock);
+	}
+	return NULL;
+}
+
+/**
+* producers with credits never fill ring buffer, and credits come back once elements are consumed
+*/
+int main(void)
+{
+	s_rb = ring_buffer_init(s_mem, sizeof(s_mem));
+	TEST_CHECK(s_rb != NULL);
+
+	/* credits run out, and are given back by consume or discard */
+	const size_t cost = ring_buffer_node_cost(8);
+	ring_buffer_reserve_opt_t opt = { 0 };
+	TEST_CHECK(ring_buffer_credit_set(s_rb, 0, 3 * cost) == 0);
+	TEST_CHECK(ring_buffer_credit_acquire(s_rb, 0, 4 * cost, ring_buffer_flag_nonblock) != 0);
+	ring_buffer_token_t* token;
+	for (int i = 0; i < 3; i++)
+	{
+		TEST_CHECK(ring_buffer_credit_acquire(s_rb, 0, 8, ring_buffer_flag_nonblock) == 0);
+		token = ring_buffer_reserve_ex(s_rb, 8, ring_buffer_flag_credit, &opt);
+		TEST_CHECK(token != NULL);
+		ring_buffer_commit(s_rb, token, i == 2 ? ring_buffer_flag_discard : 0);
+	}
+	TEST_CHECK(ring_buffer_credit_acquire(s_rb, 0, 8, ring_buffer_flag_nonblock) == 0);
+	TEST_CHECK(ring_buffer_credit_acquire(s_rb, 0, 8, ring_buffer_flag_nonblock) != 0);
+	ring_buffer_credit_release(s_rb, 0, 8);
+	token = ring_buffer_consume(s_rb, NULL);
+	ring_buffer_commit(s_rb, token, 0);
+	token = ring_buffer_consume(s_rb, NULL);
+	ring_buffer_commit(s_rb, token, 0);
+	for (int i = 0; i < 3; i++)
+	{
+		TEST_CHECK(ring_buffer_credit_acquire(s_rb, 0, 8, ring_buffer_flag_nonblock) == 0);
+	}
+	TEST_CHECK(ring_buffer_credit_acquire(s_rb, 0, 8, ring_buffer_flag_nonblock) != 0);
+
+	/* elements reserved without `ring_buffer_flag_credit` take no credits, even with options */
+	ring_buffer_set_clock(s_rb, _test_clock, NULL);
+	opt.expire = 100;
+	token = ring_buffer_reserve(s_rb, 8, 0);
+	ring_buffer_commit(s_rb, token, 0);
+	token = ring_buffer_reserve_ex(s_rb, 8, 0, &opt);
+	ring_buffer_commit(s_rb, token, 0);
+	token = ring_buffer_reserve_delayed(s_rb, 8, 1, 0);
+	ring_buffer_commit(s_rb, token, 0);
+	for (int i = 0; i < 3; i++)
+	{
+		token = ring_buffer_consume(s_rb, NULL);
+		TEST_CHECK(token != NULL);
+		ring_buffer_commit(s_rb, token, 0);
+	}
+	TEST_CHECK(ring_buffer_credit_acquire(s_rb, 0, 8, ring_buffer_flag_nonblock) != 0);
+
+	/* blocked producers are woken up by consumer */
+	s_rb = ring_buffer_init(s_mem, sizeof(s_mem));
+	for (unsigned i = 0; i < TEST_PRODUCERS; i++)
+	{
+		TEST_CHECK(ring_buffer_credit_set(s_rb, i, 12000) == 0);
+	}
+	pthread_t threads[TEST_PRODUCERS];
+	for (size_t i = 0; i < TEST_PRODUCERS; i++)
+	{
+		TEST_CHECK(pthread_create(&threads[i], NULL, _test_producer, (void*)i) == 0);
+	}
+	long consumed = 0;
+	while (consumed < (long)TEST_PRODUCERS * TEST_COUNT)
+	{
+		size_t lost;
+		pthread_mutex_lock(&s_lock);
+		token = ring_buffer_consume(s_rb, &lost);
+		TEST_CHECK(lost == 0);
+		if (token != NULL)
+		{
+			ring_buffer_commit(s_rb, token, 0);
+			consumed++;
+		}
+		pthread_mutex_unlock(&s_lock);
+	}
+	for (int i = 0; i < TEST_PRODUCERS; i++)
+	{
+		pthread_join(threads[i], NULL);
+	}
+
+	return 0;
+}
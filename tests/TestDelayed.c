@@ -0,0 +1,91 @@
+#include "RingBuffer.h"
+#include "Test.h"
+#include <string.h>
+
+static uint64_t s_now = 1000;
+
+static uint64_t _test_clock(void* arg)
+{
+	(void)arg;
+	return s_now;
+}
+
+/**
+* delayed elements are consumed only once they are due, after elements already committed
+*/
+int main(void)
+{
+	static uint8_t mem[1 << 20];
+	ring_buffer_t* rb = ring_buffer_init(mem, sizeof(mem));
+	TEST_CHECK(rb != NULL);
+
+	/* a clock is required */
+	TEST_CHECK(ring_buffer_reserve_delayed(rb, 8, 10, 0) == NULL);
+	ring_buffer_set_clock(rb, _test_clock, NULL);
+
+	ring_buffer_token_t* token = ring_buffer_reserve_delayed(rb, 8, s_now + 10, 0);
+	TEST_CHECK(token != NULL);
+	ring_buffer_commit(rb, token, 0);
+	token = ring_buffer_reserve(rb, 8, 0);
+	ring_buffer_commit(rb, token, 0);
+	token = ring_buffer_consume(rb, NULL);
+	TEST_CHECK(token != NULL && token->seq == 1);
+	ring_buffer_commit(rb, token, 0);
+	TEST_CHECK(ring_buffer_consume(rb, NULL) == NULL);
+	s_now += 10;
+	token = ring_buffer_consume(rb, NULL);
+	TEST_CHECK(token != NULL && token->seq == 2);
+	ring_buffer_commit(rb, token, 0);
+
+	/* short, long and very long delays mixed with plain elements */
+	const int count = 5000;
+	uint64_t seed = 3;
+	for (int i = 0; i < count; i++)
+	{
+		seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+		const uint64_t r = seed >> 33;
+		const uint64_t delay = i % 3 == 0 ? r % 100 : i % 3 == 1 ? r % 100000 : (r % 4) * (1ULL << 24) + r % 1000;
+		const uint64_t due = s_now + delay;
+		token = ring_buffer_reserve_delayed(rb, sizeof(due), due, 0);
+		TEST_CHECK(token != NULL);
+		memcpy(token->data, &due, sizeof(due));
+		ring_buffer_commit(rb, token, 0);
+
+		if (i % 7 == 0)
+		{
+			const uint64_t zero = 0;
+			token = ring_buffer_reserve(rb, sizeof(zero), 0);
+			memcpy(token->data, &zero, sizeof(zero));
+			ring_buffer_commit(rb, token, 0);
+		}
+		s_now += r % 50;
+	}
+
+	int due_count = 0;
+	int plain = 0;
+	uint64_t last = 0;
+	while (due_count < count)
+	{
+		while ((token = ring_buffer_consume(rb, NULL)) != NULL)
+		{
+			uint64_t due;
+			memcpy(&due, token->data, sizeof(due));
+			if (due == 0)
+			{
+				plain++;
+			}
+			else
+			{
+				TEST_CHECK(due <= s_now);
+				due_count++;
+			}
+			TEST_CHECK(token->seq > last);
+			last = token->seq;
+			ring_buffer_commit(rb, token, 0);
+		}
+		s_now += 1 + (s_now * 2654435761u) % 200000;
+	}
+	TEST_CHECK(plain == (count + 6) / 7);
+
+	return 0;
+}
@@ -0,0 +1,107 @@
+#include "RingBuffer.h"
+#include "Test.h"
+#include <string.h>
+
+static uint64_t s_now;
+
+static uint64_t _test_clock(void* arg)
+{
+	(void)arg;
+	return s_now;
+}
+
+/**
+* expired elements are dropped when consumers reach them, and before an overwrite takes live elements
+*/
+int main(void)
+{
+	static uint8_t mem[1 << 14];
+	ring_buffer_t* rb = ring_buffer_init(mem, sizeof(mem));
+	TEST_CHECK(rb != NULL);
+	ring_buffer_set_clock(rb, _test_clock, NULL);
+
+	ring_buffer_token_t* token;
+	for (int i = 0; i < 100; i++)
+	{
+		ring_buffer_reserve_opt_t opt = { 0 };
+		opt.expire = i < 50 ? 10 : 1000;
+		token = ring_buffer_reserve_ex(rb, 8, 0, &opt);
+		TEST_CHECK(token != NULL);
+		ring_buffer_commit(rb, token, 0);
+	}
+
+	/* not counted as lost */
+	s_now = 20;
+	size_t lost;
+	token = ring_buffer_consume(rb, &lost);
+	TEST_CHECK(token != NULL && token->seq == 50 && lost == 0);
+	ring_buffer_commit(rb, token, 0);
+	ring_buffer_stat_t stat;
+	ring_buffer_stat(rb, &stat);
+	TEST_CHECK(stat.expired == 50 && stat.count == 49);
+
+	s_now = 1000;
+	TEST_CHECK(ring_buffer_consume(rb, &lost) == NULL && lost == 0);
+	ring_buffer_stat(rb, &stat);
+	TEST_CHECK(stat.expired == 99 && stat.count == 0);
+
+	/* the older half expires soon, the newer half never expires */
+	rb = ring_buffer_init(mem, sizeof(mem));
+	ring_buffer_set_clock(rb, _test_clock, NULL);
+	s_now = 0;
+	size_t count = 0;
+	for (;;)
+	{
+		token = ring_buffer_reserve(rb, 32, 0);
+		if (token == NULL)
+		{
+			break;
+		}
+		ring_buffer_commit(rb, token, 0);
+		count++;
+	}
+	while ((token = ring_buffer_consume(rb, NULL)) != NULL)
+	{
+		ring_buffer_commit(rb, token, 0);
+	}
+	size_t filled = 0;
+	for (size_t i = 0; i < count; i++)
+	{
+		ring_buffer_reserve_opt_t opt = { 0 };
+		opt.expire = i < count / 2 ? 10 : 0;
+		token = ring_buffer_reserve_ex(rb, 32, 0, &opt);
+		if (token == NULL)
+		{
+			break;
+		}
+		token->data[0] = (uint8_t)(i < count / 2);
+		ring_buffer_commit(rb, token, 0);
+		filled++;
+	}
+
+	/* expired elements make room, no live element is overwritten */
+	s_now = 20;
+	for (size_t i = 0; i < count / 4; i++)
+	{
+		token = ring_buffer_reserve(rb, 32, ring_buffer_flag_overwrite);
+		TEST_CHECK(token != NULL);
+		token->data[0] = 2;
+		ring_buffer_commit(rb, token, 0);
+	}
+	ring_buffer_stat(rb, &stat);
+	TEST_CHECK(stat.expired != 0);
+	size_t total_lost = 0;
+	size_t live = 0;
+	while ((token = ring_buffer_consume(rb, &lost)) != NULL)
+	{
+		TEST_CHECK(token->data[0] != 1);
+		live++;
+		total_lost += lost;
+		ring_buffer_commit(rb, token, 0);
+	}
+	TEST_CHECK(total_lost == 0 && live == filled - count / 2 + count / 4);
+	ring_buffer_stat(rb, &stat);
+	TEST_CHECK(stat.expired == count / 2);
+
+	return 0;
+}
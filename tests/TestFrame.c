@@ -0,0 +1,101 @@
+#include "RingBuffer.h"
+#include "Test.h"
+#include <string.h>
+
+static uint64_t s_now;
+
+static uint64_t _test_clock(void* arg)
+{
+	(void)arg;
+	return s_now;
+}
+
+static size_t _test_len(uint64_t i)
+{
+	return i % 1000 == 999 ? 200 + i % 50 : i % 13;
+}
+
+/**
+* small records are packed into frames and walked back in order
+*/
+int main(void)
+{
+	static uint8_t mem[1 << 20];
+	ring_buffer_t* rb = ring_buffer_init(mem, sizeof(mem));
+	TEST_CHECK(rb != NULL);
+	ring_buffer_set_clock(rb, _test_clock, NULL);
+	ring_buffer_set_checksum(rb, 1);
+
+	ring_buffer_frame_t frame;
+	memset(&frame, 0, sizeof(frame));
+	frame.size = 4096;
+	frame.max_age = 100;
+	for (uint64_t i = 0; i < 10000; i++)
+	{
+		uint8_t buf[300];
+		const size_t len = _test_len(i);
+		for (size_t k = 0; k < len; k++)
+		{
+			buf[k] = (uint8_t)(i + k);
+		}
+		s_now++;
+		TEST_CHECK(ring_buffer_frame_append(rb, &frame, buf, len) == 0);
+	}
+
+	/* a large record gets a frame of its own */
+	static uint8_t big[10000];
+	memset(big, 7, sizeof(big));
+	TEST_CHECK(ring_buffer_frame_append(rb, &frame, big, sizeof(big)) == 0);
+	TEST_CHECK(ring_buffer_frame_flush(rb, &frame) == 0 && frame.token == NULL);
+	TEST_CHECK(ring_buffer_frame_flush(rb, &frame) == 0);
+	TEST_CHECK(ring_buffer_push(rb, "plain", 5, 0) == 0);
+
+	ring_buffer_stat_t stat;
+	ring_buffer_stat(rb, &stat);
+	TEST_CHECK(stat.count < 10000 / 10);
+
+	uint64_t i = 0;
+	ring_buffer_token_t* token;
+	while ((token = ring_buffer_consume(rb, NULL)) != NULL)
+	{
+		size_t pos = 0;
+		size_t len;
+		const uint8_t* record;
+		while ((record = ring_buffer_frame_next(token, &pos, &len)) != NULL)
+		{
+			if (i < 10000)
+			{
+				TEST_CHECK(len == _test_len(i));
+				for (size_t k = 0; k < len; k++)
+				{
+					TEST_CHECK(record[k] == (uint8_t)(i + k));
+				}
+			}
+			else if (i == 10000)
+			{
+				TEST_CHECK(len == sizeof(big) && record[sizeof(big) - 1] == 7);
+			}
+			else
+			{
+				TEST_CHECK(len == 5 && memcmp(record, "plain", 5) == 0);
+			}
+			i++;
+		}
+		ring_buffer_commit(rb, token, 0);
+	}
+	TEST_CHECK(i == 10002);
+	ring_buffer_stat(rb, &stat);
+	TEST_CHECK(stat.used == 0 && stat.corrupted == 0);
+
+	/* broken length stops the walk */
+	TEST_CHECK(ring_buffer_frame_append(rb, &frame, "abc", 3) == 0);
+	TEST_CHECK(ring_buffer_frame_flush(rb, &frame) == 0);
+	token = ring_buffer_consume(rb, NULL);
+	token->data[0] = 0x7f;
+	size_t pos = 0;
+	size_t len;
+	TEST_CHECK(ring_buffer_frame_next(token, &pos, &len) == NULL);
+	ring_buffer_commit(rb, token, 0);
+
+	return 0;
+}
@@ -0,0 +1,78 @@
+#include "RingBuffer.h"
+#include "Test.h"
+
+/**
+* iterators walk by sequence number in both directions, filter by state, and resume after ring buffer changed
+*/
+int main(void)
+{
+	static uint8_t mem[1 << 14];
+	ring_buffer_t* rb = ring_buffer_init(mem, sizeof(mem));
+	TEST_CHECK(rb != NULL);
+
+	ring_buffer_token_t* token;
+	for (int i = 0; i < 10; i++)
+	{
+		token = ring_buffer_reserve(rb, 8, 0);
+		ring_buffer_commit(rb, token, 0);
+	}
+	ring_buffer_token_t* reading = ring_buffer_consume(rb, NULL);
+	ring_buffer_token_t* writing = ring_buffer_reserve(rb, 8, 0);
+
+	ring_buffer_iter_t forward;
+	ring_buffer_iter_init(rb, &forward, 3, ring_buffer_state_all, 0);
+	for (uint64_t seq = 3; seq <= 10; seq++)
+	{
+		token = ring_buffer_iter_next(rb, &forward);
+		TEST_CHECK(token != NULL && token->seq == seq);
+	}
+	TEST_CHECK(ring_buffer_iter_next(rb, &forward) == NULL);
+
+	/* resumed iterator only visits new elements */
+	ring_buffer_commit(rb, writing, 0);
+	for (int i = 0; i < 3; i++)
+	{
+		token = ring_buffer_reserve(rb, 8, 0);
+		ring_buffer_commit(rb, token, 0);
+	}
+	for (uint64_t seq = 11; seq <= 13; seq++)
+	{
+		token = ring_buffer_iter_next(rb, &forward);
+		TEST_CHECK(token != NULL && token->seq == seq);
+	}
+	TEST_CHECK(ring_buffer_iter_next(rb, &forward) == NULL);
+
+	/* reverse, committed only */
+	ring_buffer_iter_t reverse;
+	ring_buffer_iter_init(rb, &reverse, 5, ring_buffer_state_committed, ring_buffer_iter_reverse);
+	for (uint64_t seq = 5; seq >= 1; seq--)
+	{
+		token = ring_buffer_iter_next(rb, &reverse);
+		TEST_CHECK(token != NULL && token->seq == seq);
+	}
+	TEST_CHECK(ring_buffer_iter_next(rb, &reverse) == NULL);
+
+	ring_buffer_iter_init(rb, &reverse, 1, ring_buffer_state_all, ring_buffer_iter_reverse);
+	TEST_CHECK(ring_buffer_iter_next(rb, &reverse)->seq == 1);
+	TEST_CHECK(ring_buffer_iter_next(rb, &reverse)->seq == 0);
+	TEST_CHECK(ring_buffer_iter_next(rb, &reverse) == NULL && (reverse.flags & ring_buffer_iter_end));
+
+	ring_buffer_iter_init(rb, &reverse, UINT64_MAX, ring_buffer_state_reading, ring_buffer_iter_reverse);
+	TEST_CHECK(ring_buffer_iter_next(rb, &reverse) == reading);
+	TEST_CHECK(ring_buffer_iter_next(rb, &reverse) == NULL);
+
+	/* elements removed meanwhile are skipped */
+	ring_buffer_commit(rb, reading, 0);
+	ring_buffer_iter_init(rb, &forward, 0, ring_buffer_state_all, 0);
+	token = ring_buffer_iter_next(rb, &forward);
+	TEST_CHECK(token != NULL && token->seq == 1);
+	for (int i = 0; i < 3; i++)
+	{
+		token = ring_buffer_consume(rb, NULL);
+		ring_buffer_commit(rb, token, 0);
+	}
+	token = ring_buffer_iter_next(rb, &forward);
+	TEST_CHECK(token != NULL && token->seq == 4);
+
+	return 0;
+}
@@ -0,0 +1,105 @@
+#include "RingBuffer.h"
+#include "Test.h"
+#include <string.h>
+
+static int s_live;
+
+static void* _test_alloc(size_t len, void* arg)
+{
+	(void)arg;
+	s_live++;
+	return malloc(len != 0 ? len : 1);
+}
+
+static void _test_free(void* ptr, size_t len, void* arg)
+{
+	(void)len;
+	(void)arg;
+	s_live--;
+	free(ptr);
+}
+
+/**
+* large payloads live out of ring buffer behind a descriptor, and are freed however the element is removed
+*/
+int main(void)
+{
+	static uint8_t mem[1 << 16];
+	static uint8_t mem2[1 << 16];
+	static uint8_t big[1 << 20];
+	static uint8_t out[1 << 20];
+	for (size_t i = 0; i < sizeof(big); i++)
+	{
+		big[i] = (uint8_t)(i * 2654435761u >> 11);
+	}
+
+	ring_buffer_t* rb = ring_buffer_init(mem, sizeof(mem));
+	TEST_CHECK(rb != NULL);
+	TEST_CHECK(ring_buffer_push(rb, big, 100000, 0) != 0);
+	TEST_CHECK(ring_buffer_set_large(rb, 4096, _test_alloc, _test_free, NULL) == 0);
+	ring_buffer_set_checksum(rb, 1);
+
+	TEST_CHECK(ring_buffer_push(rb, "a", 1, 0) == 0);
+	TEST_CHECK(ring_buffer_push(rb, big, 100000, 0) == 0);
+	TEST_CHECK(ring_buffer_push(rb, "b", 1, 0) == 0);
+	TEST_CHECK(ring_buffer_push(rb, big + 5, 5000, 0) == 0);
+	TEST_CHECK(s_live == 2);
+	ring_buffer_stat_t stat;
+	ring_buffer_stat(rb, &stat);
+	TEST_CHECK(stat.external == 105000);
+
+	/* tail copy skips large elements, snapshot includes them */
+	uint64_t tail[1024];
+	TEST_CHECK(ring_buffer_snapshot_tail(rb, tail, sizeof(tail), 10) == 2);
+	const int fd = test_tmpfile();
+	TEST_CHECK(ring_buffer_snapshot(rb, fd) == 0);
+	TEST_CHECK(lseek(fd, 0, SEEK_SET) == 0);
+	ring_buffer_t* rb2 = ring_buffer_init(mem2, sizeof(mem2));
+	TEST_CHECK(ring_buffer_set_large(rb2, 4096, NULL, NULL, NULL) == 0);
+	TEST_CHECK(ring_buffer_restore(rb2, fd) == 0);
+	close(fd);
+
+	size_t len;
+	TEST_CHECK(ring_buffer_pop(rb, out, sizeof(out), &len) == 0 && len == 1 && out[0] == 'a');
+	ring_buffer_token_t* token = ring_buffer_consume(rb, NULL);
+	const void* payload = ring_buffer_payload(token, &len);
+	TEST_CHECK(len == 100000 && memcmp(payload, big, len) == 0);
+	size_t pos = 0;
+	payload = ring_buffer_frame_next(token, &pos, &len);
+	TEST_CHECK(len == 100000 && memcmp(payload, big, len) == 0);
+	TEST_CHECK(ring_buffer_verify(rb, token) == 0);
+	ring_buffer_commit(rb, token, 0);
+	TEST_CHECK(s_live == 1);
+	TEST_CHECK(ring_buffer_pop(rb, out, sizeof(out), &len) == 0 && len == 1);
+	TEST_CHECK(ring_buffer_pop(rb, out, 100, &len) != 0 && len == 5000);
+	TEST_CHECK(ring_buffer_pop(rb, out, sizeof(out), &len) == 0 && len == 5000 && memcmp(out, big + 5, len) == 0);
+	TEST_CHECK(s_live == 0);
+
+	/* overwrite and exit free payloads */
+	for (int i = 0; i < 50; i++)
+	{
+		TEST_CHECK(ring_buffer_push(rb, big, 200000, ring_buffer_flag_overwrite) == 0);
+	}
+	ring_buffer_stat(rb, &stat);
+	TEST_CHECK(s_live == (int)stat.count);
+	for (int i = 0; i < 3000; i++)
+	{
+		TEST_CHECK(ring_buffer_push(rb, big, 100, ring_buffer_flag_overwrite) == 0);
+	}
+	TEST_CHECK(s_live == 0);
+	for (int i = 0; i < 5; i++)
+	{
+		TEST_CHECK(ring_buffer_push(rb, big, 200000, ring_buffer_flag_overwrite) == 0);
+	}
+	ring_buffer_exit(rb);
+	TEST_CHECK(s_live == 0);
+
+	for (int i = 0; i < 4; i++)
+	{
+		TEST_CHECK(ring_buffer_pop(rb2, out, sizeof(out), &len) == 0);
+	}
+	TEST_CHECK(len == 5000 && memcmp(out, big + 5, len) == 0);
+	ring_buffer_exit(rb2);
+
+	return 0;
+}
@@ -0,0 +1,53 @@
+#include "RingBuffer.h"
+#include "Test.h"
+
+/**
+* consume newest first, mixed with oldest first consume, and drop older elements at once
+*/
+int main(void)
+{
+	static uint8_t mem[1 << 16];
+	ring_buffer_t* rb = ring_buffer_init(mem, sizeof(mem));
+	TEST_CHECK(rb != NULL);
+
+	ring_buffer_token_t* token;
+	for (int i = 0; i < 10; i++)
+	{
+		token = ring_buffer_reserve(rb, 8, 0);
+		ring_buffer_commit(rb, token, 0);
+	}
+
+	size_t dropped;
+	ring_buffer_token_t* a = ring_buffer_consume_latest(rb, 0, &dropped);
+	TEST_CHECK(a != NULL && a->seq == 9 && dropped == 0);
+	ring_buffer_token_t* b = ring_buffer_consume_latest(rb, 0, &dropped);
+	TEST_CHECK(b != NULL && b->seq == 8);
+	ring_buffer_commit(rb, a, 0);
+	ring_buffer_commit(rb, b, 0);
+	token = ring_buffer_consume(rb, NULL);
+	TEST_CHECK(token != NULL && token->seq == 0);
+	ring_buffer_commit(rb, token, 0);
+
+	/* elements being written are skipped, older committed ones are dropped */
+	ring_buffer_token_t* writing = ring_buffer_reserve(rb, 8, 0);
+	token = ring_buffer_consume_latest(rb, ring_buffer_flag_drop_older, &dropped);
+	TEST_CHECK(token != NULL && token->seq == 7 && dropped == 6);
+	TEST_CHECK(ring_buffer_consume(rb, NULL) == NULL);
+	ring_buffer_commit(rb, token, 0);
+	ring_buffer_commit(rb, writing, 0);
+
+	/* discarded token goes back */
+	token = ring_buffer_consume_latest(rb, 0, &dropped);
+	TEST_CHECK(token != NULL && token->seq == 10);
+	TEST_CHECK(ring_buffer_commit(rb, token, ring_buffer_flag_discard) == 0);
+	token = ring_buffer_consume(rb, NULL);
+	TEST_CHECK(token != NULL && token->seq == 10);
+	ring_buffer_commit(rb, token, 0);
+	TEST_CHECK(ring_buffer_consume_latest(rb, 0, &dropped) == NULL);
+
+	ring_buffer_stat_t stat;
+	ring_buffer_stat(rb, &stat);
+	TEST_CHECK(stat.count == 0);
+
+	return 0;
+}
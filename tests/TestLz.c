@@ -0,0 +1,103 @@
+#include "RingBufferInternal.h"
+#include "Test.h"
+#include <string.h>
+
+static uint8_t s_src[1 << 17];
+static uint8_t s_out[1 << 17];
+static uint8_t s_dec[1 << 17];
+
+static uint32_t s_table[1 << RING_BUFFER_LZ_HASH_BITS];
+static uint32_t s_seed = 1;
+
+static uint32_t _test_rand(void)
+{
+	s_seed = s_seed * 1103515245 + 12345;
+	return s_seed >> 8;
+}
+
+/**
+* codec restores random, text and repetitive data, rejects short buffers and survives corrupted input.
+* compressed elements are restored by pop, read and snapshot.
+*/
+int main(void)
+{
+	for (int it = 0; it < 2000; it++)
+	{
+		const size_t len = _test_rand() % (it < 1000 ? 300 : 100000);
+		const int kind = it % 3;
+		for (size_t i = 0; i < len; i++)
+		{
+			s_src[i] = kind == 0 ? (uint8_t)_test_rand() : kind == 1 ? (uint8_t)"abcab cab, {\"k\":1}"[_test_rand() % 18] : (uint8_t)(i / 1000);
+		}
+
+		const size_t size = _ring_buffer_lz_compress(s_out, sizeof(s_out), s_src, len, s_table, it % 2 != 0 ? RING_BUFFER_LZ_HASH_BITS : 4);
+		TEST_CHECK(size != 0 && _ring_buffer_lz_raw_len(s_out, size) == len);
+		TEST_CHECK(_ring_buffer_lz_decompress(s_dec, len, s_out, size) == 0 && memcmp(s_dec, s_src, len) == 0);
+		TEST_CHECK(len == 0 || _ring_buffer_lz_decompress(s_dec, len - 1, s_out, size) != 0);
+
+		for (int k = 0; k < 5; k++)
+		{
+			const size_t pos = _test_rand() % size;
+			const uint8_t bit = (uint8_t)(1 << _test_rand() % 8);
+			s_out[pos] ^= bit;
+			_ring_buffer_lz_decompress(s_dec, len, s_out, size);
+			s_out[pos] ^= bit;
+		}
+	}
+
+	static uint8_t mem[1 << 20];
+	static uint8_t mem2[1 << 20];
+	ring_buffer_t* rb = ring_buffer_init(mem, sizeof(mem));
+	TEST_CHECK(rb != NULL);
+	ring_buffer_set_compress(rb, 1);
+	ring_buffer_set_checksum(rb, 1);
+
+	char json[2000];
+	int n = 0;
+	for (int i = 0; n < 1900; i++)
+	{
+		n += snprintf(json + n, sizeof(json) - n, "{\"id\":%d,\"name\":\"sensor\",\"v\":%d},", i, i % 7);
+	}
+	for (int i = 0; i < 100; i++)
+	{
+		TEST_CHECK(ring_buffer_push(rb, json, 1900, 0) == 0);
+	}
+	for (int i = 0; i < 10; i++)
+	{
+		for (int j = 0; j < 200; j++)
+		{
+			s_src[j] = (uint8_t)_test_rand();
+		}
+		TEST_CHECK(ring_buffer_push(rb, s_src, 200, 0) == 0);
+	}
+	ring_buffer_stat_t stat;
+	ring_buffer_stat(rb, &stat);
+	TEST_CHECK(stat.used < 100 * 1900 / 2);
+
+	const int fd = test_tmpfile();
+	TEST_CHECK(ring_buffer_snapshot(rb, fd) == 0);
+	TEST_CHECK(lseek(fd, 0, SEEK_SET) == 0);
+	ring_buffer_t* rb2 = ring_buffer_init(mem2, sizeof(mem2));
+	TEST_CHECK(ring_buffer_restore(rb2, fd) == 0);
+	close(fd);
+
+	size_t len;
+	ring_buffer_token_t* token = ring_buffer_consume(rb, NULL);
+	TEST_CHECK(ring_buffer_read(rb, token, s_dec, sizeof(s_dec), &len) == 0 && len == 1900 && memcmp(s_dec, json, 1900) == 0);
+	TEST_CHECK(ring_buffer_read(rb, token, s_dec, 100, &len) != 0);
+	ring_buffer_commit(rb, token, 0);
+	for (int i = 1; i < 100; i++)
+	{
+		TEST_CHECK(ring_buffer_pop(rb, s_dec, sizeof(s_dec), &len) == 0 && len == 1900 && memcmp(s_dec, json, 1900) == 0);
+		TEST_CHECK(ring_buffer_pop(rb2, s_dec, sizeof(s_dec), &len) == 0 && len == 1900 && memcmp(s_dec, json, 1900) == 0);
+	}
+	for (int i = 0; i < 10; i++)
+	{
+		TEST_CHECK(ring_buffer_pop(rb, s_dec, sizeof(s_dec), &len) == 0 && len == 200);
+	}
+	TEST_CHECK(ring_buffer_pop(rb, s_dec, sizeof(s_dec), &len) != 0);
+	ring_buffer_stat(rb, &stat);
+	TEST_CHECK(stat.used == 0 && stat.corrupted == 0);
+
+	return 0;
+}
@@ -0,0 +1,75 @@
+#include "RingBuffer.h"
+#include "Test.h"
+#include <string.h>
+
+#define TEST_CHUNKS	5
+
+static uint64_t s_part[TEST_CHUNKS];
+
+static int _test_sum(ring_buffer_token_t* token, int state, unsigned chunk, void* arg)
+{
+	(void)state;
+	(void)arg;
+	uint64_t value;
+	memcpy(&value, token->data, sizeof(value));
+	s_part[chunk] += value;
+	return 0;
+}
+
+static void _test_reduce(unsigned chunk, void* arg)
+{
+	*(uint64_t*)arg += s_part[chunk];
+}
+
+/**
+* chunks cover every element once in time order, and are walked by several threads
+*/
+int main(void)
+{
+	static uint8_t mem[1 << 20];
+	ring_buffer_t* rb = ring_buffer_init(mem, sizeof(mem));
+	TEST_CHECK(rb != NULL);
+
+	ring_buffer_token_t* token;
+	for (uint64_t i = 0; i < 10000; i++)
+	{
+		token = ring_buffer_reserve(rb, sizeof(i), 0);
+		memcpy(token->data, &i, sizeof(i));
+		ring_buffer_commit(rb, token, 0);
+	}
+	for (int i = 0; i < 100; i++)
+	{
+		token = ring_buffer_consume(rb, NULL);
+		ring_buffer_commit(rb, token, 0);
+	}
+	uint64_t expect = 0;
+	for (uint64_t i = 100; i < 10000; i++)
+	{
+		expect += i;
+	}
+
+	ring_buffer_token_t* starts[8];
+	const size_t n = ring_buffer_split(rb, starts, 8);
+	TEST_CHECK(n == 8 && starts[0]->seq == 100);
+	uint64_t sum = 0;
+	size_t count = 0;
+	for (size_t i = 0; i < n; i++)
+	{
+		ring_buffer_token_t* end = i + 1 < n ? starts[i + 1] : NULL;
+		for (token = starts[i]; token != end; token = ring_buffer_next(rb, token))
+		{
+			uint64_t value;
+			memcpy(&value, token->data, sizeof(value));
+			TEST_CHECK(value == 100 + count);
+			sum += value;
+			count++;
+		}
+	}
+	TEST_CHECK(count == 9900 && sum == expect);
+
+	sum = 0;
+	TEST_CHECK(ring_buffer_foreach_parallel(rb, _test_sum, _test_reduce, &sum, TEST_CHUNKS) == 9900);
+	TEST_CHECK(sum == expect);
+
+	return 0;
+}
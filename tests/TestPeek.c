@@ -0,0 +1,57 @@
+#include "RingBuffer.h"
+#include "Test.h"
+#include <string.h>
+
+/**
+* peek gives committed elements in consume order without claiming them, its generation tells when they are reused
+*/
+int main(void)
+{
+	static uint8_t mem[16384];
+	ring_buffer_t* rb = ring_buffer_init(mem, sizeof(mem));
+	TEST_CHECK(rb != NULL);
+
+	const ring_buffer_token_t* tokens[8];
+	uint64_t gen;
+	TEST_CHECK(ring_buffer_peek(rb, tokens, 8, &gen) == 0);
+
+	ring_buffer_token_t* token;
+	for (int i = 0; i < 5; i++)
+	{
+		token = ring_buffer_reserve(rb, 8, 0);
+		memset(token->data, i, 8);
+		ring_buffer_commit(rb, token, 0);
+	}
+	ring_buffer_token_t* writing = ring_buffer_reserve(rb, 8, 0);
+
+	TEST_CHECK(ring_buffer_peek(rb, tokens, 3, &gen) == 3);
+	TEST_CHECK(tokens[0]->seq == 0 && tokens[2]->seq == 2 && tokens[2]->data[0] == 2);
+	TEST_CHECK(ring_buffer_peek(rb, tokens, 8, &gen) == 5);
+
+	/* consumed element is not reused yet */
+	token = ring_buffer_consume(rb, NULL);
+	TEST_CHECK(token->seq == 0);
+	ring_buffer_commit(rb, token, 0);
+	TEST_CHECK(ring_buffer_peek_valid(rb, gen));
+	TEST_CHECK(ring_buffer_peek(rb, tokens, 8, &gen) == 4 && tokens[0]->seq == 1);
+
+	/* stop at elements being written */
+	ring_buffer_commit(rb, writing, 0);
+	TEST_CHECK(ring_buffer_peek(rb, tokens, 8, &gen) == 5);
+	token = ring_buffer_reserve(rb, 8, 0);
+	ring_buffer_commit(rb, token, 0);
+	TEST_CHECK(!ring_buffer_peek_valid(rb, gen));
+
+	/* overwrite invalidates */
+	TEST_CHECK(ring_buffer_peek(rb, tokens, 8, &gen) == 6);
+	int invalid = 0;
+	for (int i = 0; i < 1000 && !invalid; i++)
+	{
+		token = ring_buffer_reserve(rb, 64, ring_buffer_flag_overwrite);
+		ring_buffer_commit(rb, token, 0);
+		invalid = !ring_buffer_peek_valid(rb, gen);
+	}
+	TEST_CHECK(invalid);
+
+	return 0;
+}
@@ -0,0 +1,66 @@
+#include "RingBuffer.h"
+#include "Test.h"
+
+/**
+* a producer over its quota only overwrites its own elements, a producer within its quota is never overwritten
+*/
+int main(void)
+{
+	static uint8_t mem[1 << 14];
+	ring_buffer_t* rb = ring_buffer_init(mem, sizeof(mem));
+	TEST_CHECK(rb != NULL);
+
+	TEST_CHECK(ring_buffer_set_quota(rb, 0, 2048) == 0);
+	TEST_CHECK(ring_buffer_set_quota(rb, 1, 4096) == 0);
+	TEST_CHECK(ring_buffer_set_quota(rb, RING_BUFFER_PRODUCER_MAX, 4096) != 0);
+
+	ring_buffer_reserve_opt_t opt0 = { 0 };
+	ring_buffer_reserve_opt_t opt1 = { 1 };
+	ring_buffer_token_t* token;
+	for (int i = 0; i < 20; i++)
+	{
+		token = ring_buffer_reserve_ex(rb, 16, ring_buffer_flag_overwrite, &opt0);
+		TEST_CHECK(token != NULL);
+		ring_buffer_commit(rb, token, 0);
+	}
+	ring_buffer_producer_stat_t stat0;
+	TEST_CHECK(ring_buffer_producer_stat(rb, 0, &stat0) == 0);
+	const size_t used0 = stat0.used;
+	TEST_CHECK(stat0.quota == 2048 && used0 <= 2048);
+
+	/* producer 1 floods ring buffer */
+	for (int i = 0; i < 20000; i++)
+	{
+		token = ring_buffer_reserve_ex(rb, 40, ring_buffer_flag_overwrite, &opt1);
+		TEST_CHECK(token != NULL);
+		ring_buffer_commit(rb, token, 0);
+	}
+	ring_buffer_producer_stat_t stat1;
+	TEST_CHECK(ring_buffer_producer_stat(rb, 0, &stat0) == 0);
+	TEST_CHECK(ring_buffer_producer_stat(rb, 1, &stat1) == 0);
+	TEST_CHECK(stat0.lost == 0 && stat0.used == used0);
+	TEST_CHECK(stat1.lost != 0 && stat1.used > stat1.quota);
+
+	/* producer 0 takes space of producer 1 up to its quota, then only its own */
+	for (int round = 0; round < 2; round++)
+	{
+		const size_t used1 = stat1.used;
+		const size_t lost1 = stat1.lost;
+		for (int i = 0; i < 1000; i++)
+		{
+			token = ring_buffer_reserve_ex(rb, 16, ring_buffer_flag_overwrite, &opt0);
+			TEST_CHECK(token != NULL);
+			ring_buffer_commit(rb, token, 0);
+		}
+		TEST_CHECK(ring_buffer_producer_stat(rb, 0, &stat0) == 0);
+		TEST_CHECK(ring_buffer_producer_stat(rb, 1, &stat1) == 0);
+		TEST_CHECK(stat0.lost != 0 && stat0.used <= stat0.quota + ring_buffer_node_cost(16));
+		TEST_CHECK(round == 0 || (stat1.lost == lost1 && stat1.used == used1));
+	}
+
+	ring_buffer_stat_t stat;
+	ring_buffer_stat(rb, &stat);
+	TEST_CHECK(stat.used == stat0.used + stat1.used);
+
+	return 0;
+}
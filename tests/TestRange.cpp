@@ -0,0 +1,41 @@
+#include "RingBuffer.hpp"
+#include "Test.h"
+#include <algorithm>
+#include <cstring>
+
+/**
+* chunks of the range adapter work with standard algorithms
+*/
+int main(void)
+{
+	static uint8_t mem[1 << 20];
+	ring_buffer_t* rb = ring_buffer_init(mem, sizeof(mem));
+	TEST_CHECK(rb != NULL);
+
+	for (uint64_t i = 0; i < 10000; i++)
+	{
+		ring_buffer_token_t* token = ring_buffer_reserve(rb, sizeof(i), 0);
+		std::memcpy(token->data, &i, sizeof(i));
+		ring_buffer_commit(rb, token, 0);
+	}
+
+	std::vector<ring_buffer_range::chunk> chunks = ring_buffer_range::split(rb, 8);
+	TEST_CHECK(chunks.size() == 8);
+	uint64_t sum = 0;
+	std::for_each(chunks.begin(), chunks.end(), [&sum](const ring_buffer_range::chunk& c)
+	{
+		for (ring_buffer_token_t& token : c)
+		{
+			uint64_t value;
+			std::memcpy(&value, token.data, sizeof(value));
+			sum += value;
+		}
+	});
+	TEST_CHECK(sum == 9999ULL * 10000 / 2);
+
+	ring_buffer_range::chunk all = ring_buffer_range::all(rb);
+	TEST_CHECK(std::distance(all.begin(), all.end()) == 10000);
+	TEST_CHECK((1 << all.begin().state()) == ring_buffer_state_committed);
+
+	return 0;
+}
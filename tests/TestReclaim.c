@@ -0,0 +1,116 @@
+#include "RingBuffer.h"
+#include "Test.h"
+#include <string.h>
+#include <sys/mman.h>
+
+static uint64_t s_now = 1;
+
+static uint64_t _test_clock(void* arg)
+{
+	(void)arg;
+	return s_now;
+}
+
+/**
+* bytes of `mem` backed by physical pages
+*/
+static size_t _test_resident(void* mem, size_t size)
+{
+	static unsigned char vec[1 << 16];
+	const size_t page = (size_t)getpagesize();
+	TEST_CHECK(size / page <= sizeof(vec) && mincore(mem, size, vec) == 0);
+	size_t n = 0;
+	for (size_t i = 0; i < size / page; i++)
+	{
+		n += vec[i] & 1;
+	}
+	return n * page;
+}
+
+/**
+* pages of free space are given back, and elements are intact after that
+*/
+int main(void)
+{
+	const size_t size = 64 << 20;
+	uint8_t* mem = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	TEST_CHECK(mem != MAP_FAILED);
+	ring_buffer_t* rb = ring_buffer_init(mem, size);
+	TEST_CHECK(rb != NULL);
+
+	static uint8_t buf[4000];
+	memset(buf, 9, sizeof(buf));
+	while (ring_buffer_push(rb, buf, sizeof(buf), 0) == 0)
+	{
+	}
+	const size_t full = _test_resident(mem, size);
+
+	/* keep 100 elements, then add 50 */
+	ring_buffer_stat_t stat;
+	size_t len;
+	for (;;)
+	{
+		ring_buffer_stat(rb, &stat);
+		if (stat.count == 100)
+		{
+			break;
+		}
+		TEST_CHECK(ring_buffer_pop(rb, buf, sizeof(buf), &len) == 0);
+	}
+	for (int i = 0; i < 50; i++)
+	{
+		TEST_CHECK(ring_buffer_push(rb, buf, sizeof(buf), 0) == 0);
+	}
+
+	const size_t released = ring_buffer_reclaim(rb);
+	TEST_CHECK(released > size / 2);
+	TEST_CHECK(_test_resident(mem, size) + released <= full);
+	TEST_CHECK(ring_buffer_reclaim(rb) == 0);
+
+	int n = 0;
+	while (ring_buffer_pop(rb, buf, sizeof(buf), &len) == 0)
+	{
+		TEST_CHECK(len == sizeof(buf) && buf[0] == 9 && buf[sizeof(buf) - 1] == 9);
+		n++;
+	}
+	TEST_CHECK(n == 150);
+
+	/* pages are mapped again on use */
+	for (int i = 0; i < 10000; i++)
+	{
+		TEST_CHECK(ring_buffer_push(rb, buf, sizeof(buf), ring_buffer_flag_overwrite) == 0);
+	}
+	ring_buffer_stat(rb, &stat);
+	TEST_CHECK(stat.reclaimed == released);
+
+	/* interval */
+	ring_buffer_set_clock(rb, _test_clock, NULL);
+	ring_buffer_set_reclaim(rb, 100);
+	while (ring_buffer_pop(rb, buf, sizeof(buf), &len) == 0)
+	{
+	}
+	TEST_CHECK(ring_buffer_reclaim(rb) > 0);
+	s_now += 50;
+	for (int i = 0; i < 100; i++)
+	{
+		TEST_CHECK(ring_buffer_push(rb, buf, sizeof(buf), 0) == 0);
+	}
+	while (ring_buffer_pop(rb, buf, sizeof(buf), &len) == 0)
+	{
+	}
+	TEST_CHECK(ring_buffer_reclaim(rb) == 0);
+	s_now += 60;
+	TEST_CHECK(ring_buffer_reclaim(rb) > 0);
+
+	/* nothing is given back from a shared mapping */
+	uint8_t* shared = mmap(NULL, 1 << 20, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	TEST_CHECK(shared != MAP_FAILED);
+	rb = ring_buffer_init(shared, 1 << 20);
+	TEST_CHECK(ring_buffer_push(rb, buf, sizeof(buf), 0) == 0);
+	TEST_CHECK(ring_buffer_pop(rb, buf, sizeof(buf), &len) == 0);
+	TEST_CHECK(ring_buffer_reclaim(rb) == 0);
+
+	munmap(shared, 1 << 20);
+	munmap(mem, size);
+	return 0;
+}
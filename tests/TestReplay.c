@@ -0,0 +1,56 @@
+#include "RingBuffer.h"
+#include "Test.h"
+
+/**
+* consumers reading by sequence number leave elements resident, and can seek back to replay them
+*/
+int main(void)
+{
+	static uint8_t mem[8192];
+	ring_buffer_t* rb = ring_buffer_init(mem, sizeof(mem));
+	TEST_CHECK(rb != NULL);
+
+	ring_buffer_token_t* token;
+	for (int i = 0; i < 3; i++)
+	{
+		token = ring_buffer_reserve(rb, 8, ring_buffer_flag_overwrite);
+		ring_buffer_commit(rb, token, 0);
+	}
+
+	ring_buffer_consumer_t a = { 0 };
+	ring_buffer_consumer_t b = { 0 };
+	for (uint64_t i = 0; i < 3; i++)
+	{
+		token = ring_buffer_consume_from(rb, &a, NULL);
+		TEST_CHECK(token != NULL && token->seq == i);
+		ring_buffer_commit(rb, token, 0);
+	}
+	TEST_CHECK(ring_buffer_consume_from(rb, &a, NULL) == NULL);
+
+	/* the other consumer still sees everything */
+	token = ring_buffer_consume_from(rb, &b, NULL);
+	TEST_CHECK(token != NULL && token->seq == 0);
+	ring_buffer_commit(rb, token, 0);
+
+	/* replay */
+	TEST_CHECK(ring_buffer_seek(rb, &a, 1) == 0);
+	token = ring_buffer_consume_from(rb, &a, NULL);
+	TEST_CHECK(token != NULL && token->seq == 1);
+	ring_buffer_commit(rb, token, 0);
+	TEST_CHECK(ring_buffer_seek(rb, &a, 100) != 0);
+
+	/* overwritten elements are skipped */
+	for (int i = 0; i < 1000; i++)
+	{
+		token = ring_buffer_reserve(rb, 8, ring_buffer_flag_overwrite);
+		TEST_CHECK(token != NULL);
+		ring_buffer_commit(rb, token, 0);
+	}
+	size_t lost;
+	token = ring_buffer_consume_from(rb, &b, &lost);
+	TEST_CHECK(token != NULL && lost != 0 && token->seq == 1 + lost);
+	TEST_CHECK(ring_buffer_seek(rb, &b, 1) != 0);
+	ring_buffer_commit(rb, token, 0);
+
+	return 0;
+}
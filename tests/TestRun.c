@@ -0,0 +1,63 @@
+#include "RingBuffer.h"
+#include "Test.h"
+#include <string.h>
+
+/**
+* a run claims contiguous committed elements as one span, and is committed or given back at once
+*/
+int main(void)
+{
+	static uint8_t mem[1 << 16];
+	ring_buffer_t* rb = ring_buffer_init(mem, sizeof(mem));
+	TEST_CHECK(rb != NULL);
+
+	ring_buffer_span_t span;
+	size_t count;
+	TEST_CHECK(ring_buffer_consume_run(rb, &span, 1 << 20, &count) != 0);
+
+	ring_buffer_token_t* token;
+	for (int i = 0; i < 100; i++)
+	{
+		token = ring_buffer_reserve(rb, 8, 0);
+		memcpy(token->data, &i, sizeof(i));
+		ring_buffer_commit(rb, token, 0);
+	}
+
+	TEST_CHECK(ring_buffer_consume_run(rb, &span, 1 << 20, &count) == 0);
+	TEST_CHECK(count == 100 && span.len == 100 * ring_buffer_node_cost(8));
+	int i = 0;
+	for (token = ring_buffer_span_next(&span, NULL); token != NULL; token = ring_buffer_span_next(&span, token), i++)
+	{
+		int value;
+		memcpy(&value, token->data, sizeof(value));
+		TEST_CHECK(value == i && token->seq == (uint64_t)i);
+	}
+	TEST_CHECK(i == 100);
+	TEST_CHECK(ring_buffer_consume_run(rb, &span, 1 << 20, &count) != 0);
+	TEST_CHECK(ring_buffer_commit_run(rb, &span, ring_buffer_flag_discard) == 0);
+
+	/* limited by bytes and by count */
+	TEST_CHECK(ring_buffer_consume_run(rb, &span, 10 * ring_buffer_node_cost(8), &count) == 0 && count == 10);
+	ring_buffer_span_t span2;
+	TEST_CHECK(ring_buffer_consume_run_ex(rb, &span2, 1 << 20, 5, &count) == 0 && count == 5);
+	token = ring_buffer_consume(rb, NULL);
+	TEST_CHECK(token != NULL && token->seq == 15);
+	ring_buffer_commit(rb, token, 0);
+	TEST_CHECK(ring_buffer_commit_run(rb, &span, 0) == 0);
+	TEST_CHECK(ring_buffer_commit_run(rb, &span2, 0) == 0);
+
+	ring_buffer_stat_t stat;
+	ring_buffer_stat(rb, &stat);
+	TEST_CHECK(stat.count == 84);
+
+	/* a run stops at an element being written */
+	token = ring_buffer_reserve(rb, 8, 0);
+	TEST_CHECK(ring_buffer_consume_run(rb, &span, 1 << 20, &count) == 0 && count == 84);
+	TEST_CHECK(ring_buffer_commit_run(rb, &span, 0) == 0);
+	TEST_CHECK(ring_buffer_consume_run(rb, &span, 1 << 20, &count) != 0);
+	ring_buffer_commit(rb, token, 0);
+	TEST_CHECK(ring_buffer_consume_run(rb, &span, 1 << 20, &count) == 0 && count == 1);
+	TEST_CHECK(ring_buffer_commit_run(rb, &span, 0) == 0);
+
+	return 0;
+}
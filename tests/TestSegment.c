@@ -0,0 +1,240 @@
+#include "RingBuffer.h"
+#include "Test.h"
+#include <string.h>
+
+static int s_live;
+
+static void* _test_alloc(size_t len, void* arg)
+{
+	(void)arg;
+	s_live++;
+	return malloc(len);
+}
+
+static void _test_free(void* ptr, size_t len, void* arg)
+{
+	(void)len;
+	(void)arg;
+	s_live--;
+	free(ptr);
+}
+
+static uint64_t s_now = 1000;
+
+static uint64_t _test_clock(void* arg)
+{
+	(void)arg;
+	return s_now;
+}
+
+static int _test_visit(ring_buffer_token_t* token, int state, unsigned chunk, void* arg)
+{
+	(void)token;
+	(void)state;
+	(void)chunk;
+	(void)arg;
+	return 0;
+}
+
+static uint32_t s_seed = 1;
+
+static uint32_t _test_rand(void)
+{
+	s_seed = s_seed * 1103515245 + 12345;
+	return s_seed >> 8;
+}
+
+/**
+* ring buffer grows with new segments instead of failing, keeps order across them, and gives drained ones back
+*/
+int main(void)
+{
+	static uint8_t mem[8192];
+	ring_buffer_t* rb = ring_buffer_init(mem, sizeof(mem));
+	TEST_CHECK(rb != NULL);
+	TEST_CHECK(ring_buffer_set_growth(rb, 8192, 8, _test_alloc, _test_free, NULL) == 0);
+	ring_buffer_set_checksum(rb, 1);
+
+	uint64_t wseq = 0;
+	uint64_t rseq = 0;
+	char buf[600];
+	ring_buffer_stat_t stat;
+	for (int round = 0; round < 200; round++)
+	{
+		const int nw = _test_rand() % 60;
+		const int nr = _test_rand() % 60;
+		for (int i = 0; i < nw; i++)
+		{
+			memset(buf, 0, sizeof(buf));
+			memcpy(buf, &wseq, sizeof(wseq));
+			if (ring_buffer_push(rb, buf, 8 + _test_rand() % 500, 0) != 0)
+			{
+				break;
+			}
+			wseq++;
+		}
+		for (int i = 0; i < nr; i++)
+		{
+			size_t len;
+			if (ring_buffer_pop(rb, buf, sizeof(buf), &len) != 0)
+			{
+				break;
+			}
+			uint64_t value;
+			memcpy(&value, buf, sizeof(value));
+			TEST_CHECK(value == rseq);
+			rseq++;
+		}
+		ring_buffer_stat(rb, &stat);
+		TEST_CHECK((int)stat.segments == s_live && stat.count == wseq - rseq);
+	}
+	size_t len;
+	while (ring_buffer_pop(rb, buf, sizeof(buf), &len) == 0)
+	{
+		rseq++;
+	}
+	TEST_CHECK(rseq == wseq);
+	ring_buffer_stat(rb, &stat);
+	TEST_CHECK(stat.count == 0 && stat.segments == 0 && s_live == 0);
+
+	/* an element being written in an old segment holds back newer ones */
+	ring_buffer_token_t* writing = ring_buffer_reserve(rb, 100, 0);
+	int n = 0;
+	do
+	{
+		TEST_CHECK(ring_buffer_push(rb, buf, 400, 0) == 0);
+		n++;
+		ring_buffer_stat(rb, &stat);
+	} while (stat.segments == 0);
+	for (int i = 0; i < 5; i++)
+	{
+		TEST_CHECK(ring_buffer_push(rb, buf, 400, 0) == 0);
+	}
+	TEST_CHECK(ring_buffer_consume(rb, NULL) == NULL);
+	ring_buffer_commit(rb, writing, 0);
+	int count = 0;
+	uint64_t last = 0;
+	ring_buffer_token_t* token;
+	while ((token = ring_buffer_consume(rb, NULL)) != NULL)
+	{
+		TEST_CHECK(count == 0 || token->seq > last);
+		last = token->seq;
+		ring_buffer_commit(rb, token, 0);
+		count++;
+	}
+	TEST_CHECK(count == n + 5 + 1);
+	ring_buffer_stat(rb, &stat);
+	TEST_CHECK(stat.segments == 0 && s_live == 0);
+
+	/* segment attached by caller is given back by growth callback */
+	void* segment = _test_alloc(8192, NULL);
+	TEST_CHECK(ring_buffer_attach(rb, segment, 8192) == 0);
+	TEST_CHECK(ring_buffer_push(rb, "x", 1, 0) == 0);
+	const int fd = test_tmpfile();
+	TEST_CHECK(ring_buffer_snapshot(rb, fd) == 0);
+	close(fd);
+	TEST_CHECK(ring_buffer_pop(rb, buf, sizeof(buf), &len) == 0 && len == 1 && buf[0] == 'x');
+	TEST_CHECK(s_live == 0);
+
+	/* a pending delayed element keeps ring buffer from growing, so it is still consumed after older elements */
+	ring_buffer_set_clock(rb, _test_clock, NULL);
+	token = ring_buffer_reserve_delayed(rb, 100, s_now + 10, 0);
+	TEST_CHECK(token != NULL);
+	n = 0;
+	while (ring_buffer_push(rb, buf, 400, 0) == 0)
+	{
+		n++;
+	}
+	TEST_CHECK(n != 0 && s_live == 0);
+	ring_buffer_commit(rb, token, 0);
+	TEST_CHECK(ring_buffer_push(rb, buf, 400, 0) != 0 && s_live == 0);
+	segment = _test_alloc(8192, NULL);
+	TEST_CHECK(ring_buffer_attach(rb, segment, 8192) != 0);
+	_test_free(segment, 8192, NULL);
+	s_now += 10;
+	count = 0;
+	while ((token = ring_buffer_consume(rb, NULL)) != NULL)
+	{
+		TEST_CHECK(count == 0 || token->seq > last);
+		TEST_CHECK((count == n) == (token->len == 100));
+		last = token->seq;
+		ring_buffer_commit(rb, token, 0);
+		count++;
+	}
+	TEST_CHECK(count == n + 1);
+
+	/* no delayed element is taken while grown */
+	while (s_live == 0)
+	{
+		TEST_CHECK(ring_buffer_push(rb, buf, 400, 0) == 0);
+	}
+	TEST_CHECK(ring_buffer_reserve_delayed(rb, 100, s_now + 10, 0) == NULL);
+
+	/* functions seeing only first segment fail while grown */
+	const ring_buffer_token_t* peeked[4];
+	ring_buffer_consumer_t consumer = { 0 };
+	ring_buffer_iter_t iter;
+	ring_buffer_iter_init(rb, &iter, 0, ring_buffer_state_committed, 0);
+	TEST_CHECK(ring_buffer_get(rb, last + 1) == NULL);
+	TEST_CHECK(ring_buffer_seek(rb, &consumer, last + 1) != 0);
+	TEST_CHECK(ring_buffer_consume_from(rb, &consumer, NULL) == NULL);
+	TEST_CHECK(ring_buffer_peek(rb, peeked, 4, NULL) == 0);
+	TEST_CHECK(ring_buffer_consume_latest(rb, 0, NULL) == NULL);
+	TEST_CHECK(ring_buffer_iter_next(rb, &iter) == NULL);
+	TEST_CHECK(ring_buffer_foreach_parallel(rb, _test_visit, NULL, NULL, 2) < 0);
+	TEST_CHECK(ring_buffer_snapshot_tail(rb, buf, sizeof(buf), 1) < 0);
+
+	/* settings changed later reach the segment being written */
+	ring_buffer_set_compress(rb, 1);
+	memset(buf, 0, sizeof(buf));
+	TEST_CHECK(ring_buffer_push(rb, buf, 400, 0) == 0);
+	ring_buffer_set_compress(rb, 0);
+	ring_buffer_stat(rb, &stat);
+	for (size_t i = 1; i < stat.count; i++)
+	{
+		token = ring_buffer_consume(rb, NULL);
+		ring_buffer_commit(rb, token, 0);
+	}
+	token = ring_buffer_consume(rb, NULL);
+	TEST_CHECK(token != NULL && token->len < 400);
+	ring_buffer_commit(rb, token, 0);
+	TEST_CHECK(ring_buffer_push(rb, buf, 400, 0) == 0);
+	while (ring_buffer_pop(rb, buf, sizeof(buf), &len) == 0)
+	{
+		rseq++;
+	}
+	TEST_CHECK(s_live == 0);
+	token = ring_buffer_reserve_delayed(rb, 100, s_now, 0);
+	TEST_CHECK(token != NULL);
+	ring_buffer_commit(rb, token, 0);
+	token = ring_buffer_consume(rb, NULL);
+	TEST_CHECK(token != NULL && token->seq > last);
+	ring_buffer_commit(rb, token, 0);
+
+	/* corrupted elements in a segment are still counted after it is given back */
+	while (s_live == 0)
+	{
+		TEST_CHECK(ring_buffer_push(rb, buf, 400, 0) == 0);
+	}
+	for (int i = 0; i < 2; i++)
+	{
+		token = ring_buffer_reserve(rb, 100, 0);
+		TEST_CHECK(token != NULL);
+		memset(token->data, 1, token->len);
+		ring_buffer_commit(rb, token, 0);
+		token->data[0] ^= 0xff;
+	}
+	ring_buffer_stat(rb, &stat);
+	const size_t corrupted = stat.corrupted;
+	while ((token = ring_buffer_consume(rb, NULL)) != NULL && token->len != 100)
+	{
+		ring_buffer_commit(rb, token, 0);
+	}
+	TEST_CHECK(token == NULL);
+	TEST_CHECK(ring_buffer_push(rb, "x", 1, 0) == 0 && ring_buffer_pop(rb, buf, sizeof(buf), &len) == 0);
+	ring_buffer_stat(rb, &stat);
+	TEST_CHECK(stat.corrupted == corrupted + 2 && stat.count == 0 && s_live == 0);
+	ring_buffer_exit(rb);
+
+	return 0;
+}
@@ -0,0 +1,70 @@
+#include "RingBuffer.h"
+#include "Test.h"
+#include <string.h>
+
+/**
+* sequence numbers follow reserve order, `ring_buffer_get` finds resident elements by them,
+* and `lost` of `ring_buffer_consume` counts overwritten elements.
+*/
+int main(void)
+{
+	static uint8_t mem[16384];
+	ring_buffer_t* rb = ring_buffer_init(mem, sizeof(mem));
+	TEST_CHECK(rb != NULL);
+
+	size_t total_lost = 0;
+	size_t consumed = 0;
+	for (uint64_t i = 0; i < 1000; i++)
+	{
+		ring_buffer_token_t* token = ring_buffer_reserve(rb, 16 + (i % 7) * 8, ring_buffer_flag_overwrite);
+		TEST_CHECK(token != NULL && token->seq == i);
+		memset(token->data, (int)(i & 0xff), token->len);
+		ring_buffer_commit(rb, token, 0);
+		TEST_CHECK(ring_buffer_get(rb, i) == token);
+
+		if (i % 5 == 0)
+		{
+			size_t lost;
+			token = ring_buffer_consume(rb, &lost);
+			TEST_CHECK(token != NULL);
+			total_lost += lost;
+			consumed++;
+			const uint64_t seq = token->seq;
+			ring_buffer_commit(rb, token, 0);
+			TEST_CHECK(ring_buffer_get(rb, seq) == NULL);
+		}
+	}
+
+	/* every element is consumed, resident or lost */
+	size_t resident = 0;
+	for (uint64_t seq = 0; seq < 1000; seq++)
+	{
+		ring_buffer_token_t* token = ring_buffer_get(rb, seq);
+		if (token != NULL)
+		{
+			TEST_CHECK(token->seq == seq && token->data[0] == (uint8_t)(seq & 0xff));
+			resident++;
+		}
+	}
+	size_t lost;
+	ring_buffer_token_t* token;
+	while ((token = ring_buffer_consume(rb, &lost)) != NULL)
+	{
+		total_lost += lost;
+		ring_buffer_commit(rb, token, 0);
+	}
+	TEST_CHECK(resident != 0);
+	TEST_CHECK(consumed + resident + total_lost == 1000);
+
+	/* discarded writes leave a gap, but nothing is lost */
+	token = ring_buffer_reserve(rb, 8, 0);
+	ring_buffer_commit(rb, token, ring_buffer_flag_discard);
+	token = ring_buffer_reserve(rb, 8, 0);
+	TEST_CHECK(token->seq == 1001);
+	ring_buffer_commit(rb, token, 0);
+	token = ring_buffer_consume(rb, &lost);
+	TEST_CHECK(token != NULL && token->seq == 1001 && lost == 0);
+	ring_buffer_commit(rb, token, 0);
+
+	return 0;
+}
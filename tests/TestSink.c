@@ -0,0 +1,146 @@
+#include "RingBufferInternal.h"
+#include "Test.h"
+#include <dirent.h>
+#include <string.h>
+
+#define TEST_PRODUCERS	4
+#define TEST_COUNT		20000
+
+static pthread_mutex_t s_lock = PTHREAD_MUTEX_INITIALIZER;
+static ring_buffer_t* s_rb;
+static uint64_t s_durable;
+static int s_callbacks;
+
+static void _test_lock(void* arg)
+{
+	(void)arg;
+	pthread_mutex_lock(&s_lock);
+}
+
+static void _test_unlock(void* arg)
+{
+	(void)arg;
+	pthread_mutex_unlock(&s_lock);
+}
+
+static void _test_durable(uint64_t seq, void* arg)
+{
+	(void)arg;
+	TEST_CHECK(s_callbacks == 0 || seq > s_durable);
+	s_durable = seq;
+	s_callbacks++;
+}
+
+static size_t _test_len(long id, int i)
+{
+	return 1 + (size_t)(i * 13 + id) % 290;
+}
+
+static void* _test_producer(void* arg)
+{
+	const long id = (long)arg;
+	uint8_t buf[300];
+	for (int i = 0; i < TEST_COUNT; i++)
+	{
+		const size_t len = _test_len(id, i);
+		memset(buf, (int)(id * 7 + i), len);
+		buf[0] = (uint8_t)id;
+		for (;;)
+		{
+			_test_lock(NULL);
+			const int ret = ring_buffer_push(s_rb, buf, len, 0);
+			_test_unlock(NULL);
+			if (ret == 0)
+			{
+				break;
+			}
+			usleep(10);
+		}
+	}
+	return NULL;
+}
+
+static int _test_compare(const void* a, const void* b)
+{
+	return strcmp(*(char* const*)a, *(char* const*)b);
+}
+
+/**
+* every element from several producers ends up in log segments in sequence order, then leaves ring buffer
+*/
+int main(void)
+{
+	static uint8_t mem[256 << 10];
+	s_rb = ring_buffer_init(mem, sizeof(mem));
+	TEST_CHECK(s_rb != NULL);
+
+	char dir[] = "/tmp/ringbuffer_sinkXXXXXX";
+	TEST_CHECK(mkdtemp(dir) != NULL);
+	ring_buffer_sink_opt_t opt = { dir, 256 << 10, 64 << 10, 200, _test_lock, _test_unlock, _test_durable, NULL };
+	TEST_CHECK(ring_buffer_sink_start(s_rb, &opt) == 0);
+	TEST_CHECK(ring_buffer_sink_start(s_rb, &opt) != 0);
+
+	pthread_t threads[TEST_PRODUCERS];
+	for (long i = 0; i < TEST_PRODUCERS; i++)
+	{
+		TEST_CHECK(pthread_create(&threads[i], NULL, _test_producer, (void*)i) == 0);
+	}
+	for (int i = 0; i < TEST_PRODUCERS; i++)
+	{
+		pthread_join(threads[i], NULL);
+	}
+	TEST_CHECK(ring_buffer_sink_stop(s_rb) == 0);
+	TEST_CHECK(ring_buffer_sink_durable(s_rb) == TEST_PRODUCERS * TEST_COUNT);
+	TEST_CHECK(s_durable == TEST_PRODUCERS * TEST_COUNT - 1);
+	ring_buffer_stat_t stat;
+	ring_buffer_stat(s_rb, &stat);
+	TEST_CHECK(stat.count == 0);
+
+	/* segment files are named by their first sequence number */
+	DIR* d = opendir(dir);
+	TEST_CHECK(d != NULL);
+	char* names[1024];
+	int n = 0;
+	struct dirent* entry;
+	while ((entry = readdir(d)) != NULL)
+	{
+		if (entry->d_name[0] != '.')
+		{
+			TEST_CHECK(n < 1024);
+			names[n++] = strdup(entry->d_name);
+		}
+	}
+	closedir(d);
+	qsort(names, n, sizeof(char*), _test_compare);
+
+	uint64_t seq = 0;
+	int counts[TEST_PRODUCERS] = { 0 };
+	for (int f = 0; f < n; f++)
+	{
+		char path[256];
+		snprintf(path, sizeof(path), "%s/%s", dir, names[f]);
+		TEST_CHECK(strtoull(names[f], NULL, 10) == seq);
+		FILE* fp = fopen(path, "rb");
+		TEST_CHECK(fp != NULL);
+		ring_buffer_snapshot_record_t record;
+		uint8_t buf[300];
+		while (fread(&record, sizeof(record), 1, fp) == 1)
+		{
+			TEST_CHECK(record.seq == seq && record.len <= sizeof(buf));
+			TEST_CHECK(fread(buf, 1, (size_t)record.len, fp) == record.len);
+			const int id = buf[0];
+			TEST_CHECK(id < TEST_PRODUCERS);
+			const int i = counts[id]++;
+			TEST_CHECK(record.len == _test_len(id, i));
+			TEST_CHECK(record.len == 1 || buf[record.len - 1] == (uint8_t)(id * 7 + i));
+			seq++;
+		}
+		fclose(fp);
+		unlink(path);
+		free(names[f]);
+	}
+	rmdir(dir);
+	TEST_CHECK(seq == TEST_PRODUCERS * TEST_COUNT);
+
+	return 0;
+}
@@ -0,0 +1,143 @@
+#include "RingBuffer.h"
+#include "Test.h"
+#include <pthread.h>
+#include <string.h>
+
+static pthread_mutex_t s_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void _test_lock(void* arg)
+{
+	(void)arg;
+	pthread_mutex_lock(&s_lock);
+}
+
+static void _test_unlock(void* arg)
+{
+	(void)arg;
+	pthread_mutex_unlock(&s_lock);
+}
+
+static size_t s_consumed = 0;
+
+/**
+* consume the newest element each time the snapshot lets the lock go
+*/
+static void _test_unlock_consume(void* arg)
+{
+	ring_buffer_t* rb = arg;
+	pthread_mutex_unlock(&s_lock);
+	pthread_mutex_lock(&s_lock);
+	ring_buffer_token_t* token = ring_buffer_consume_latest(rb, 0, NULL);
+	if (token != NULL)
+	{
+		ring_buffer_commit(rb, token, 0);
+		s_consumed++;
+	}
+	pthread_mutex_unlock(&s_lock);
+}
+
+/**
+* check a restored ring holds the newest committed elements of the source, with their sequence numbers
+*/
+static void _test_check_restored(ring_buffer_t* rb, uint64_t last_seq, uint64_t next)
+{
+	ring_buffer_token_t* token;
+	size_t count = 0;
+	uint64_t last = 0;
+	while ((token = ring_buffer_consume(rb, NULL)) != NULL)
+	{
+		for (size_t i = 0; i < token->len; i++)
+		{
+			TEST_CHECK(token->data[i] == (uint8_t)(token->seq & 0xff));
+		}
+		TEST_CHECK(token->seq % 7 != 0);
+		TEST_CHECK(count == 0 || token->seq > last);
+		last = token->seq;
+		count++;
+		ring_buffer_commit(rb, token, 0);
+	}
+	TEST_CHECK(count != 0 && last == last_seq);
+
+	token = ring_buffer_reserve(rb, 1, 0);
+	TEST_CHECK(token != NULL && token->seq == next);
+	ring_buffer_commit(rb, token, ring_buffer_flag_discard);
+}
+
+int main(void)
+{
+	static uint8_t mem[1 << 20];
+	static uint8_t mem2[1 << 16];
+	ring_buffer_t* rb = ring_buffer_init(mem, sizeof(mem));
+	TEST_CHECK(rb != NULL);
+
+	for (int i = 0; i < 5000; i++)
+	{
+		ring_buffer_token_t* token = ring_buffer_reserve(rb, i % 50, ring_buffer_flag_overwrite);
+		memset(token->data, i & 0xff, token->len);
+		ring_buffer_commit(rb, token, i % 7 == 0 ? ring_buffer_flag_discard : 0);
+	}
+
+	/* elements being written are not included */
+	ring_buffer_token_t* writing = ring_buffer_reserve(rb, 10, 0);
+	TEST_CHECK(writing != NULL && writing->seq == 5000);
+
+	int fd = test_tmpfile();
+	TEST_CHECK(ring_buffer_snapshot(rb, fd) == 0);
+	TEST_CHECK(lseek(fd, 0, SEEK_SET) == 0);
+
+	/* smaller ring keeps the newest elements */
+	ring_buffer_t* rb2 = ring_buffer_init(mem2, sizeof(mem2));
+	TEST_CHECK(ring_buffer_restore(rb2, fd) == 0);
+	_test_check_restored(rb2, 4999, 5001);
+	close(fd);
+
+	/* snapshot without the lock, producers go on meanwhile */
+	ring_buffer_commit(rb, writing, ring_buffer_flag_discard);
+	fd = test_tmpfile();
+	TEST_CHECK(ring_buffer_snapshot_ex(rb, fd, _test_lock, _test_unlock, NULL) == 0);
+	TEST_CHECK(lseek(fd, 0, SEEK_SET) == 0);
+
+	/* a drained ring buffer can be restored again, even if it has gone past the snapshot */
+	for (int i = 0; i < 100; i++)
+	{
+		ring_buffer_token_t* token = ring_buffer_reserve(rb2, 8, ring_buffer_flag_overwrite);
+		ring_buffer_commit(rb2, token, 0);
+	}
+	ring_buffer_token_t* token = ring_buffer_reserve(rb2, 8, 0);
+	TEST_CHECK(token->seq == 5102);
+	TEST_CHECK(ring_buffer_restore(rb2, fd) != 0);
+	ring_buffer_commit(rb2, token, ring_buffer_flag_discard);
+	while ((token = ring_buffer_consume(rb2, NULL)) != NULL)
+	{
+		ring_buffer_commit(rb2, token, 0);
+	}
+	TEST_CHECK(ring_buffer_restore(rb2, fd) == 0);
+	TEST_CHECK(ring_buffer_get(rb2, 5101) == NULL && ring_buffer_get(rb2, 4999) != NULL);
+	_test_check_restored(rb2, 4999, 5001);
+	TEST_CHECK(lseek(fd, 0, SEEK_SET) == 0);
+	TEST_CHECK(ring_buffer_restore(rb2, fd) == 0);
+	_test_check_restored(rb2, 4999, 5001);
+	close(fd);
+
+	/* only the batch being written is pinned, elements of the cut not written yet can still be consumed */
+	fd = test_tmpfile();
+	TEST_CHECK(ring_buffer_snapshot_ex(rb, fd, _test_lock, _test_unlock_consume, rb) == 0);
+	TEST_CHECK(s_consumed != 0);
+	TEST_CHECK(lseek(fd, 0, SEEK_SET) == 0);
+	TEST_CHECK(ring_buffer_restore(rb2, fd) == 0);
+	TEST_CHECK(ring_buffer_get(rb2, 4999) == NULL);
+	size_t restored = 0;
+	uint64_t last = 0;
+	while ((token = ring_buffer_consume(rb2, NULL)) != NULL)
+	{
+		TEST_CHECK(token->len == 0 || token->data[0] == (uint8_t)(token->seq & 0xff));
+		TEST_CHECK(restored == 0 || token->seq > last);
+		last = token->seq;
+		restored++;
+		ring_buffer_commit(rb2, token, 0);
+	}
+	TEST_CHECK(restored != 0 && last < 4999);
+	close(fd);
+
+	return 0;
+}
@@ -0,0 +1,100 @@
+#include "RingBuffer.h"
+#include "Test.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include <string.h>
+
+static uint8_t s_mem[1 << 14];
+static ring_buffer_t* s_rb;
+static pthread_mutex_t s_lock = PTHREAD_MUTEX_INITIALIZER;
+static atomic_int s_stop;
+
+/**
+* write elements whose bytes all depend on the value in the first 8 bytes, so torn copies are found
+*/
+static void* _test_producer(void* arg)
+{
+	(void)arg;
+	uint64_t value = 0;
+	while (!atomic_load(&s_stop))
+	{
+		value++;
+		const size_t len = 8 + value % 60;
+		pthread_mutex_lock(&s_lock);
+		ring_buffer_token_t* token = ring_buffer_reserve(s_rb, len, ring_buffer_flag_overwrite);
+		pthread_mutex_unlock(&s_lock);
+		memcpy(token->data, &value, sizeof(value));
+		memset(token->data + 8, (int)(value & 0xff), len - 8);
+		pthread_mutex_lock(&s_lock);
+		ring_buffer_commit(s_rb, token, 0);
+		pthread_mutex_unlock(&s_lock);
+	}
+	return NULL;
+}
+
+/**
+* check copied elements are newest first and not torn
+* @return	number of elements
+*/
+static int _test_check_tail(const void* buf, int n)
+{
+	const uint8_t* pos = buf;
+	uint64_t last = UINT64_MAX;
+	for (int i = 0; i < n; i++)
+	{
+		const ring_buffer_token_t* token = (const ring_buffer_token_t*)pos;
+		uint64_t value;
+		memcpy(&value, token->data, sizeof(value));
+		TEST_CHECK(token->seq < last);
+		for (size_t j = 8; j < token->len; j++)
+		{
+			TEST_CHECK(token->data[j] == (uint8_t)(value & 0xff));
+		}
+		last = token->seq;
+		pos += (sizeof(ring_buffer_token_t) + token->len + sizeof(void*) - 1) & ~(sizeof(void*) - 1);
+	}
+	return n;
+}
+
+/**
+* copy the newest elements without the lock while a producer overwrites them
+*/
+int main(void)
+{
+	static uint64_t buf[4096];
+	s_rb = ring_buffer_init(s_mem, sizeof(s_mem));
+	TEST_CHECK(s_rb != NULL);
+	TEST_CHECK(ring_buffer_snapshot_tail(s_rb, buf, sizeof(buf), 20) == 0);
+
+	/* newest first, only committed elements */
+	ring_buffer_token_t* token;
+	for (uint64_t i = 0; i < 5; i++)
+	{
+		token = ring_buffer_reserve(s_rb, 8, 0);
+		memcpy(token->data, &i, sizeof(i));
+		ring_buffer_commit(s_rb, token, 0);
+	}
+	ring_buffer_token_t* writing = ring_buffer_reserve(s_rb, 8, 0);
+	TEST_CHECK(ring_buffer_snapshot_tail(s_rb, buf, sizeof(buf), 3) == 3);
+	TEST_CHECK(((ring_buffer_token_t*)buf)->seq == 4);
+	TEST_CHECK(ring_buffer_snapshot_tail(s_rb, buf, sizeof(buf), 20) == 5);
+	TEST_CHECK(ring_buffer_snapshot_tail(s_rb, buf, 2 * (sizeof(ring_buffer_token_t) + 8), 20) == 2);
+	ring_buffer_commit(s_rb, writing, ring_buffer_flag_discard);
+
+	pthread_t thread;
+	TEST_CHECK(pthread_create(&thread, NULL, _test_producer, NULL) == 0);
+	long copied = 0;
+	for (int i = 0; i < 20000; i++)
+	{
+		const int n = ring_buffer_snapshot_tail(s_rb, buf, sizeof(buf), 20);
+		if (n > 0)
+		{
+			copied += _test_check_tail(buf, n);
+		}
+	}
+	atomic_store(&s_stop, 1);
+	pthread_join(thread, NULL);
+	TEST_CHECK(copied != 0);
+
+	return 0;
+}
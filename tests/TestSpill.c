@@ -0,0 +1,141 @@
+#include "RingBuffer.h"
+#include "Test.h"
+#include <fcntl.h>
+#include <string.h>
+
+static void _test_fill(uint8_t* buf, size_t len, unsigned id)
+{
+	for (size_t i = 0; i < len; i++)
+	{
+		buf[i] = (uint8_t)(id * 31 + i);
+	}
+}
+
+static size_t _test_len(unsigned id)
+{
+	return id % 97 == 0 ? 5000 + id % 300 : 1 + (id * 7) % 200;
+}
+
+static uint32_t s_seed = 1;
+
+static uint32_t _test_rand(void)
+{
+	s_seed = s_seed * 1103515245 + 12345;
+	return s_seed >> 8;
+}
+
+/**
+* elements which do not fit go to the spill file and come back in order with their sequence numbers
+*/
+int main(void)
+{
+	static uint8_t mem[64 << 10];
+	static uint8_t stage[4096];
+	static uint8_t buf[8192];
+	static uint8_t expect[8192];
+	ring_buffer_t* rb = ring_buffer_init(mem, sizeof(mem));
+	TEST_CHECK(rb != NULL);
+	const int fd = test_tmpfile();
+	TEST_CHECK(ring_buffer_set_spill(rb, fd, stage, 16) != 0);
+	TEST_CHECK(ring_buffer_set_spill(rb, fd, stage, sizeof(stage)) == 0);
+
+	unsigned wid = 0;
+	unsigned rid = 0;
+	size_t len;
+	ring_buffer_stat_t stat;
+	for (int round = 0; round < 200; round++)
+	{
+		const int np = _test_rand() % 400;
+		const int nc = _test_rand() % 400;
+		for (int i = 0; i < np; i++)
+		{
+			len = _test_len(wid);
+			_test_fill(buf, len, wid);
+			TEST_CHECK(ring_buffer_push(rb, buf, len, ring_buffer_flag_overwrite) == 0);
+			wid++;
+		}
+		for (int i = 0; i < nc; i++)
+		{
+			if (i % 2)
+			{
+				ring_buffer_token_t* token = ring_buffer_consume(rb, NULL);
+				if (token == NULL)
+				{
+					break;
+				}
+				TEST_CHECK(token->seq == rid);
+				TEST_CHECK(ring_buffer_read(rb, token, buf, sizeof(buf), &len) == 0);
+				ring_buffer_commit(rb, token, 0);
+			}
+			else if (ring_buffer_pop(rb, buf, sizeof(buf), &len) != 0)
+			{
+				break;
+			}
+			TEST_CHECK(len == _test_len(rid));
+			_test_fill(expect, len, rid);
+			TEST_CHECK(memcmp(buf, expect, len) == 0);
+			rid++;
+		}
+
+		/* reserve fails while elements wait in the file */
+		ring_buffer_stat(rb, &stat);
+		if (stat.spilled != 0)
+		{
+			TEST_CHECK(ring_buffer_reserve(rb, 1, 0) == NULL);
+			TEST_CHECK(ring_buffer_set_spill(rb, -1, NULL, 0) != 0);
+		}
+	}
+	while (ring_buffer_pop(rb, buf, sizeof(buf), &len) == 0)
+	{
+		TEST_CHECK(len == _test_len(rid));
+		_test_fill(expect, len, rid);
+		TEST_CHECK(memcmp(buf, expect, len) == 0);
+		rid++;
+	}
+	TEST_CHECK(rid == wid);
+	ring_buffer_stat(rb, &stat);
+	TEST_CHECK(stat.spilled == 0 && stat.count == 0);
+	TEST_CHECK(lseek(fd, 0, SEEK_END) == 0);
+
+	ring_buffer_token_t* token = ring_buffer_reserve(rb, 10, 0);
+	TEST_CHECK(token != NULL);
+	ring_buffer_commit(rb, token, 0);
+
+	/* an element which never fits is not spilled */
+	TEST_CHECK(ring_buffer_push(rb, buf, sizeof(mem), 0) != 0);
+	TEST_CHECK(ring_buffer_set_spill(rb, -1, NULL, 0) == 0);
+	close(fd);
+
+	/* failed writes lose spilled elements, but do not keep reserve blocked */
+	char path[] = "/tmp/ringbuffer_spillXXXXXX";
+	const int wfd = mkstemp(path);
+	TEST_CHECK(wfd >= 0);
+	const int rfd = open(path, O_RDONLY);
+	TEST_CHECK(rfd >= 0);
+	unlink(path);
+	close(wfd);
+	rb = ring_buffer_init(mem, sizeof(mem));
+	TEST_CHECK(ring_buffer_set_spill(rb, rfd, stage, sizeof(stage)) == 0);
+	memset(buf, 5, 100);
+	int pushed = 0;
+	while (ring_buffer_push(rb, buf, 100, 0) == 0)
+	{
+		pushed++;
+	}
+	ring_buffer_stat(rb, &stat);
+	TEST_CHECK(stat.spilled == 0 && (size_t)pushed > stat.count);
+	size_t lost;
+	token = ring_buffer_consume(rb, &lost);
+	TEST_CHECK(token != NULL && lost == (size_t)pushed - stat.count);
+	ring_buffer_commit(rb, token, 0);
+	while (ring_buffer_pop(rb, buf, sizeof(buf), &len) == 0)
+	{
+	}
+	token = ring_buffer_reserve(rb, 10, 0);
+	TEST_CHECK(token != NULL);
+	ring_buffer_commit(rb, token, 0);
+	TEST_CHECK(ring_buffer_push(rb, buf, 100, 0) == 0);
+	close(rfd);
+
+	return 0;
+}
@@ -0,0 +1,148 @@
+#include "RingBufferInternal.h"
+#include "Test.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <string.h>
+
+#define TEST_PRODUCERS	4
+#define TEST_COUNT		30000
+
+static pthread_mutex_t s_lock = PTHREAD_MUTEX_INITIALIZER;
+static ring_buffer_t* s_rb;
+static atomic_int s_done;
+
+static void _test_lock(void* arg)
+{
+	(void)arg;
+	pthread_mutex_lock(&s_lock);
+}
+
+static void _test_unlock(void* arg)
+{
+	(void)arg;
+	pthread_mutex_unlock(&s_lock);
+}
+
+static size_t _test_len(long id, int i)
+{
+	return 1 + (size_t)(i * 13 + id) % (i % 50 ? 290 : 2900);
+}
+
+static void* _test_producer(void* arg)
+{
+	const long id = (long)arg;
+	uint8_t buf[3000];
+	for (int i = 0; i < TEST_COUNT; i++)
+	{
+		const size_t len = _test_len(id, i);
+		memset(buf, (int)(id * 7 + i), len);
+		buf[0] = (uint8_t)id;
+		for (;;)
+		{
+			_test_lock(NULL);
+			const int ret = ring_buffer_push(s_rb, buf, len, 0);
+			_test_unlock(NULL);
+			if (ret == 0)
+			{
+				break;
+			}
+			sched_yield();
+		}
+	}
+	atomic_fetch_add(&s_done, 1);
+	return NULL;
+}
+
+/**
+* runs are written in sequence order while producers go on. a failed write keeps its elements in ring buffer.
+*/
+int main(void)
+{
+	static uint8_t mem[1 << 20];
+	s_rb = ring_buffer_init(mem, sizeof(mem));
+	TEST_CHECK(s_rb != NULL);
+
+	char path[] = "/tmp/ringbuffer_uringXXXXXX";
+	const int fd = mkstemp(path);
+	TEST_CHECK(fd >= 0);
+	ring_buffer_uring_opt_t opt = { fd, 0, 8, 16 << 10, _test_lock, _test_unlock, NULL };
+	if (ring_buffer_uring_start(s_rb, &opt) != 0)
+	{
+		/* kernel without io_uring, or forbidden by seccomp */
+		TEST_CHECK(errno == ENOSYS || errno == EPERM);
+		unlink(path);
+		return TEST_SKIP;
+	}
+
+	pthread_t threads[TEST_PRODUCERS];
+	for (long i = 0; i < TEST_PRODUCERS; i++)
+	{
+		TEST_CHECK(pthread_create(&threads[i], NULL, _test_producer, (void*)i) == 0);
+	}
+	long total = 0;
+	while (atomic_load(&s_done) < TEST_PRODUCERS || total < TEST_PRODUCERS * TEST_COUNT)
+	{
+		const int ret = ring_buffer_uring_drain(s_rb, 1);
+		TEST_CHECK(ret >= 0);
+		total += ret;
+		if (ret == 0)
+		{
+			usleep(50);
+		}
+	}
+	for (int i = 0; i < TEST_PRODUCERS; i++)
+	{
+		pthread_join(threads[i], NULL);
+	}
+	TEST_CHECK(ring_buffer_uring_stop(s_rb) == 0);
+	TEST_CHECK(total == TEST_PRODUCERS * TEST_COUNT);
+	ring_buffer_stat_t stat;
+	ring_buffer_stat(s_rb, &stat);
+	TEST_CHECK(stat.count == 0);
+
+	FILE* fp = fdopen(fd, "rb");
+	TEST_CHECK(fp != NULL);
+	ring_buffer_snapshot_record_t record;
+	static uint8_t buf[3000];
+	uint64_t seq = 0;
+	int counts[TEST_PRODUCERS] = { 0 };
+	while (fread(&record, sizeof(record), 1, fp) == 1)
+	{
+		TEST_CHECK(record.seq == seq && record.len <= sizeof(buf));
+		TEST_CHECK(fread(buf, 1, (size_t)record.len, fp) == record.len);
+		const int id = buf[0];
+		TEST_CHECK(id < TEST_PRODUCERS);
+		const int i = counts[id]++;
+		TEST_CHECK(record.len == _test_len(id, i));
+		TEST_CHECK(record.len == 1 || buf[record.len - 1] == (uint8_t)(id * 7 + i));
+		seq++;
+	}
+	TEST_CHECK(seq == TEST_PRODUCERS * TEST_COUNT);
+
+	/* writes to a read only file fail, elements stay */
+	const int bad = open(path, O_RDONLY);
+	TEST_CHECK(bad >= 0);
+	opt.fd = bad;
+	TEST_CHECK(ring_buffer_uring_start(s_rb, &opt) == 0);
+	memset(buf, 1, 100);
+	for (int i = 0; i < 50; i++)
+	{
+		TEST_CHECK(ring_buffer_push(s_rb, buf, 100, 0) == 0);
+	}
+	int ret = 0;
+	for (int i = 0; i < 10 && ret >= 0; i++)
+	{
+		ret = ring_buffer_uring_drain(s_rb, 1);
+	}
+	TEST_CHECK(ret == -1);
+	TEST_CHECK(ring_buffer_uring_stop(s_rb) == EBADF);
+	ring_buffer_stat(s_rb, &stat);
+	TEST_CHECK(stat.count == 50);
+	TEST_CHECK(ring_buffer_pop(s_rb, buf, sizeof(buf), NULL) == 0 && buf[0] == 1);
+
+	close(bad);
+	fclose(fp);
+	unlink(path);
+	return 0;
+}
@@ -0,0 +1,67 @@
+#include "RingBuffer.h"
+#include "Test.h"
+
+static int s_high;
+static int s_low;
+
+static void _test_watermark(ring_buffer_t* rb, int high, void* arg)
+{
+	(void)rb;
+	(void)arg;
+	if (high)
+	{
+		s_high++;
+	}
+	else
+	{
+		s_low++;
+	}
+}
+
+/**
+* callbacks are called once when fill level reaches high watermark, and once when it falls to low watermark
+*/
+int main(void)
+{
+	static uint8_t mem[16384];
+	ring_buffer_t* rb = ring_buffer_init(mem, sizeof(mem));
+	TEST_CHECK(rb != NULL);
+
+	TEST_CHECK(ring_buffer_set_watermark(rb, ring_buffer_watermark_count, 2, 4, _test_watermark, NULL) != 0);
+	TEST_CHECK(ring_buffer_set_watermark(rb, ring_buffer_watermark_count, 8, 2, _test_watermark, NULL) == 0);
+
+	ring_buffer_token_t* token;
+	for (int round = 0; round < 3; round++)
+	{
+		for (int i = 0; i < 10; i++)
+		{
+			token = ring_buffer_reserve(rb, 8, 0);
+			ring_buffer_commit(rb, token, 0);
+			TEST_CHECK(s_high == round + (i >= 7));
+		}
+		TEST_CHECK(s_low == round);
+		for (int i = 0; i < 10; i++)
+		{
+			token = ring_buffer_consume(rb, NULL);
+			ring_buffer_commit(rb, token, 0);
+			TEST_CHECK(s_low == round + (i >= 7));
+		}
+	}
+
+	/* byte unit */
+	TEST_CHECK(ring_buffer_set_watermark(rb, ring_buffer_watermark_bytes, 4 * ring_buffer_node_cost(8), 0, _test_watermark, NULL) == 0);
+	s_high = s_low = 0;
+	for (int i = 0; i < 4; i++)
+	{
+		token = ring_buffer_reserve(rb, 8, 0);
+		ring_buffer_commit(rb, token, 0);
+	}
+	TEST_CHECK(s_high == 1 && s_low == 0);
+	while ((token = ring_buffer_consume(rb, NULL)) != NULL)
+	{
+		ring_buffer_commit(rb, token, 0);
+	}
+	TEST_CHECK(s_high == 1 && s_low == 1);
+
+	return 0;
+}